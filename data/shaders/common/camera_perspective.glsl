@@ -15,4 +15,9 @@ void calcCameraRay(vec2 pixelPos, vec2 screenSize, out vec3 rayPos, out vec3 ray
 	rayPos = cameraPosition;
 }
 
+//The angle covered by a single pixel (used for ray cone texture LOD)
+float calcPixelSpreadAngle(vec2 screenSize) {
+	return length(cameraMatrix[1]) / screenSize.y;
+}
+
 #endif
@@ -5,10 +5,17 @@
 #define MATH_PI_HALF (0.5 * 3.141592653589793)
 #define MATH_PI_DOUBLE (2.0 * 3.141592653589793)
 
-#define NONUNIFORM_MESH_IDX (nonuniformEXT(gl_InstanceCustomIndexEXT))
-
 #define NORMAL_EPSILON (0.00001)
 
+//The types in which normals and texture coordinates are stored in the vertex buffers
+#ifdef COMPACT_VERTICES
+	#define PACKED_NORMAL uint
+	#define PACKED_TEX_COORDS uint
+#else
+	#define PACKED_NORMAL vec3
+	#define PACKED_TEX_COORDS vec2
+#endif
+
 struct Vertex
 {
 	//TODO: Split Vertex into SoA instead of AoS to allows for accessing only specific elements
@@ -22,13 +29,35 @@ struct Vertex
 struct hitPayload
 {
 	vec3 hitValue;
+	
+	//The angle by which the ray cone of a primary ray widens per unit of distance
+	float spreadAngle;
 };
 
-struct Material
-{
-	//TODO: SoA (same as vertex)
-	uint albedoIndex;
-};
+vec3 unpackNormal(vec3 normal) {
+	return normal;
+}
+
+//Decodes an octahedral-encoded normal (two 16-bit snorm values)
+vec3 unpackNormal(uint normal) {
+	vec2 f = unpackSnorm2x16(normal);
+	vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+	
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	
+	return normalize(n);
+}
+
+vec2 unpackTexCoords(vec2 texCoords) {
+	return texCoords;
+}
+
+//Decodes half precision texture coordinates
+vec2 unpackTexCoords(uint texCoords) {
+	return unpackHalf2x16(texCoords);
+}
 
 //theta - angle aroung up axis (0, 2pi)
 //phi - angle between horizontal plane and the point (-pi/2, pi/2)
@@ -44,4 +73,17 @@ vec3 normalizedToUnitSphere(float theta, float phi) {
 	return toUnitSphere(MATH_PI_DOUBLE * theta, MATH_PI * phi - MATH_PI_HALF);
 }
 
+//Texture LOD of a ray cone hitting a triangle ("Texture Level of Detail Strategies for Real-Time Ray Tracing", Ray Tracing Gems)
+//p0-p2 are the world space vertex positions and t0-t2 their texture coordinates
+float calcRayConeLod(vec3 p0, vec3 p1, vec3 p2, vec2 t0, vec2 t1, vec2 t2, ivec2 texSize, float coneWidth, vec3 rayDir) {
+	vec3 worldCross = cross(p1 - p0, p2 - p0);
+	
+	float worldArea = max(length(worldCross), 1e-20);
+	float texelArea = max(float(texSize.x * texSize.y) * abs((t1.x - t0.x) * (t2.y - t0.y) - (t2.x - t0.x) * (t1.y - t0.y)), 1e-20);
+	
+	float cosine = max(abs(dot(rayDir, worldCross / worldArea)), 1e-4);
+	
+	return 0.5 * log2(texelArea / worldArea) + log2(max(coneWidth, 1e-20)) - log2(cosine);
+}
+
 #endif
@@ -0,0 +1,50 @@
+#ifndef GEOMETRY_GLSL
+#define GEOMETRY_GLSL
+
+//Requires GL_EXT_buffer_reference and GL_EXT_scalar_block_layout
+
+#include "common/common.glsl"
+
+//The mesh data is read through the device addresses in the geometry records (see "Note on geometry buffers" in SceneLoader.cpp)
+layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer PositionBuffer { vec3 v[]; };
+layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer NormalBuffer { PACKED_NORMAL v[]; };
+layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer TexCoordBuffer { PACKED_TEX_COORDS v[]; };
+layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer IndexBuffer { uint i[]; };
+
+//The mesh's index data stores 16-bit indices (packed two per word)
+#define MESH_FLAG_16_BIT_INDICES 1u
+
+//Must match `GeometryRecord` in SceneLoader.h
+struct GeometryRecord
+{
+	PositionBuffer positions;
+	NormalBuffer normals;
+	TexCoordBuffer texCoords;
+	IndexBuffer indices;
+	
+	uint materialIndex;
+	uint flags;
+	uint firstFace;
+	uint padding;
+};
+
+//The geometry record of the hit geometry (`geometryRecords` must be declared by the shader)
+#define GEOMETRY_RECORD (geometryRecords[gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT])
+
+//The index of the hit triangle within its mesh (a geometry can start anywhere in the mesh's index data)
+#define MESH_PRIMITIVE_ID (GEOMETRY_RECORD.firstFace + uint(gl_PrimitiveID))
+
+//Extracts the indices of a triangle from the two words that hold its 16-bit indices
+uvec3 unpackIndices16(uint word0, uint word1, uint primitive) {
+	return (primitive & 1u) == 0u ? uvec3(word0 & 0xFFFFu, word0 >> 16, word1 & 0xFFFFu)
+								  : uvec3(word0 >> 16, word1 & 0xFFFFu, word1 >> 16);
+}
+
+//Reads the indices of a triangle from index data declared as `uint i[]`. Index data is read
+//as words, so that 16-bit indices don't require 16-bit storage buffer access.
+#define FETCH_TRIANGLE_INDICES(indexArray, meshFlags, primitive) \
+	(((meshFlags) & MESH_FLAG_16_BIT_INDICES) != 0u ? \
+		unpackIndices16(indexArray[(3u * uint(primitive)) >> 1], indexArray[((3u * uint(primitive)) >> 1) + 1u], uint(primitive)) : \
+		uvec3(indexArray[3u * uint(primitive)], indexArray[3u * uint(primitive) + 1u], indexArray[3u * uint(primitive) + 2u]))
+
+#endif
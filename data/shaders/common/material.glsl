@@ -0,0 +1,19 @@
+#ifndef MATERIAL_GLSL
+#define MATERIAL_GLSL
+
+//Requires GL_EXT_buffer_reference, GL_EXT_scalar_block_layout and GL_EXT_nonuniform_qualifier
+
+//The material fields are stored as arrays that are indexed by the material index (see "Note on the material table" in SceneLoader.h)
+layout(buffer_reference, scalar, buffer_reference_align = 4) readonly buffer MaterialIndexArray { uint v[]; };
+
+//Must match `MaterialTable` in SceneLoader.h
+struct MaterialTable
+{
+	MaterialIndexArray albedoIndices;
+	MaterialIndexArray samplerIndices;
+};
+
+//Combines a texture with the sampler for its wrap modes (`albedoTextures` and `textureSamplers` must be declared by the shader)
+#define ALBEDO_TEXTURE(albedoIndex, samplerIndex) sampler2D(albedoTextures[nonuniformEXT(albedoIndex)], textureSamplers[nonuniformEXT(samplerIndex)])
+
+#endif
@@ -2,6 +2,7 @@
 
 #include <fstream>
 #include <cassert>
+#include <filesystem>
 
 #include "ProjectBase.h"
 
@@ -55,6 +56,15 @@ public:
 	{
 		return std::string(DATA_DIRECTORY_PATH) + "/shaders/";
 	}
+
+	//Returns the path of a file in the cache directory (the directory is created if it doesn't exist)
+	inline static std::string cachePath(const std::string& name)
+	{
+		std::error_code error;
+		std::filesystem::create_directories(CACHE_DIRECTORY_PATH, error);
+
+		return std::string(CACHE_DIRECTORY_PATH) + "/" + name;
+	}
 };
 
 #define FATAL_ERROR(...) printf(__VA_ARGS__); assert(false)
\ No newline at end of file
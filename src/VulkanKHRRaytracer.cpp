@@ -35,6 +35,13 @@ const char* s_pipelineNames[] = {
 	"Sampler Zoo"
 };
 
+//Indexed by `BLASBuildMode`
+const char* s_blasBuildModeNames[] = {
+	"Serial",
+	"Batched",
+	"Host"
+};
+
 PipelineDefFunc s_pipelineFunctions[] = {
 	&createPipeline<BasicRaytracingPipeline>,
 	&createPipeline<SamplerZooPipeline>
@@ -71,7 +78,7 @@ void VulkanKHRRaytracer::start()
 	//Create logical device
 	RaytracingDeviceFeatures* rtFeatures = m_raytracingDevice.init(&m_device);
 
-	m_device.createLogicalDevice(deviceExtensions, s_validationLayers, rtFeatures->pNext);
+	m_device.createLogicalDevice(deviceExtensions, s_validationLayers, rtFeatures->pNext, &rtFeatures->deviceFeatures);
 
 	delete rtFeatures;
 
@@ -120,9 +127,9 @@ void VulkanKHRRaytracer::handlePipelineChange()
 	m_pipeline->createRenderTarget(m_renderTargetWidth, m_renderTargetHeight);
 }
 
-void VulkanKHRRaytracer::loadSceneDeferred()
+void VulkanKHRRaytracer::loadSceneDeferred(SceneLoadOptions options)
 {
-	std::shared_ptr<Scene> newScene = SceneLoader::loadScene(&m_raytracingDevice, m_scenePath, m_sceneProgessTracker);
+	std::shared_ptr<Scene> newScene = SceneLoader::loadScene(&m_raytracingDevice, m_scenePath, m_sceneProgessTracker, options);
 
 	std::lock_guard<std::mutex> guard(m_frameLock);
 	
@@ -223,7 +230,8 @@ void VulkanKHRRaytracer::mainLoop()
 			m_skipPipeline = true;
 			m_showProgressDialog = true;
 
-			std::thread(&VulkanKHRRaytracer::loadSceneDeferred, this).detach();
+			//The options are copied, so that the UI can't change them while the scene is loading
+			std::thread(&VulkanKHRRaytracer::loadSceneDeferred, this, m_sceneLoadOptions).detach();
 
 			m_reloadScene = false;
 		}
@@ -232,6 +240,12 @@ void VulkanKHRRaytracer::mainLoop()
 
 		if (!m_skipPipeline)
 		{
+			//Animated scenes change every frame, just like a moving camera
+			if (m_playAnimations && m_scene->animate(commandBuffer, deltaTime))
+			{
+				m_pipeline->notifyCameraChange();
+			}
+
 			m_pipeline->raytrace(commandBuffer);
 		}
 
@@ -278,6 +292,24 @@ void VulkanKHRRaytracer::drawUI()
 				ImGui::PopItemFlag();
 				ImGui::PopStyleVar();
 			}
+
+			ImGui::Checkbox("Use scene cache", &m_sceneLoadOptions.useSceneCache);
+			ImGui::Checkbox("Batch uploads", &m_sceneLoadOptions.batchUploads);
+			ImGui::Checkbox("Compress textures", &m_sceneLoadOptions.compressTextures);
+			ImGui::Checkbox("Compact vertices", &m_sceneLoadOptions.compactVertices);
+			ImGui::Checkbox("Optimize meshes", &m_sceneLoadOptions.optimizeMeshes);
+			ImGui::Checkbox("Merge small meshes", &m_sceneLoadOptions.mergeSmallMeshes);
+			ImGui::Checkbox("Classify triangle opacity", &m_sceneLoadOptions.classifyTriangleOpacity);
+
+			int blasBuildMode = (int)m_sceneLoadOptions.blasBuildMode;
+			if (ImGui::Combo("BLAS builds", &blasBuildMode, s_blasBuildModeNames, sizeof(s_blasBuildModeNames) / sizeof(s_blasBuildModeNames[0])))
+			{
+				m_sceneLoadOptions.blasBuildMode = (BLASBuildMode)blasBuildMode;
+			}
+
+			ImGui::Checkbox("Benchmark BLAS builds", &m_sceneLoadOptions.benchmarkBLASBuilds);
+
+			ImGui::Checkbox("Play animations", &m_playAnimations);
 		}
 
 		if (ImGui::CollapsingHeader("Rendering Backend", ImGuiTreeNodeFlags_DefaultOpen))
@@ -422,6 +454,11 @@ void VulkanKHRRaytracer::showPerformancePopup()
 		ImGui::Separator();
 
 		ImGui::Text("Frame Time: %.1fms", m_presenter.getRenderTime() * 1000.0f);
+
+		MemoryAllocatorStats memoryStats = m_device.getMemoryStats();
+
+		ImGui::Text("Device Memory: %.1fMB in %u blocks, %.1fMB dedicated (%u)", (memoryStats.blockSize / (1024.0 * 1024.0)), memoryStats.blockCount,
+					(memoryStats.dedicatedSize / (1024.0 * 1024.0)), memoryStats.dedicatedAllocationCount);
 	}
 
 	ImGui::End();
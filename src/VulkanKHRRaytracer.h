@@ -40,7 +40,9 @@ private:
 	VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
 
 	bool m_autoReloadScene = true;
+	bool m_playAnimations = true;
 	bool m_reloadScene = false;
+	SceneLoadOptions m_sceneLoadOptions;
 	std::shared_ptr<Scene> m_scene = nullptr;
 
 	std::mutex m_frameLock;
@@ -50,7 +52,7 @@ private:
 private:
 	VulkanKHRRaytracer();
 
-	void loadSceneDeferred();
+	void loadSceneDeferred(SceneLoadOptions options);
 	void handlePipelineChange();
 
 	void mainLoop();
@@ -0,0 +1,622 @@
+#include "MemoryAllocator.h"
+
+#include "RenderDevice.h"
+#include "Common.h"
+
+#include <algorithm>
+
+#define MEMORY_TLSF_SL_BITS 3
+#define MEMORY_TLSF_SL_COUNT (1 << MEMORY_TLSF_SL_BITS)
+#define MEMORY_TLSF_FL_COUNT 48
+
+//Ranges smaller than this are all in the first level, which is split linearly
+#define MEMORY_TLSF_SMALL_SIZE_LOG2 8
+#define MEMORY_TLSF_SMALL_SIZE (1ull << MEMORY_TLSF_SMALL_SIZE_LOG2)
+
+//The rest of a free range is only split off if it's at least this large
+#define MEMORY_TLSF_MIN_RANGE_SIZE 64
+
+//Pools per memory type (device address, image, strategy and size class)
+#define MEMORY_POOLS_PER_TYPE 16
+
+struct MemoryRange
+{
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+
+	bool isFree = true;
+
+	//Neighbouring ranges in the block
+	MemoryRange* prevPhysical = nullptr;
+	MemoryRange* nextPhysical = nullptr;
+
+	//Neighbouring ranges in the free list
+	MemoryRange* prevFree = nullptr;
+	MemoryRange* nextFree = nullptr;
+};
+
+struct MemoryBlock
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+	uint8_t* mappedData = nullptr;
+
+	MemoryPool* pool = nullptr;
+	uint32_t allocationCount = 0;
+
+	//Linear strategy
+	VkDeviceSize linearOffset = 0;
+
+	//General strategy
+	MemoryRange* firstRange = nullptr;
+
+	uint64_t flBitmap = 0;
+	uint32_t slBitmaps[MEMORY_TLSF_FL_COUNT] = {};
+	MemoryRange* freeLists[MEMORY_TLSF_FL_COUNT][MEMORY_TLSF_SL_COUNT] = {};
+};
+
+struct MemoryPool
+{
+	uint32_t memoryTypeIndex = 0;
+	MemoryRequest request;
+
+	VkDeviceSize blockSize = 0;
+	std::vector<MemoryBlock*> blocks;
+};
+
+static uint32_t findHighestBit(uint64_t mask)
+{
+	uint32_t index = 0;
+
+	while (mask >>= 1)
+	{
+		index++;
+	}
+
+	return index;
+}
+
+static uint32_t findLowestBit(uint64_t mask)
+{
+	uint32_t index = 0;
+
+	while (!(mask & 1))
+	{
+		mask >>= 1;
+		index++;
+	}
+
+	return index;
+}
+
+/* ********************** */
+/*    TLSF free lists     */
+/* ********************** */
+
+static void mapSize(VkDeviceSize size, uint32_t& fl, uint32_t& sl)
+{
+	if (size < MEMORY_TLSF_SMALL_SIZE)
+	{
+		fl = 0;
+		sl = (uint32_t)(size / (MEMORY_TLSF_SMALL_SIZE / MEMORY_TLSF_SL_COUNT));
+
+		return;
+	}
+
+	uint32_t log2 = findHighestBit(size);
+
+	fl = log2 - MEMORY_TLSF_SMALL_SIZE_LOG2 + 1;
+	sl = (uint32_t)(size >> (log2 - MEMORY_TLSF_SL_BITS)) & (MEMORY_TLSF_SL_COUNT - 1);
+}
+
+//Rounds the size up to the next list, so that every range in the list that it maps to is large enough
+static void mapSearchSize(VkDeviceSize size, uint32_t& fl, uint32_t& sl)
+{
+	if (size < MEMORY_TLSF_SMALL_SIZE)
+	{
+		size += MEMORY_TLSF_SMALL_SIZE / MEMORY_TLSF_SL_COUNT - 1;
+	}
+	else
+	{
+		size += (1ull << (findHighestBit(size) - MEMORY_TLSF_SL_BITS)) - 1;
+	}
+
+	mapSize(size, fl, sl);
+}
+
+static void insertFreeRange(MemoryBlock& block, MemoryRange* range)
+{
+	uint32_t fl, sl;
+	mapSize(range->size, fl, sl);
+
+	range->isFree = true;
+	range->prevFree = nullptr;
+	range->nextFree = block.freeLists[fl][sl];
+
+	if (range->nextFree)
+	{
+		range->nextFree->prevFree = range;
+	}
+
+	block.freeLists[fl][sl] = range;
+
+	block.flBitmap |= 1ull << fl;
+	block.slBitmaps[fl] |= 1u << sl;
+}
+
+static void removeFreeRange(MemoryBlock& block, MemoryRange* range)
+{
+	uint32_t fl, sl;
+	mapSize(range->size, fl, sl);
+
+	if (range->prevFree)
+	{
+		range->prevFree->nextFree = range->nextFree;
+	}
+	else
+	{
+		block.freeLists[fl][sl] = range->nextFree;
+	}
+
+	if (range->nextFree)
+	{
+		range->nextFree->prevFree = range->prevFree;
+	}
+
+	if (!block.freeLists[fl][sl])
+	{
+		block.slBitmaps[fl] &= ~(1u << sl);
+
+		if (!block.slBitmaps[fl])
+		{
+			block.flBitmap &= ~(1ull << fl);
+		}
+	}
+
+	range->isFree = false;
+	range->prevFree = nullptr;
+	range->nextFree = nullptr;
+}
+
+static MemoryRange* findFreeRange(const MemoryBlock& block, uint32_t fl, uint32_t sl)
+{
+	if (fl >= MEMORY_TLSF_FL_COUNT)
+	{
+		return nullptr;
+	}
+
+	uint32_t slMap = block.slBitmaps[fl] & (~0u << sl);
+
+	if (!slMap)
+	{
+		uint64_t flMap = block.flBitmap & (~0ull << (fl + 1));
+
+		if (!flMap)
+		{
+			return nullptr;
+		}
+
+		fl = findLowestBit(flMap);
+		slMap = block.slBitmaps[fl];
+	}
+
+	return block.freeLists[fl][findLowestBit(slMap)];
+}
+
+//Inserts a new range after `range` in the block
+static MemoryRange* splitRange(MemoryRange* range, VkDeviceSize size)
+{
+	MemoryRange* rest = new MemoryRange();
+	rest->offset = range->offset + size;
+	rest->size = range->size - size;
+	rest->prevPhysical = range;
+	rest->nextPhysical = range->nextPhysical;
+
+	if (range->nextPhysical)
+	{
+		range->nextPhysical->prevPhysical = rest;
+	}
+
+	range->nextPhysical = rest;
+	range->size = size;
+
+	return rest;
+}
+
+static MemoryRange* allocateRange(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment)
+{
+	//Any range in the list fits the allocation, no matter where it starts
+	uint32_t fl, sl;
+	mapSearchSize(size + alignment - 1, fl, sl);
+
+	MemoryRange* range = findFreeRange(block, fl, sl);
+
+	if (!range)
+	{
+		return nullptr;
+	}
+
+	removeFreeRange(block, range);
+
+	//Return the padding in front of the allocation to the free lists (the previous range is never
+	//free, since it would have been merged with this one)
+	VkDeviceSize padding = UINT32_ALIGN(range->offset, alignment) - range->offset;
+
+	if (padding > 0)
+	{
+		MemoryRange* aligned = splitRange(range, padding);
+
+		insertFreeRange(block, range);
+		range = aligned;
+	}
+
+	if (range->size - size >= MEMORY_TLSF_MIN_RANGE_SIZE)
+	{
+		insertFreeRange(block, splitRange(range, size));
+	}
+
+	range->isFree = false;
+
+	return range;
+}
+
+static void freeRange(MemoryBlock& block, MemoryRange* range)
+{
+	//Merge with the free neighbours
+	MemoryRange* prev = range->prevPhysical;
+
+	if (prev && prev->isFree)
+	{
+		removeFreeRange(block, prev);
+
+		prev->size += range->size;
+		prev->nextPhysical = range->nextPhysical;
+
+		if (range->nextPhysical)
+		{
+			range->nextPhysical->prevPhysical = prev;
+		}
+
+		delete range;
+		range = prev;
+	}
+
+	MemoryRange* next = range->nextPhysical;
+
+	if (next && next->isFree)
+	{
+		removeFreeRange(block, next);
+
+		range->size += next->size;
+		range->nextPhysical = next->nextPhysical;
+
+		if (next->nextPhysical)
+		{
+			next->nextPhysical->prevPhysical = range;
+		}
+
+		delete next;
+	}
+
+	insertFreeRange(block, range);
+}
+
+static bool allocateFromBlock(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, Allocation& allocation)
+{
+	if (block.pool->request.strategy == MemoryStrategy::Linear)
+	{
+		VkDeviceSize offset = UINT32_ALIGN(block.linearOffset, alignment);
+
+		if (offset + size > block.size)
+		{
+			return false;
+		}
+
+		block.linearOffset = offset + size;
+
+		allocation.block = &block;
+		allocation.offset = offset;
+
+		return true;
+	}
+
+	MemoryRange* range = allocateRange(block, size, alignment);
+
+	if (!range)
+	{
+		return false;
+	}
+
+	allocation.block = &block;
+	allocation.range = range;
+	allocation.offset = range->offset;
+
+	return true;
+}
+
+/* ********************** */
+/*    Memory allocator    */
+/* ********************** */
+
+MemoryAllocator::MemoryAllocator() {}
+MemoryAllocator::~MemoryAllocator() {}
+
+void MemoryAllocator::init(VkDevice device, const VkPhysicalDeviceMemoryProperties& memProperties)
+{
+	m_device = device;
+	m_memProperties = memProperties;
+
+	m_pools.clear();
+	m_pools.resize(VK_MAX_MEMORY_TYPES * MEMORY_POOLS_PER_TYPE);
+
+	m_stats = {};
+}
+
+void MemoryAllocator::destroy()
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+
+	if (m_stats.allocationCount > 0 || m_stats.dedicatedAllocationCount > 0)
+	{
+		std::cout << "Device memory leaked: " << m_stats.allocationCount << " allocations, " << m_stats.dedicatedAllocationCount << " dedicated allocations" << std::endl;
+	}
+
+	for (std::unique_ptr<MemoryPool>& pool : m_pools)
+	{
+		if (!pool)
+		{
+			continue;
+		}
+
+		for (MemoryBlock* block : pool->blocks)
+		{
+			destroyBlock(block);
+		}
+
+		pool = nullptr;
+	}
+
+	m_pools.clear();
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const
+{
+	for (uint32_t i = 0; i < m_memProperties.memoryTypeCount; ++i)
+	{
+		if (typeFilter & (1 << i) && (m_memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			return i;
+		}
+	}
+
+	return (uint32_t)-1;
+}
+
+MemoryPool& MemoryAllocator::getPool(uint32_t memoryTypeIndex, const MemoryRequest& request, bool isSmall)
+{
+	uint32_t poolIndex = memoryTypeIndex * MEMORY_POOLS_PER_TYPE;
+	poolIndex += (request.deviceAddress ? 8 : 0) + (request.isImage ? 4 : 0);
+	poolIndex += (request.strategy == MemoryStrategy::Linear ? 2 : 0) + (isSmall ? 1 : 0);
+
+	std::unique_ptr<MemoryPool>& pool = m_pools[poolIndex];
+
+	if (!pool)
+	{
+		pool = std::make_unique<MemoryPool>();
+		pool->memoryTypeIndex = memoryTypeIndex;
+
+		pool->request.strategy = request.strategy;
+		pool->request.deviceAddress = request.deviceAddress;
+		pool->request.isImage = request.isImage;
+
+		//Blocks shouldn't take up a large part of small heaps (eg. the host visible part of device local memory)
+		VkDeviceSize heapSize = m_memProperties.memoryHeaps[m_memProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+
+		pool->blockSize = std::min<VkDeviceSize>(isSmall ? MEMORY_SMALL_BLOCK_SIZE : MEMORY_BLOCK_SIZE, heapSize / 8);
+	}
+
+	return *pool;
+}
+
+VkDeviceMemory MemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, const MemoryRequest& request, uint8_t** mappedData)
+{
+	VkMemoryDedicatedAllocateInfo dedicatedInfo = {};
+	dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+	dedicatedInfo.buffer = request.dedicatedBuffer;
+	dedicatedInfo.image = request.dedicatedImage;
+
+	bool isDedicated = request.dedicated && (request.dedicatedBuffer != VK_NULL_HANDLE || request.dedicatedImage != VK_NULL_HANDLE);
+
+	VkMemoryAllocateFlagsInfo allocFlags = {};
+	allocFlags.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+	allocFlags.pNext = isDedicated ? &dedicatedInfo : nullptr;
+	allocFlags.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	if (request.deviceAddress)
+	{
+		allocInfo.pNext = &allocFlags;
+	}
+	else if (isDedicated)
+	{
+		allocInfo.pNext = &dedicatedInfo;
+	}
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VK_CHECK(vkAllocateMemory(m_device, &allocInfo, nullptr, &memory));
+
+	*mappedData = nullptr;
+
+	if (m_memProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		VK_CHECK(vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, (void**)mappedData));
+	}
+
+	return memory;
+}
+
+MemoryBlock* MemoryAllocator::createBlock(MemoryPool& pool)
+{
+	MemoryBlock* block = new MemoryBlock();
+	block->size = pool.blockSize;
+	block->pool = &pool;
+	block->memory = allocateDeviceMemory(pool.blockSize, pool.memoryTypeIndex, pool.request, &block->mappedData);
+
+	if (pool.request.strategy == MemoryStrategy::General)
+	{
+		block->firstRange = new MemoryRange();
+		block->firstRange->size = pool.blockSize;
+
+		insertFreeRange(*block, block->firstRange);
+	}
+
+	pool.blocks.push_back(block);
+
+	m_stats.blockCount++;
+	m_stats.blockSize += block->size;
+
+	return block;
+}
+
+void MemoryAllocator::destroyBlock(MemoryBlock* block)
+{
+	MemoryRange* range = block->firstRange;
+
+	while (range)
+	{
+		MemoryRange* next = range->nextPhysical;
+		delete range;
+
+		range = next;
+	}
+
+	//Freeing the memory also unmaps it
+	vkFreeMemory(m_device, block->memory, nullptr);
+
+	m_stats.blockCount--;
+	m_stats.blockSize -= block->size;
+
+	delete block;
+}
+
+Allocation MemoryAllocator::allocate(const MemoryRequest& request)
+{
+	uint32_t memoryTypeIndex = findMemoryType(request.requirements.memoryTypeBits, request.properties);
+
+	if (memoryTypeIndex == (uint32_t)-1)
+	{
+		FATAL_ERROR("Could not find appropriate memory type for allocation");
+	}
+
+	VkDeviceSize size = std::max<VkDeviceSize>(request.requirements.size, 1);
+	VkDeviceSize alignment = std::max<VkDeviceSize>(request.requirements.alignment, 1);
+
+	std::lock_guard<std::mutex> guard(m_mutex);
+
+	MemoryPool& pool = getPool(memoryTypeIndex, request, size <= MEMORY_SMALL_REQUEST_SIZE);
+
+	Allocation allocation;
+
+	if (request.dedicated || size > std::min<VkDeviceSize>(MEMORY_DEDICATED_THRESHOLD, pool.blockSize / 2))
+	{
+		MemoryRequest dedicatedRequest = request;
+		dedicatedRequest.dedicated = true;
+
+		allocation.memory = allocateDeviceMemory(size, memoryTypeIndex, dedicatedRequest, &allocation.mappedData);
+		allocation.size = size;
+
+		m_stats.dedicatedAllocationCount++;
+		m_stats.dedicatedSize += size;
+
+		return allocation;
+	}
+
+	bool isAllocated = false;
+
+	for (MemoryBlock* block : pool.blocks)
+	{
+		if ((isAllocated = allocateFromBlock(*block, size, alignment, allocation)))
+		{
+			break;
+		}
+	}
+
+	//Only create a new block if the allocation doesn't fit into any of the existing ones
+	if (!isAllocated && !allocateFromBlock(*createBlock(pool), size, alignment, allocation))
+	{
+		FATAL_ERROR("Could not sub-allocate memory from a new block");
+	}
+
+	allocation.block->allocationCount++;
+
+	allocation.memory = allocation.block->memory;
+	allocation.size = size;
+	allocation.mappedData = allocation.block->mappedData ? allocation.block->mappedData + allocation.offset : nullptr;
+
+	m_stats.allocationCount++;
+	m_stats.allocatedSize += size;
+
+	return allocation;
+}
+
+void MemoryAllocator::free(const Allocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard(m_mutex);
+
+	if (!allocation.block)
+	{
+		vkFreeMemory(m_device, allocation.memory, nullptr);
+
+		m_stats.dedicatedAllocationCount--;
+		m_stats.dedicatedSize -= allocation.size;
+
+		return;
+	}
+
+	MemoryBlock* block = allocation.block;
+
+	if (allocation.range)
+	{
+		freeRange(*block, allocation.range);
+	}
+
+	m_stats.allocationCount--;
+	m_stats.allocatedSize -= allocation.size;
+
+	if (--block->allocationCount > 0)
+	{
+		return;
+	}
+
+	block->linearOffset = 0;
+
+	//Keep one empty block around for the next allocations
+	std::vector<MemoryBlock*>& blocks = block->pool->blocks;
+
+	for (MemoryBlock* other : blocks)
+	{
+		if (other != block && other->allocationCount == 0)
+		{
+			blocks.erase(std::find(blocks.begin(), blocks.end(), block));
+			destroyBlock(block);
+
+			break;
+		}
+	}
+}
+
+MemoryAllocatorStats MemoryAllocator::getStats()
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+
+	return m_stats;
+}
\ No newline at end of file
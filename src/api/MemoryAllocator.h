@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <volk.h>
+
+#include <vector>
+#include <memory>
+#include <mutex>
+
+/*
+ ------------------------------------
+	Note on device memory allocation
+ ------------------------------------
+
+ Drivers limit the number of live allocations (maxMemoryAllocationCount, which is 4096 on many of them) and every
+ `vkAllocateMemory` is expensive, so resources don't get their own allocation. Instead, the allocator allocates large
+ blocks of memory and sub-allocates resources from them. Blocks belong to pools, one for every combination of:
+	- Memory type
+	- Whether buffer device addresses are used (VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT)
+	- Whether the memory is used for images or buffers (so that bufferImageGranularity never has to be considered)
+	- Strategy
+	- Size class (requests of up to MEMORY_SMALL_REQUEST_SIZE share smaller blocks, so that the many small uniform
+	  and staging buffers don't fragment the blocks that scene data is allocated from)
+
+ There are two strategies:
+	- General: blocks are managed with a two-level segregated fit (TLSF) allocator. Free ranges are kept in lists that
+	  are bucketed by the power of two of their size (first level), which is split into MEMORY_TLSF_SL_COUNT linear
+	  buckets (second level). Bitmaps of the non-empty lists find a large enough free range in constant time, and
+	  freed ranges are merged with their free neighbours right away.
+	- Linear: allocations are bumped from the end of a block, and the block is only reused once all of its allocations
+	  have been freed. This is meant for short-lived memory (eg. scratch and staging buffers).
+
+ Requests larger than MEMORY_DEDICATED_THRESHOLD (or half a block) and resources that the driver wants to have their
+ own allocation (VkMemoryDedicatedRequirements, usually large images) get a dedicated allocation. Blocks that become
+ empty are released, except for one per pool, so that reloading a scene doesn't reallocate all of them.
+
+ Host visible blocks stay mapped for as long as they exist and `Allocation::mappedData` points to the allocation,
+ so memory never has to be mapped and unmapped by the resources that use it.
+*/
+
+//Requests of up to this size are allocated from the small blocks
+#define MEMORY_SMALL_REQUEST_SIZE (256ull * 1024)
+
+#define MEMORY_SMALL_BLOCK_SIZE (16ull * 1024 * 1024)
+#define MEMORY_BLOCK_SIZE (128ull * 1024 * 1024)
+
+//Requests larger than this always get their own allocation
+#define MEMORY_DEDICATED_THRESHOLD (32ull * 1024 * 1024)
+
+enum class MemoryStrategy
+{
+	//Two-level segregated fit, for memory that is freed in any order
+	General,
+
+	//Bump allocation, for short-lived memory that is freed soon after it was allocated
+	Linear
+};
+
+struct MemoryRequest
+{
+	VkMemoryRequirements requirements = {};
+	VkMemoryPropertyFlags properties = 0;
+
+	MemoryStrategy strategy = MemoryStrategy::General;
+
+	//The memory is bound to buffers with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+	bool deviceAddress = false;
+
+	//The memory is bound to optimally tiled images
+	bool isImage = false;
+
+	//Forces a dedicated allocation (for `dedicatedBuffer` or `dedicatedImage`, if one of them is set)
+	bool dedicated = false;
+	VkBuffer dedicatedBuffer = VK_NULL_HANDLE;
+	VkImage dedicatedImage = VK_NULL_HANDLE;
+};
+
+struct MemoryBlock;
+struct MemoryRange;
+struct MemoryPool;
+
+struct Allocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+
+	//Points to the allocation if the memory is host visible (null otherwise)
+	uint8_t* mappedData = nullptr;
+
+	//The block and range the allocation was made from (both are null for dedicated allocations)
+	MemoryBlock* block = nullptr;
+	MemoryRange* range = nullptr;
+};
+
+struct MemoryAllocatorStats
+{
+	uint32_t blockCount = 0;
+	VkDeviceSize blockSize = 0;
+
+	uint32_t dedicatedAllocationCount = 0;
+	VkDeviceSize dedicatedSize = 0;
+
+	//Allocations made from blocks
+	uint32_t allocationCount = 0;
+	VkDeviceSize allocatedSize = 0;
+};
+
+class MemoryAllocator
+{
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties m_memProperties = {};
+
+	//Created when they are first needed (see `getPool`)
+	std::vector<std::unique_ptr<MemoryPool>> m_pools;
+
+	MemoryAllocatorStats m_stats;
+
+	//Scenes are loaded on a separate thread
+	std::mutex m_mutex;
+private:
+	MemoryPool& getPool(uint32_t memoryTypeIndex, const MemoryRequest& request, bool isSmall);
+
+	VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, const MemoryRequest& request, uint8_t** mappedData);
+
+	MemoryBlock* createBlock(MemoryPool& pool);
+	void destroyBlock(MemoryBlock* block);
+public:
+	MemoryAllocator();
+	~MemoryAllocator();
+
+	void init(VkDevice device, const VkPhysicalDeviceMemoryProperties& memProperties);
+	void destroy();
+
+	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+
+	Allocation allocate(const MemoryRequest& request);
+	void free(const Allocation& allocation);
+
+	MemoryAllocatorStats getStats();
+};
\ No newline at end of file
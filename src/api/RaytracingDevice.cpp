@@ -2,10 +2,13 @@
 
 #include "api/RaytracingPipeline.h"
 
+#include "utils/ThreadPool.h"
+
 #include <glm/ext/matrix_transform.hpp>
 
 #include <algorithm>
 #include <iostream>
+#include <thread>
 
 RaytracingDevice::~RaytracingDevice()
 {
@@ -32,8 +35,16 @@ RaytracingDeviceFeatures* RaytracingDevice::init(RenderDevice* renderDevice)
 
 	m_physicalDeviceProperties = {};
 
+	m_maintenance3Properties = {};
+	m_maintenance3Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_3_PROPERTIES;
+
+	m_deviceIDProperties = {};
+	m_deviceIDProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+	m_deviceIDProperties.pNext = &m_maintenance3Properties;
+
 	m_accelStructProperties = {};
 	m_accelStructProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+	m_accelStructProperties.pNext = &m_deviceIDProperties;
 
 	m_rtPipelineProperties = {};
 	m_rtPipelineProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
@@ -51,7 +62,7 @@ RaytracingDeviceFeatures* RaytracingDevice::init(RenderDevice* renderDevice)
 	//Create feature struct
 	RaytracingDeviceFeatures* features = new RaytracingDeviceFeatures();
 
-	features->accelStructFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR, nullptr, VK_TRUE, VK_FALSE, VK_FALSE, VK_FALSE, VK_TRUE };
+	features->accelStructFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR, nullptr, VK_TRUE, VK_FALSE, VK_FALSE, m_accelStructFeatures.accelerationStructureHostCommands, VK_TRUE };
 	features->rtPipelineFeatures = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR, &features->accelStructFeatures, VK_TRUE, VK_FALSE, VK_FALSE, VK_FALSE, VK_FALSE };
 	features->bufferAddress = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES, &features->rtPipelineFeatures, VK_TRUE, VK_FALSE, VK_FALSE };
 
@@ -61,7 +72,6 @@ RaytracingDeviceFeatures* RaytracingDevice::init(RenderDevice* renderDevice)
 	features->descriptorIndexing.descriptorBindingVariableDescriptorCount = VK_TRUE;
 	features->descriptorIndexing.runtimeDescriptorArray = VK_TRUE;
 	features->descriptorIndexing.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
-	features->descriptorIndexing.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
 
 	features->hostQueryReset = {};
 	features->hostQueryReset.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES;
@@ -75,16 +85,16 @@ RaytracingDeviceFeatures* RaytracingDevice::init(RenderDevice* renderDevice)
 
 	features->pNext = &features->scalarBlockLayout;
 
+	//Block-compressed scene textures are optional
+	features->deviceFeatures.textureCompressionBC = m_physicalDeviceFeatures.textureCompressionBC;
+
 	m_renderDevice = renderDevice;
 
 	return features;
 }
 
-std::shared_ptr<const BLASGeometryInfo> RaytracingDevice::compileGeometry(VkBuffer vertexBuffer, unsigned int vertexSize, unsigned int maxVertex, VkBuffer indexBuffer, unsigned int indexCount, VkDeviceOrHostAddressConstKHR transformData, VkGeometryFlagsKHR flags) const
+std::shared_ptr<const BLASGeometryInfo> RaytracingDevice::compileGeometry(VkDeviceAddress vertexAddress, unsigned int vertexSize, unsigned int maxVertex, VkDeviceAddress indexAddress, VkIndexType indexType, unsigned int indexCount, VkDeviceOrHostAddressConstKHR transformData, VkGeometryFlagsKHR flags) const
 {
-	VkDeviceAddress vertexAddress = m_renderDevice->getBufferAddress(vertexBuffer);
-	VkDeviceAddress indexAddress = m_renderDevice->getBufferAddress(indexBuffer);
-
 	VkAccelerationStructureGeometryKHR geometry = {};
 	geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
 	geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
@@ -93,7 +103,7 @@ std::shared_ptr<const BLASGeometryInfo> RaytracingDevice::compileGeometry(VkBuff
 	geometry.geometry.triangles.vertexData.deviceAddress = vertexAddress;
 	geometry.geometry.triangles.vertexStride = vertexSize;
 	geometry.geometry.triangles.maxVertex = maxVertex;
-	geometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
+	geometry.geometry.triangles.indexType = indexType;
 	geometry.geometry.triangles.indexData.deviceAddress = indexAddress;
 	geometry.geometry.triangles.transformData = transformData;
 	geometry.flags = flags;
@@ -112,6 +122,42 @@ std::shared_ptr<const BLASGeometryInfo> RaytracingDevice::compileGeometry(VkBuff
 	return geometryInfo;
 }
 
+std::shared_ptr<const BLASGeometryInfo> RaytracingDevice::compileHostGeometry(const void* vertexData, unsigned int vertexSize, unsigned int maxVertex, const void* indexData, VkIndexType indexType, unsigned int indexCount, VkGeometryFlagsKHR flags) const
+{
+	VkAccelerationStructureGeometryKHR geometry = {};
+	geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+	geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+	geometry.geometry.triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+	geometry.geometry.triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+	geometry.geometry.triangles.vertexData.hostAddress = vertexData;
+	geometry.geometry.triangles.vertexStride = vertexSize;
+	geometry.geometry.triangles.maxVertex = maxVertex;
+	geometry.geometry.triangles.indexType = indexType;
+	geometry.geometry.triangles.indexData.hostAddress = indexData;
+	geometry.geometry.triangles.transformData.hostAddress = nullptr;
+	geometry.flags = flags;
+
+	VkAccelerationStructureBuildRangeInfoKHR rangeInfo = {};
+	rangeInfo.firstVertex = 0;
+	rangeInfo.primitiveCount = indexCount;
+	rangeInfo.primitiveOffset = 0;
+	rangeInfo.transformOffset = 0;
+
+	std::shared_ptr<BLASGeometryInfo> geometryInfo = std::make_shared<BLASGeometryInfo>();
+
+	geometryInfo->geometryArray.push_back(geometry);
+	geometryInfo->rangeInfoArray.push_back(rangeInfo);
+
+	return geometryInfo;
+}
+
+static void writeInstanceTransform(VkAccelerationStructureInstanceKHR& instance, const glm::mat4& transform)
+{
+	memcpy(instance.transform.matrix[0], &transform[0], 4 * sizeof(float));
+	memcpy(instance.transform.matrix[1], &transform[1], 4 * sizeof(float));
+	memcpy(instance.transform.matrix[2], &transform[2], 4 * sizeof(float));
+}
+
 VkAccelerationStructureInstanceKHR RaytracingDevice::compileInstances(const BottomLevelAS& blas, glm::mat4 transform, uint32_t instanceCustomIndex, uint32_t mask, uint32_t sbtRecordOffset, VkGeometryInstanceFlagsKHR flags) const
 {
 	//Get acceleration structure address
@@ -128,9 +174,7 @@ VkAccelerationStructureInstanceKHR RaytracingDevice::compileInstances(const Bott
 	instance.instanceShaderBindingTableRecordOffset = sbtRecordOffset;
 	instance.flags = flags;
 
-	memcpy(instance.transform.matrix[0], &transform[0], 4 * sizeof(float));
-	memcpy(instance.transform.matrix[1], &transform[1], 4 * sizeof(float));
-	memcpy(instance.transform.matrix[2], &transform[2], 4 * sizeof(float));
+	writeInstanceTransform(instance, transform);
 
 	return instance;
 }
@@ -154,105 +198,113 @@ VkAccelerationStructureInstanceKHR RaytracingDevice::compileInstances(const Bott
 	m_device = device;
 */
 
-BLASBuildResult RaytracingDevice::buildBLAS(std::vector<BLASCreateInfo>& blasCIList) const
+BottomLevelAS RaytracingDevice::prepareBLAS(const BLASCreateInfo& createInfo, VkAccelerationStructureBuildTypeKHR buildType, VkMemoryRequirements& memRequirements) const
 {
 	VkDevice deviceHandle = m_renderDevice->getDevice();
 
-	std::vector<BottomLevelAS> blasList;
-	std::vector<std::pair<VkDeviceSize, VkDeviceSize>> blasRanges;
+	/*
+	 ----------------------------------
+	      Note on BLAS construction 
+	 ----------------------------------
+
+	`VkAccelerationStructureBuildGeometryInfoKHR` takes an array of `VkAccelerationStructureGeometryKHR`,
+	each of which represents some geometry that the acceleration structure will be built from. When calling
+	`vkGetAccelerationStructureBuildSizesKHR`, `pMaxPrimitiveCounts` is an array parrallel to `pGeometries`,
+	where each entry is the number of primitives in its respective entry in `pGeometries`.
+	*/
+
+	BottomLevelAS blas;
+	blas.geometryInfo = createInfo.geometryInfo;
+
+	blas.buildInfo = {};
+	blas.buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+	blas.buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+	blas.buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+	blas.buildInfo.srcAccelerationStructure = VK_NULL_HANDLE;
+	blas.buildInfo.dstAccelerationStructure = VK_NULL_HANDLE;
+	blas.buildInfo.geometryCount = (uint32_t)createInfo.geometryInfo->geometryArray.size();
+	blas.buildInfo.pGeometries = createInfo.geometryInfo->geometryArray.data();
+	blas.buildInfo.flags = createInfo.flags;
+
+	//Query acceleration structure size
+	std::vector<uint32_t> maxPrimitiveCount(blas.buildInfo.geometryCount);
+	
+	for (size_t i = 0; i < blas.buildInfo.geometryCount; ++i)
+	{
+		maxPrimitiveCount[i] = createInfo.geometryInfo->rangeInfoArray[i].primitiveCount;
+	}
 
-	const VkBufferUsageFlags accelStructBufferUsage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
-	const VkBufferUsageFlags scratchBufferUsage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	blas.sizeInfo = {};
+	blas.sizeInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
 
-	const VkMemoryPropertyFlags accelStructMemoryPropery = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-	const VkMemoryPropertyFlags scratchMemoryPropery = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	vkGetAccelerationStructureBuildSizesKHR(deviceHandle, buildType, &blas.buildInfo, maxPrimitiveCount.data(), &blas.sizeInfo);
 
-	/* Pull BLAS size details */
-	VkDeviceSize totalStoreSize = 0;
-	VkDeviceSize maxScratchSize = 0;
+	//Create acceleration structure buffer
+	VkBufferCreateInfo bufferCI = {};
+	bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferCI.size = blas.sizeInfo.accelerationStructureSize;
+	bufferCI.usage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferCI.queueFamilyIndexCount = 0;
+	bufferCI.pQueueFamilyIndices = nullptr;
 
-	uint32_t mutualMemoryTypeBits = 0xFFFFFFFF;
+	VK_CHECK(vkCreateBuffer(deviceHandle, &bufferCI, nullptr, &blas.accelStorageBuffer));
 
-	for (const BLASCreateInfo& createInfo : blasCIList)
-	{
-		/*
-		 ----------------------------------
-		      Note on BLAS construction 
-		 ----------------------------------
+	//Create acceleration structure
+	VkAccelerationStructureCreateInfoKHR accelCreateInfo = {};
+	accelCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+	accelCreateInfo.buffer = blas.accelStorageBuffer;
+	accelCreateInfo.offset = 0;
+	accelCreateInfo.size = blas.sizeInfo.accelerationStructureSize;
+	accelCreateInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
 
-		`VkAccelerationStructureBuildGeometryInfoKHR` takes an array of `VkAccelerationStructureGeometryKHR`,
-		each of which represents some geometry that the acceleration structure will be built from. When calling
-		`vkGetAccelerationStructureBuildSizesKHR`, `pMaxPrimitiveCounts` is an array parrallel to `pGeometries`,
-		where each entry is the number of primitives in its respective entry in `pGeometries`.
-		*/
+	VK_CHECK(vkCreateAccelerationStructureKHR(deviceHandle, &accelCreateInfo, nullptr, &blas.accelerationStructure));
 
-		BottomLevelAS blas;
-		blas.geometryInfo = createInfo.geometryInfo;
+	blas.buildInfo.dstAccelerationStructure = blas.accelerationStructure;
 
-		blas.buildInfo = {};
-		blas.buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
-		blas.buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-		blas.buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-		blas.buildInfo.srcAccelerationStructure = VK_NULL_HANDLE;
-		blas.buildInfo.dstAccelerationStructure = VK_NULL_HANDLE;
-		blas.buildInfo.geometryCount = (uint32_t)createInfo.geometryInfo->geometryArray.size();
-		blas.buildInfo.pGeometries = createInfo.geometryInfo->geometryArray.data();
-		blas.buildInfo.flags = createInfo.flags;
-
-		//Query acceleration structure size
-		std::vector<uint32_t> maxPrimitiveCount(blas.buildInfo.geometryCount);
-		
-		for (size_t i = 0; i < blas.buildInfo.geometryCount; ++i)
-		{
-			maxPrimitiveCount[i] = createInfo.geometryInfo->rangeInfoArray[i].primitiveCount;
-		}
+	vkGetBufferMemoryRequirements(deviceHandle, blas.accelStorageBuffer, &memRequirements);
 
-		blas.sizeInfo = {};
-		blas.sizeInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
-
-		vkGetAccelerationStructureBuildSizesKHR(deviceHandle, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &blas.buildInfo, maxPrimitiveCount.data(), &blas.sizeInfo);
+	return blas;
+}
 
-		//Create acceleration structure buffer
-		VkBufferCreateInfo bufferCI = {};
-		bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferCI.size = blas.sizeInfo.accelerationStructureSize;
-		bufferCI.usage = accelStructBufferUsage;
-		bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		bufferCI.queueFamilyIndexCount = 0;
-		bufferCI.pQueueFamilyIndices = nullptr;
+BLASBuildResult RaytracingDevice::buildBLAS(std::vector<BLASCreateInfo>& blasCIList, BLASBuildMode mode) const
+{
+	if (mode == BLASBuildMode::Host)
+	{
+		return buildBLASOnHost(blasCIList);
+	}
 
-		VK_CHECK(vkCreateBuffer(deviceHandle, &bufferCI, nullptr, &blas.accelStorageBuffer));
+	VkDevice deviceHandle = m_renderDevice->getDevice();
 
-		//Create acceleration structure
-		VkAccelerationStructureCreateInfoKHR createInfo = {};
-		createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-		createInfo.buffer = blas.accelStorageBuffer;
-		createInfo.offset = 0;
-		createInfo.size = blas.sizeInfo.accelerationStructureSize;
-		createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+	std::vector<BottomLevelAS> blasList;
+	std::vector<VkMemoryRequirements> blasRequirements;
 
-		VK_CHECK(vkCreateAccelerationStructureKHR(deviceHandle, &createInfo, nullptr, &blas.accelerationStructure));
+	const VkBufferUsageFlags accelStructBufferUsage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	const VkBufferUsageFlags scratchBufferUsage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
 
-		blas.buildInfo.dstAccelerationStructure = blas.accelerationStructure;
+	const VkMemoryPropertyFlags accelStructMemoryPropery = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	const VkMemoryPropertyFlags scratchMemoryPropery = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 
-		//Update memory requirements
-		VkMemoryRequirements memRequirements;
-		vkGetBufferMemoryRequirements(deviceHandle, blas.accelStorageBuffer, &memRequirements);
+	/* Pull BLAS size details */
+	VkDeviceSize maxScratchSize = 0;
+	VkDeviceSize accelStructAlignment = 1;
 
-		VkDeviceSize pageOffset = UINT32_ALIGN(totalStoreSize, memRequirements.alignment);
-		VkDeviceSize actualSize = memRequirements.size;
+	uint32_t mutualMemoryTypeBits = 0xFFFFFFFF;
 
-		totalStoreSize = pageOffset + actualSize;
+	for (const BLASCreateInfo& createInfo : blasCIList)
+	{
+		VkMemoryRequirements memRequirements;
+		BottomLevelAS blas = prepareBLAS(createInfo, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, memRequirements);
 
 		mutualMemoryTypeBits &= memRequirements.memoryTypeBits;
+		accelStructAlignment = std::max(accelStructAlignment, memRequirements.alignment);
 
 		maxScratchSize = std::max(blas.sizeInfo.buildScratchSize, maxScratchSize);
 
-		blasRanges.push_back(std::make_pair(pageOffset, actualSize));
+		blasRequirements.push_back(memRequirements);
 		blasList.push_back(blas);
 	}
 
-	//Allocate memory
 	if (!mutualMemoryTypeBits)
 	{
 		FATAL_ERROR("Could not find memory type that supports all bottom-level acceleration structures");
@@ -265,206 +317,518 @@ BLASBuildResult RaytracingDevice::buildBLAS(std::vector<BLASCreateInfo>& blasCIL
 		FATAL_ERROR("Could not find appropriate memory type for acceleration strctures");
 	}
 
-	//Allocate storage memory
-	VkMemoryAllocateFlagsInfo memAllocFlags = {};
-	memAllocFlags.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
-	memAllocFlags.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+	//All acceleration structures of an allocation must support its memory type
+	auto allocateMemory = [&](VkDeviceSize size, VkDeviceSize alignment)
+	{
+		MemoryRequest request;
+		request.requirements.size = size;
+		request.requirements.alignment = alignment;
+		request.requirements.memoryTypeBits = 1u << memTypeIndex;
+		request.properties = accelStructMemoryPropery;
+		request.deviceAddress = true;
+
+		return m_renderDevice->allocateMemory(request);
+	};
+
+	std::cout << "Building BLAS list (" << blasList.size() << "): ";
+
+	/*
+	 ----------------------------------
+	      Note on batched BLAS builds
+	 ----------------------------------
 
-	VkMemoryAllocateInfo memAllocInfo = {};
-	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memAllocInfo.pNext = &memAllocFlags;
-	memAllocInfo.allocationSize = totalStoreSize;
-	memAllocInfo.memoryTypeIndex = memTypeIndex;
+	 In serial mode, every build gets its own command buffer and a barrier, since all builds share the same scratch
+	 memory. The GPU can't overlap any of the builds, which leaves it mostly idle for scenes with lots of small meshes.
 
-	VkDeviceMemory accelStructMemory = VK_NULL_HANDLE;
-	VK_CHECK(vkAllocateMemory(deviceHandle, &memAllocInfo, nullptr, &accelStructMemory));
+	 In batched mode, the builds are partitioned into batches that are each recorded with a single call to
+	 `vkCmdBuildAccelerationStructuresKHR`. Every build of a batch gets its own slice of a scratch pool, so the builds
+	 of a batch can run concurrently, and barriers are only needed between batches (which reuse the pool). The size of
+	 the pool is limited by BLAS_SCRATCH_POOL_BUDGET, unless a single build needs more than that.
+	*/
+	VkDeviceSize scratchAlignment = std::max<VkDeviceSize>(m_accelStructProperties.minAccelerationStructureScratchOffsetAlignment, 1);
 
-	static volatile auto deoptimizer = totalStoreSize;
+	//Batches as (first BLAS, BLAS count)
+	std::vector<std::pair<size_t, size_t>> batches;
+	std::vector<VkDeviceSize> scratchOffsets(blasList.size(), 0);
 
-	std::cout << "Building BLAS list (" << blasList.size() << "): ";
+	VkDeviceSize scratchPoolSize = UINT32_ALIGN(maxScratchSize, scratchAlignment);
+
+	if (mode == BLASBuildMode::Batched)
+	{
+		VkDeviceSize scratchBudget = std::max<VkDeviceSize>(BLAS_SCRATCH_POOL_BUDGET, scratchPoolSize);
+		VkDeviceSize scratchOffset = 0;
+
+		for (size_t i = 0; i < blasList.size(); ++i)
+		{
+			VkDeviceSize scratchSize = UINT32_ALIGN(blasList[i].sizeInfo.buildScratchSize, scratchAlignment);
+
+			if (batches.empty() || scratchOffset + scratchSize > scratchBudget || batches.back().second >= BLAS_BUILD_BATCH_MAX_COUNT)
+			{
+				batches.push_back(std::make_pair(i, 0));
+				scratchOffset = 0;
+			}
+
+			scratchOffsets[i] = scratchOffset;
+			scratchOffset += scratchSize;
+
+			scratchPoolSize = std::max(scratchPoolSize, scratchOffset);
+
+			batches.back().second++;
+		}
 
-	Buffer scratchMemory = m_renderDevice->createBuffer(maxScratchSize, scratchBufferUsage, scratchMemoryPropery);
-	VkDeviceAddress scratchAddress = m_renderDevice->getBufferAddress(scratchMemory.buffer);
+		std::cout << batches.size() << " batches... ";
+	}
+	else
+	{
+		for (size_t i = 0; i < blasList.size(); ++i)
+		{
+			batches.push_back(std::make_pair(i, 1));
+		}
+	}
+
+	/*
+	 ----------------------------------
+	      Note on BLAS compaction
+	 ----------------------------------
+
+	 Building every BLAS before compacting any of them means that all the uncompacted BLASes and all of their compact
+	 copies are resident at the same time. Instead, the batches are grouped into rounds whose uncompacted BLASes fit
+	 into a single build block of about BLAS_BUILD_STORAGE_BUDGET bytes, which every round reuses:
+		1. The BLASes of a round are built into the build block and their compacted sizes are queried
+		2. Once the submission has completed, the sizes are read back (without waiting on the queries) and
+		   the compact BLASes are sub-allocated from an arena that grows in BLAS_COMPACT_BLOCK_SIZE blocks
+		3. The copies into the compact BLASes are recorded at the start of the next round's submission,
+		   followed by a barrier, so that its builds can overwrite the build block right after them
+
+	 The uncompacted BLASes of a round are destroyed as soon as their copies have completed. Peak memory usage is
+	 the build block plus the arena, rather than twice the size of all the BLASes. BLASes that don't allow
+	 compaction are cloned into the arena, so that the build block can be reused.
+	*/
+
+	//Rounds as (first batch, batch count)
+	std::vector<std::pair<size_t, size_t>> rounds;
+	std::vector<VkDeviceSize> storageOffsets(blasList.size(), 0);
+
+	VkDeviceSize buildBlockSize = 0;
+	VkDeviceSize storageOffset = 0;
+
+	for (size_t batch = 0; batch < batches.size(); ++batch)
+	{
+		size_t first = batches[batch].first;
+		size_t count = batches[batch].second;
+
+		VkDeviceSize batchEnd = storageOffset;
+
+		for (size_t i = first; i < first + count; ++i)
+		{
+			batchEnd = UINT32_ALIGN(batchEnd, blasRequirements[i].alignment) + blasRequirements[i].size;
+		}
+
+		if (rounds.empty() || (storageOffset > 0 && batchEnd > BLAS_BUILD_STORAGE_BUDGET))
+		{
+			rounds.push_back(std::make_pair(batch, 0));
+			storageOffset = 0;
+		}
+
+		for (size_t i = first; i < first + count; ++i)
+		{
+			storageOffsets[i] = UINT32_ALIGN(storageOffset, blasRequirements[i].alignment);
+			storageOffset = storageOffsets[i] + blasRequirements[i].size;
+		}
+
+		buildBlockSize = std::max(buildBlockSize, storageOffset);
+
+		rounds.back().second++;
+	}
+
+	Allocation buildMemory = allocateMemory(std::max<VkDeviceSize>(buildBlockSize, 1), accelStructAlignment);
+
+	//The buffer's address isn't necessarily aligned to `scratchAlignment`, so some extra space is needed
+	Buffer scratchMemory = m_renderDevice->createBuffer(scratchPoolSize + scratchAlignment, scratchBufferUsage, scratchMemoryPropery);
+	VkDeviceAddress scratchAddress = UINT32_ALIGN(m_renderDevice->getBufferAddress(scratchMemory.buffer), scratchAlignment);
 
 	//Create query pool to store acceleration structure properties
 	VkQueryPoolCreateInfo queryPoolCreateInfo = {};
 	queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-	queryPoolCreateInfo.queryCount = (uint32_t)blasList.size();
+	queryPoolCreateInfo.queryCount = std::max((uint32_t)blasList.size(), 1u);
 	queryPoolCreateInfo.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
 
 	VkQueryPool queryPool;
 	VK_CHECK(vkCreateQueryPool(m_renderDevice->getDevice(), &queryPoolCreateInfo, nullptr, &queryPool));
 
-	vkResetQueryPool(m_renderDevice->getDevice(), queryPool, 0, (uint32_t)blasList.size());
+	vkResetQueryPool(m_renderDevice->getDevice(), queryPool, 0, queryPoolCreateInfo.queryCount);
 
-	std::cout << "Building... ";
+	std::cout << rounds.size() << " rounds... Building and compacting... ";
+
+	//Compact BLASes and the arena they are allocated from
+	std::vector<BottomLevelAS> compactBLASList = blasList;
+	std::vector<Allocation> compactMemoryBlocks;
+
+	VkDeviceSize compactBlockEnd = 0;
+	VkDeviceSize compactBlockOffset = 0;
+	VkDeviceSize totalArenaSize = 0;
+
+	VkDeviceSize totalOriginalSize = 0;
+	VkDeviceSize totalStoreSize = 0;
 
-	//Create a single buffer for each BLAS to prevent the driver from getting stuck
-	//if the workload is too load
-	m_renderDevice->executeCommands((int)blasList.size(), [&](VkCommandBuffer* commandBuffers)
+	//BLASes whose copies are recorded into the next submission
+	std::vector<size_t> pendingCopies;
+
+	for (size_t round = 0; round <= rounds.size(); ++round)
 	{
-		for (int i = 0; i < (int)blasList.size(); ++i)
+		//The last submission only has the copies of the last round
+		size_t firstBatch = round < rounds.size() ? rounds[round].first : batches.size();
+		size_t batchCount = round < rounds.size() ? rounds[round].second : 0;
+
+		//Create a command buffer for each batch to prevent the driver from getting stuck
+		//if the workload is too large
+		m_renderDevice->executeCommands((int)batchCount + 1, [&](VkCommandBuffer* commandBuffers)
 		{
-			//Bind memory to acceleration structure
-			VK_CHECK(vkBindBufferMemory(deviceHandle, blasList[i].accelStorageBuffer, accelStructMemory, blasRanges[i].first));
+			for (size_t i : pendingCopies)
+			{
+				bool isCompacted = (blasList[i].buildInfo.flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) == VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
 
-			//Build acceleration structure
-			VkAccelerationStructureBuildGeometryInfoKHR buildInfo = blasList[i].buildInfo;
-			buildInfo.scratchData.deviceAddress = scratchAddress;
+				VkCopyAccelerationStructureInfoKHR copyInfo = {};
+				copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+				copyInfo.src = blasList[i].accelerationStructure;
+				copyInfo.dst = compactBLASList[i].accelerationStructure;
+				copyInfo.mode = isCompacted ? VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR : VK_COPY_ACCELERATION_STRUCTURE_MODE_CLONE_KHR;
 
-			std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> ppBuildRangeInfos(blasList[i].geometryInfo->rangeInfoArray.size());
-			for (size_t j = 0; j < blasList[i].geometryInfo->rangeInfoArray.size(); ++j)
-			{
-				ppBuildRangeInfos[j] = &blasList[i].geometryInfo->rangeInfoArray[j];
+				vkCmdCopyAccelerationStructureKHR(commandBuffers[0], &copyInfo);
 			}
 
-			vkCmdBuildAccelerationStructuresKHR(commandBuffers[i], 1, &buildInfo, ppBuildRangeInfos.data());
-
-			//Since all acceleration structures use the same scratch memory,
-			//a barrier is need to prevent it from being used concurrently
+			//The builds of this round overwrite the build block that the copies read from
 			VkMemoryBarrier barrier = {};
 			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
-			barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
-			barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+			barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+			barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
 
-			vkCmdPipelineBarrier(commandBuffers[i],
-				VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
-				VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
-				0, 1, &barrier, 0, nullptr, 0, nullptr);
+			if (!pendingCopies.empty())
+			{
+				vkCmdPipelineBarrier(commandBuffers[0],
+					VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+					VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+					0, 1, &barrier, 0, nullptr, 0, nullptr);
+			}
 
-			if ((buildInfo.flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) == VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR)
+			for (size_t batch = firstBatch; batch < firstBatch + batchCount; ++batch)
 			{
-				VkAccelerationStructureKHR accelStruct = blasList[i].accelerationStructure;
+				VkCommandBuffer commandBuffer = commandBuffers[batch - firstBatch + 1];
 
-				vkCmdWriteAccelerationStructuresPropertiesKHR(commandBuffers[i], 1, &accelStruct, VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, queryPool, i);
+				size_t first = batches[batch].first;
+				size_t count = batches[batch].second;
+
+				std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos(count);
+				std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> ppBuildRangeInfos(count);
+
+				for (size_t i = 0; i < count; ++i)
+				{
+					const BottomLevelAS& blas = blasList[first + i];
+
+					//Bind memory to acceleration structure
+					VK_CHECK(vkBindBufferMemory(deviceHandle, blas.accelStorageBuffer, buildMemory.memory, buildMemory.offset + storageOffsets[first + i]));
+
+					buildInfos[i] = blas.buildInfo;
+					buildInfos[i].scratchData.deviceAddress = scratchAddress + scratchOffsets[first + i];
+
+					//The range infos of a build are an array with one entry per geometry
+					ppBuildRangeInfos[i] = blas.geometryInfo->rangeInfoArray.data();
+				}
+
+				//Build acceleration structures
+				vkCmdBuildAccelerationStructuresKHR(commandBuffer, (uint32_t)count, buildInfos.data(), ppBuildRangeInfos.data());
+
+				//Since all batches use the same scratch memory,
+				//a barrier is need to prevent it from being used concurrently
+				vkCmdPipelineBarrier(commandBuffer,
+					VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+					VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+					0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+				for (size_t i = first; i < first + count; ++i)
+				{
+					if ((blasList[i].buildInfo.flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) == VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR)
+					{
+						VkAccelerationStructureKHR accelStruct = blasList[i].accelerationStructure;
+
+						vkCmdWriteAccelerationStructuresPropertiesKHR(commandBuffer, 1, &accelStruct, VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, queryPool, (uint32_t)i);
+					}
+				}
 			}
+		});
+
+		//The copies have completed, so the uncompacted BLASes of the previous round can go
+		for (size_t i : pendingCopies)
+		{
+			destroyBLAS(blasList[i]);
+		}
+
+		pendingCopies.clear();
+
+		if (round == rounds.size())
+		{
+			break;
 		}
-	});
 
-	std::cout << "Compacting... ";
+		//Create the compact BLASes of this round
+		size_t firstBLAS = batches[firstBatch].first;
+		size_t lastBLAS = batches[firstBatch + batchCount - 1].first + batches[firstBatch + batchCount - 1].second;
 
-	const std::vector<BottomLevelAS> oldBLASes = blasList;
+		for (size_t i = firstBLAS; i < lastBLAS; ++i)
+		{
+			VkDeviceSize compactSize = blasList[i].sizeInfo.accelerationStructureSize;
 
-	//Create compact acceleration structures
-	VkDeviceSize totalOriginalSize = totalStoreSize;
+			if ((blasList[i].buildInfo.flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) == VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR)
+			{
+				//The submission has completed, so the result is available without waiting
+				VK_CHECK(vkGetQueryPoolResults(m_renderDevice->getDevice(), queryPool, (uint32_t)i, 1, sizeof(VkDeviceSize), &compactSize, sizeof(VkDeviceSize), VK_QUERY_RESULT_64_BIT));
 
-	mutualMemoryTypeBits = 0xFFFFFFFF;
-	totalStoreSize = 0;
+				assert(compactSize != (VkDeviceSize)-1 && compactSize > 0);
+			}
 
-	for (int i = 0; i < (int)blasList.size(); ++i)
-	{
-		//Get compact size
-		VkAccelerationStructureBuildGeometryInfoKHR buildInfo = blasList[i].buildInfo;
+			//Create new buffer
+			VkBufferCreateInfo bufferCI = {};
+			bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			bufferCI.size = compactSize;
+			bufferCI.usage = accelStructBufferUsage;
+			bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			bufferCI.queueFamilyIndexCount = 0;
+			bufferCI.pQueueFamilyIndices = nullptr;
 
-		if ((buildInfo.flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) != VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR)
-		{
-			continue;
+			VK_CHECK(vkCreateBuffer(deviceHandle, &bufferCI, nullptr, &compactBLASList[i].accelStorageBuffer));
+
+			//Sub-allocate its memory from the arena (offsets are relative to the start of the memory object)
+			VkMemoryRequirements memRequirements;
+			vkGetBufferMemoryRequirements(deviceHandle, compactBLASList[i].accelStorageBuffer, &memRequirements);
+
+			if ((memRequirements.memoryTypeBits & (1u << memTypeIndex)) == 0)
+			{
+				FATAL_ERROR("Compact acceleration structure doesn't support the memory type of the other acceleration structures");
+			}
+
+			VkDeviceSize pageOffset = UINT32_ALIGN(compactBlockOffset, memRequirements.alignment);
+
+			if (compactMemoryBlocks.empty() || pageOffset + memRequirements.size > compactBlockEnd)
+			{
+				VkDeviceSize compactBlockSize = std::max<VkDeviceSize>(BLAS_COMPACT_BLOCK_SIZE, memRequirements.size);
+				compactMemoryBlocks.push_back(allocateMemory(compactBlockSize, std::max(accelStructAlignment, memRequirements.alignment)));
+
+				totalArenaSize += compactBlockSize;
+
+				pageOffset = compactMemoryBlocks.back().offset;
+				compactBlockEnd = pageOffset + compactBlockSize;
+			}
+
+			compactBlockOffset = pageOffset + memRequirements.size;
+
+			VK_CHECK(vkBindBufferMemory(deviceHandle, compactBLASList[i].accelStorageBuffer, compactMemoryBlocks.back().memory, pageOffset));
+
+			VkAccelerationStructureCreateInfoKHR createInfo = {};
+			createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+			createInfo.buffer = compactBLASList[i].accelStorageBuffer;
+			createInfo.offset = 0;
+			createInfo.size = compactSize;
+			createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+
+			VK_CHECK(vkCreateAccelerationStructureKHR(m_renderDevice->getDevice(), &createInfo, nullptr, &compactBLASList[i].accelerationStructure));
+
+			compactBLASList[i].buildInfo.dstAccelerationStructure = compactBLASList[i].accelerationStructure;
+
+			totalOriginalSize += blasRequirements[i].size;
+			totalStoreSize += memRequirements.size;
+
+			pendingCopies.push_back(i);
 		}
+	}
 
-		VkDeviceSize compactSize = 0;
-		VK_CHECK(vkGetQueryPoolResults(m_renderDevice->getDevice(), queryPool, i, 1, sizeof(VkDeviceSize), &compactSize, sizeof(VkDeviceSize), VK_QUERY_RESULT_WAIT_BIT));
+	std::cout << "Finished!" << std::endl;
+	std::cout << "    -Total original size: " << (totalOriginalSize / 1024.0f) << "KB" << std::endl;
+	std::cout << "    -Total compact size:  " << (totalStoreSize / 1024.0f) << "KB" << std::endl;
+	std::cout << "    -Compaction ratio:    " << (float)((100.0 * totalStoreSize) / std::max<VkDeviceSize>(totalOriginalSize, 1)) << "%" << std::endl;
+	std::cout << "    -Peak memory usage:   " << ((buildBlockSize + totalArenaSize) / 1024.0f) << "KB" << std::endl;
 
-		assert(compactSize != (VkDeviceSize)-1 && compactSize > 0);
+	//Destroy resources
+	m_renderDevice->destroyBuffer(scratchMemory);
 
-		//Create new buffer
-		VkBufferCreateInfo bufferCI = {};
-		bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferCI.size = compactSize;
-		bufferCI.usage = accelStructBufferUsage;
-		bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		bufferCI.queueFamilyIndexCount = 0;
-		bufferCI.pQueueFamilyIndices = nullptr;
+	m_renderDevice->freeMemory(buildMemory);
+	vkDestroyQueryPool(m_renderDevice->getDevice(), queryPool, nullptr);
 
-		VK_CHECK(vkCreateBuffer(deviceHandle, &bufferCI, nullptr, &blasList[i].accelStorageBuffer));
+	return { compactBLASList, compactMemoryBlocks };
+}
 
-		VkAccelerationStructureCreateInfoKHR createInfo = {};
-		createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-		createInfo.buffer = blasList[i].accelStorageBuffer;
-		createInfo.offset = 0;
-		createInfo.size = compactSize;
-		createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+BLASBuildResult RaytracingDevice::buildBLASOnHost(std::vector<BLASCreateInfo>& blasCIList) const
+{
+	/*
+	 ----------------------------------
+	      Note on host BLAS builds
+	 ----------------------------------
+
+	 When the driver exposes `accelerationStructureHostCommands`, the BLASes can be built on the CPU with
+	 `vkBuildAccelerationStructuresKHR`. Each batch of builds is handed to a deferred operation, which is then joined
+	 by the threads of the global thread pool until it is finished. Nothing is submitted to the queue, so the GPU can
+	 keep rendering the previous scene while the builds run.
+
+	 Host builds read the geometry from host memory (see `compileHostGeometry`) and write to host visible memory.
+	 Compaction is skipped, since it would need all the acceleration structures to be built and copied a second
+	 time on the CPU, which takes away most of the benefit.
+	*/
+	if (!isHostBuildSupported())
+	{
+		FATAL_ERROR("Host acceleration structure builds are not supported by the device");
+	}
 
-		VK_CHECK(vkCreateAccelerationStructureKHR(m_renderDevice->getDevice(), &createInfo, nullptr, &blasList[i].accelerationStructure));
+	VkDevice deviceHandle = m_renderDevice->getDevice();
+
+	std::vector<BottomLevelAS> blasList;
+	std::vector<VkDeviceSize> blasOffsets;
+
+	VkDeviceSize totalStoreSize = 0;
+	VkDeviceSize maxScratchSize = 0;
+	VkDeviceSize accelStructAlignment = 1;
+
+	uint32_t mutualMemoryTypeBits = 0xFFFFFFFF;
+
+	for (const BLASCreateInfo& createInfo : blasCIList)
+	{
+		BLASCreateInfo hostCreateInfo = createInfo;
+		hostCreateInfo.flags &= ~VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
 
-		//Update memory requirements
 		VkMemoryRequirements memRequirements;
-		vkGetBufferMemoryRequirements(deviceHandle, blasList[i].accelStorageBuffer, &memRequirements);
+		BottomLevelAS blas = prepareBLAS(hostCreateInfo, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_HOST_KHR, memRequirements);
 
 		VkDeviceSize pageOffset = UINT32_ALIGN(totalStoreSize, memRequirements.alignment);
-		VkDeviceSize actualSize = memRequirements.size;
 
-		totalStoreSize = pageOffset + actualSize;
+		totalStoreSize = pageOffset + memRequirements.size;
 
 		mutualMemoryTypeBits &= memRequirements.memoryTypeBits;
+		accelStructAlignment = std::max(accelStructAlignment, memRequirements.alignment);
 
-		maxScratchSize = std::max(blasList[i].sizeInfo.buildScratchSize, maxScratchSize);
+		maxScratchSize = std::max(blas.sizeInfo.buildScratchSize, maxScratchSize);
 
-		blasRanges[i] = std::make_pair(pageOffset, actualSize);
+		blasOffsets.push_back(pageOffset);
+		blasList.push_back(blas);
 	}
 
+	//Allocate memory (host commands can only access host visible memory)
 	if (!mutualMemoryTypeBits)
 	{
 		FATAL_ERROR("Could not find memory type that supports all bottom-level acceleration structures");
 	}
 
-	memTypeIndex = m_renderDevice->findMemoryType(mutualMemoryTypeBits, accelStructMemoryPropery);
+	MemoryRequest request;
+	request.requirements.size = totalStoreSize;
+	request.requirements.alignment = accelStructAlignment;
+	request.requirements.memoryTypeBits = mutualMemoryTypeBits;
+	request.properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	request.deviceAddress = true;
 
-	if (memTypeIndex == (uint32_t)-1)
+	Allocation accelStructMemory = m_renderDevice->allocateMemory(request);
+
+	for (size_t i = 0; i < blasList.size(); ++i)
 	{
-		FATAL_ERROR("Could not find appropriate memory type for acceleration strctures");
+		VK_CHECK(vkBindBufferMemory(deviceHandle, blasList[i].accelStorageBuffer, accelStructMemory.memory, accelStructMemory.offset + blasOffsets[i]));
 	}
 
-	//Allocate compact storage memory
-	memAllocInfo = {};
-	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memAllocInfo.pNext = &memAllocFlags;
-	memAllocInfo.allocationSize = totalStoreSize;
-	memAllocInfo.memoryTypeIndex = memTypeIndex;
+	std::cout << "Building BLAS list on host (" << blasList.size() << "): ";
 
-	VkDeviceMemory compactAccelStructMemory = VK_NULL_HANDLE;
-	VK_CHECK(vkAllocateMemory(deviceHandle, &memAllocInfo, nullptr, &compactAccelStructMemory));
+	//Partition the builds into batches the same way as device builds, but with the scratch pool in host memory
+	VkDeviceSize scratchAlignment = std::max<VkDeviceSize>(m_accelStructProperties.minAccelerationStructureScratchOffsetAlignment, 16);
+	VkDeviceSize scratchBudget = std::max<VkDeviceSize>(BLAS_SCRATCH_POOL_BUDGET, UINT32_ALIGN(maxScratchSize, scratchAlignment));
 
-	m_renderDevice->executeCommands(1, [&](VkCommandBuffer* commandBuffer)
+	std::vector<std::pair<size_t, size_t>> batches;
+	std::vector<VkDeviceSize> scratchOffsets(blasList.size(), 0);
+
+	VkDeviceSize scratchPoolSize = 0;
+	VkDeviceSize scratchOffset = 0;
+
+	for (size_t i = 0; i < blasList.size(); ++i)
 	{
-		for (int i = 0; i < (int)blasList.size(); ++i)
+		VkDeviceSize scratchSize = UINT32_ALIGN(blasList[i].sizeInfo.buildScratchSize, scratchAlignment);
+
+		if (batches.empty() || scratchOffset + scratchSize > scratchBudget || batches.back().second >= BLAS_BUILD_BATCH_MAX_COUNT)
 		{
-			VkAccelerationStructureBuildGeometryInfoKHR buildInfo = blasList[i].buildInfo;
-			
-			if ((buildInfo.flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) != VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR)
-			{
-				continue;
-			}
+			batches.push_back(std::make_pair(i, 0));
+			scratchOffset = 0;
+		}
 
-			//Bind memory to acceleration structure
-			VK_CHECK(vkBindBufferMemory(deviceHandle, blasList[i].accelStorageBuffer, compactAccelStructMemory, blasRanges[i].first));
+		scratchOffsets[i] = scratchOffset;
+		scratchOffset += scratchSize;
 
-			VkCopyAccelerationStructureInfoKHR copyInfo = {};
-			copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
-			copyInfo.src = oldBLASes[i].accelerationStructure;
-			copyInfo.dst = blasList[i].accelerationStructure;
-			copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+		scratchPoolSize = std::max(scratchPoolSize, scratchOffset);
 
-			vkCmdCopyAccelerationStructureKHR(commandBuffer[0], &copyInfo);
-		}
-	});
+		batches.back().second++;
+	}
 
-	std::cout << "Finished!" << std::endl;
-	std::cout << "    -Total original size: " << (totalOriginalSize / 1024.0f) << "KB" << std::endl;
-	std::cout << "    -Total compact size:  " << (totalStoreSize / 1024.0f) << "KB" << std::endl;
-	std::cout << "    -Compaction ratio:    " << (float)((100.0 * totalStoreSize) / totalOriginalSize) << "%" << std::endl;;
+	std::vector<uint8_t> scratchMemory(scratchPoolSize + scratchAlignment);
+	uint8_t* scratchBase = (uint8_t*)UINT32_ALIGN((uintptr_t)scratchMemory.data(), (uintptr_t)scratchAlignment);
 
-	//Destroy resources
-	for (int i = 0; i < (int)oldBLASes.size(); ++i)
+	std::cout << batches.size() << " batches... Building... ";
+
+	for (const std::pair<size_t, size_t>& batch : batches)
 	{
-		destroyBLAS(oldBLASes[i]);
+		size_t first = batch.first;
+		size_t count = batch.second;
+
+		std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos(count);
+		std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> ppBuildRangeInfos(count);
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			buildInfos[i] = blasList[first + i].buildInfo;
+			buildInfos[i].scratchData.hostAddress = scratchBase + scratchOffsets[first + i];
+
+			ppBuildRangeInfos[i] = blasList[first + i].geometryInfo->rangeInfoArray.data();
+		}
+
+		VkDeferredOperationKHR operation;
+		VK_CHECK(vkCreateDeferredOperationKHR(deviceHandle, nullptr, &operation));
+
+		VkResult result = vkBuildAccelerationStructuresKHR(deviceHandle, operation, (uint32_t)count, buildInfos.data(), ppBuildRangeInfos.data());
+
+		if (result == VK_OPERATION_DEFERRED_KHR)
+		{
+			joinDeferredOperation(operation);
+
+			result = vkGetDeferredOperationResultKHR(deviceHandle, operation);
+		}
+		else if (result == VK_OPERATION_NOT_DEFERRED_KHR)
+		{
+			result = VK_SUCCESS;
+		}
+
+		VK_CHECK(result);
+
+		vkDestroyDeferredOperationKHR(deviceHandle, operation, nullptr);
 	}
 
-	m_renderDevice->destroyBuffer(scratchMemory);
+	std::cout << "Finished!" << std::endl;
+	std::cout << "    -Total size: " << (totalStoreSize / 1024.0f) << "KB" << std::endl;
 
-	vkFreeMemory(deviceHandle, accelStructMemory, nullptr);
-	vkDestroyQueryPool(m_renderDevice->getDevice(), queryPool, nullptr);
+	return { blasList, { accelStructMemory } };
+}
+
+void RaytracingDevice::joinDeferredOperation(VkDeferredOperationKHR operation) const
+{
+	VkDevice deviceHandle = m_renderDevice->getDevice();
+	ThreadPool& threadPool = ThreadPool::global();
+
+	//The calling thread takes part in `parallelFor`, so it is one of the joining threads
+	size_t threadCount = std::min<size_t>(vkGetDeferredOperationMaxConcurrencyKHR(deviceHandle, operation), threadPool.getThreadCount() + 1);
+
+	threadPool.parallelFor(std::max<size_t>(threadCount, 1), [&](size_t)
+	{
+		//VK_THREAD_IDLE_KHR means that there is no work for this thread at the moment, but more might come later
+		while (vkDeferredOperationJoinKHR(deviceHandle, operation) == VK_THREAD_IDLE_KHR)
+		{
+			std::this_thread::yield();
+		}
+	});
 
-	return { blasList, compactAccelStructMemory };
+	//VK_THREAD_DONE_KHR only means that no more threads are needed, so wait for the ones still working
+	while (vkGetDeferredOperationResultKHR(deviceHandle, operation) == VK_NOT_READY)
+	{
+		std::this_thread::yield();
+	}
 }
 
 void RaytracingDevice::destroyBLAS(const BottomLevelAS& blas) const
@@ -480,27 +844,302 @@ void RaytracingDevice::destroyBLAS(const BottomLevelAS& blas) const
 	}
 }
 
+void RaytracingDevice::destroyBLAS(const BLASBuildResult& buildResult) const
+{
+	for (const BottomLevelAS& blas : buildResult.blasList)
+	{
+		destroyBLAS(blas);
+	}
+
+	for (const Allocation& memory : buildResult.memoryBlocks)
+	{
+		m_renderDevice->freeMemory(memory);
+	}
+}
+
+std::vector<std::vector<uint8_t>> RaytracingDevice::serializeBLAS(const BLASBuildResult& buildResult) const
+{
+	VkDevice deviceHandle = m_renderDevice->getDevice();
+
+	const std::vector<BottomLevelAS>& blasList = buildResult.blasList;
+
+	if (blasList.empty())
+	{
+		return {};
+	}
+
+	//Query serialized sizes
+	VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+	queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolCreateInfo.queryCount = (uint32_t)blasList.size();
+	queryPoolCreateInfo.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR;
+
+	VkQueryPool queryPool;
+	VK_CHECK(vkCreateQueryPool(deviceHandle, &queryPoolCreateInfo, nullptr, &queryPool));
+
+	vkResetQueryPool(deviceHandle, queryPool, 0, (uint32_t)blasList.size());
+
+	std::vector<VkAccelerationStructureKHR> accelStructs;
+
+	for (const BottomLevelAS& blas : blasList)
+	{
+		accelStructs.push_back(blas.accelerationStructure);
+	}
+
+	m_renderDevice->executeCommands(1, [&](VkCommandBuffer* commandBuffer)
+	{
+		vkCmdWriteAccelerationStructuresPropertiesKHR(commandBuffer[0], (uint32_t)accelStructs.size(), accelStructs.data(), VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR, queryPool, 0);
+	});
+
+	std::vector<VkDeviceSize> serializedSizes(blasList.size());
+	VK_CHECK(vkGetQueryPoolResults(deviceHandle, queryPool, 0, (uint32_t)blasList.size(), serializedSizes.size() * sizeof(VkDeviceSize), serializedSizes.data(), sizeof(VkDeviceSize), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+	vkDestroyQueryPool(deviceHandle, queryPool, nullptr);
+
+	//Serialize into a readback buffer (destination addresses must be 256-byte aligned)
+	std::vector<VkDeviceSize> offsets(blasList.size());
+	VkDeviceSize totalSize = 0;
+
+	for (size_t i = 0; i < blasList.size(); ++i)
+	{
+		offsets[i] = totalSize;
+		totalSize = UINT32_ALIGN(totalSize + serializedSizes[i], (VkDeviceSize)256);
+	}
+
+	Buffer readbackBuffer = m_renderDevice->createBuffer(totalSize + 256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+														 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryStrategy::Linear);
+
+	VkDeviceAddress bufferAddress = m_renderDevice->getBufferAddress(readbackBuffer.buffer);
+	VkDeviceAddress baseAddress = UINT32_ALIGN(bufferAddress, (VkDeviceAddress)256);
+
+	m_renderDevice->executeCommands(1, [&](VkCommandBuffer* commandBuffer)
+	{
+		for (size_t i = 0; i < blasList.size(); ++i)
+		{
+			VkCopyAccelerationStructureToMemoryInfoKHR copyInfo = {};
+			copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_INFO_KHR;
+			copyInfo.src = blasList[i].accelerationStructure;
+			copyInfo.dst.deviceAddress = baseAddress + offsets[i];
+			copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_SERIALIZE_KHR;
+
+			vkCmdCopyAccelerationStructureToMemoryKHR(commandBuffer[0], &copyInfo);
+		}
+	});
+
+	const uint8_t* mappedMemory = readbackBuffer.allocation.mappedData + (baseAddress - bufferAddress);
+
+	std::vector<std::vector<uint8_t>> serializedBLASes(blasList.size());
+
+	for (size_t i = 0; i < blasList.size(); ++i)
+	{
+		serializedBLASes[i].assign(mappedMemory + offsets[i], mappedMemory + offsets[i] + serializedSizes[i]);
+	}
+
+	m_renderDevice->destroyBuffer(readbackBuffer);
+
+	return serializedBLASes;
+}
+
+bool RaytracingDevice::deserializeBLAS(std::vector<BLASCreateInfo>& blasCIList, const std::vector<std::pair<const uint8_t*, size_t>>& serializedBLASes, BLASBuildResult& buildResult) const
+{
+	/*
+	 The serialized data starts with a header of:
+		- The driver UUID and the compatibility UUID (VK_UUID_SIZE bytes each)
+		- The serialized size, the deserialized size and the number of BLAS handles (8 bytes each)
+	*/
+	const size_t serializedHeaderSize = 2 * VK_UUID_SIZE + 3 * sizeof(uint64_t);
+
+	VkDevice deviceHandle = m_renderDevice->getDevice();
+
+	if (blasCIList.size() != serializedBLASes.size())
+	{
+		return false;
+	}
+
+	std::vector<VkDeviceSize> accelStructSizes(serializedBLASes.size());
+
+	for (size_t i = 0; i < serializedBLASes.size(); ++i)
+	{
+		const uint8_t* data = serializedBLASes[i].first;
+
+		if (serializedBLASes[i].second < serializedHeaderSize)
+		{
+			return false;
+		}
+
+		VkAccelerationStructureVersionInfoKHR versionInfo = {};
+		versionInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_VERSION_INFO_KHR;
+		versionInfo.pVersionData = data;
+
+		VkAccelerationStructureCompatibilityKHR compatibility = VK_ACCELERATION_STRUCTURE_COMPATIBILITY_INCOMPATIBLE_KHR;
+		vkGetDeviceAccelerationStructureCompatibilityKHR(deviceHandle, &versionInfo, &compatibility);
+
+		if (compatibility != VK_ACCELERATION_STRUCTURE_COMPATIBILITY_COMPATIBLE_KHR)
+		{
+			return false;
+		}
+
+		uint64_t serializedSize;
+		uint64_t handleCount;
+
+		memcpy(&serializedSize, data + 2 * VK_UUID_SIZE, sizeof(uint64_t));
+		memcpy(&accelStructSizes[i], data + 2 * VK_UUID_SIZE + sizeof(uint64_t), sizeof(uint64_t));
+		memcpy(&handleCount, data + 2 * VK_UUID_SIZE + 2 * sizeof(uint64_t), sizeof(uint64_t));
+
+		//BLASes don't reference other acceleration structures
+		if (serializedSize > serializedBLASes[i].second || handleCount != 0 || accelStructSizes[i] == 0)
+		{
+			return false;
+		}
+	}
+
+	std::cout << "Loading serialized BLAS list (" << serializedBLASes.size() << ")... ";
+
+	//Create acceleration structure buffers
+	std::vector<BottomLevelAS> blasList(serializedBLASes.size());
+	std::vector<VkDeviceSize> blasOffsets(serializedBLASes.size());
+
+	VkDeviceSize totalStoreSize = 0;
+	VkDeviceSize accelStructAlignment = 1;
+
+	uint32_t mutualMemoryTypeBits = 0xFFFFFFFF;
+
+	for (size_t i = 0; i < blasList.size(); ++i)
+	{
+		BottomLevelAS& blas = blasList[i];
+		blas.geometryInfo = blasCIList[i].geometryInfo;
+
+		blas.buildInfo = {};
+		blas.buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+		blas.buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+		blas.buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+		blas.buildInfo.geometryCount = (uint32_t)blas.geometryInfo->geometryArray.size();
+		blas.buildInfo.pGeometries = blas.geometryInfo->geometryArray.data();
+		blas.buildInfo.flags = blasCIList[i].flags;
+
+		blas.sizeInfo = {};
+		blas.sizeInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+		blas.sizeInfo.accelerationStructureSize = accelStructSizes[i];
+
+		VkBufferCreateInfo bufferCI = {};
+		bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferCI.size = accelStructSizes[i];
+		bufferCI.usage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+		bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		VK_CHECK(vkCreateBuffer(deviceHandle, &bufferCI, nullptr, &blas.accelStorageBuffer));
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(deviceHandle, blas.accelStorageBuffer, &memRequirements);
+
+		blasOffsets[i] = UINT32_ALIGN(totalStoreSize, memRequirements.alignment);
+		totalStoreSize = blasOffsets[i] + memRequirements.size;
+
+		mutualMemoryTypeBits &= memRequirements.memoryTypeBits;
+		accelStructAlignment = std::max(accelStructAlignment, memRequirements.alignment);
+	}
+
+	//Allocate memory
+	MemoryRequest request;
+	request.requirements.size = totalStoreSize;
+	request.requirements.alignment = accelStructAlignment;
+	request.requirements.memoryTypeBits = mutualMemoryTypeBits;
+	request.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	request.deviceAddress = true;
+
+	Allocation accelStructMemory = m_renderDevice->allocateMemory(request);
+
+	for (size_t i = 0; i < blasList.size(); ++i)
+	{
+		BottomLevelAS& blas = blasList[i];
+
+		VK_CHECK(vkBindBufferMemory(deviceHandle, blas.accelStorageBuffer, accelStructMemory.memory, accelStructMemory.offset + blasOffsets[i]));
+
+		VkAccelerationStructureCreateInfoKHR createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+		createInfo.buffer = blas.accelStorageBuffer;
+		createInfo.offset = 0;
+		createInfo.size = accelStructSizes[i];
+		createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+
+		VK_CHECK(vkCreateAccelerationStructureKHR(deviceHandle, &createInfo, nullptr, &blas.accelerationStructure));
+
+		blas.buildInfo.dstAccelerationStructure = blas.accelerationStructure;
+	}
+
+	//Upload the serialized data (source addresses must be 256-byte aligned)
+	std::vector<VkDeviceSize> offsets(serializedBLASes.size());
+	VkDeviceSize totalSize = 0;
+
+	for (size_t i = 0; i < serializedBLASes.size(); ++i)
+	{
+		offsets[i] = totalSize;
+		totalSize = UINT32_ALIGN(totalSize + serializedBLASes[i].second, (VkDeviceSize)256);
+	}
+
+	Buffer uploadBuffer = m_renderDevice->createBuffer(totalSize + 256, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+													   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryStrategy::Linear);
+
+	VkDeviceAddress bufferAddress = m_renderDevice->getBufferAddress(uploadBuffer.buffer);
+	VkDeviceAddress baseAddress = UINT32_ALIGN(bufferAddress, (VkDeviceAddress)256);
+
+	uint8_t* mappedMemory = uploadBuffer.allocation.mappedData + (baseAddress - bufferAddress);
+
+	for (size_t i = 0; i < serializedBLASes.size(); ++i)
+	{
+		memcpy(mappedMemory + offsets[i], serializedBLASes[i].first, serializedBLASes[i].second);
+	}
+
+	m_renderDevice->executeCommands(1, [&](VkCommandBuffer* commandBuffer)
+	{
+		for (size_t i = 0; i < blasList.size(); ++i)
+		{
+			VkCopyMemoryToAccelerationStructureInfoKHR copyInfo = {};
+			copyInfo.sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_ACCELERATION_STRUCTURE_INFO_KHR;
+			copyInfo.src.deviceAddress = baseAddress + offsets[i];
+			copyInfo.dst = blasList[i].accelerationStructure;
+			copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_DESERIALIZE_KHR;
+
+			vkCmdCopyMemoryToAccelerationStructureKHR(commandBuffer[0], &copyInfo);
+		}
+	});
+
+	m_renderDevice->destroyBuffer(uploadBuffer);
+
+	std::cout << "Finished!" << std::endl;
+	std::cout << "    -Total size: " << (totalStoreSize / 1024.0f) << "KB" << std::endl;
+
+	buildResult = { blasList, { accelStructMemory } };
+
+	return true;
+}
+
 void RaytracingDevice::buildTLAS(TopLevelAS& tlas, const std::vector<VkAccelerationStructureInstanceKHR>& instances, VkBuildAccelerationStructureFlagsKHR flags) const
 {
 	std::cout << "Building TLAS: ";
 	std::cout << "Preparing... ";
 
-	VkDeviceSize instanceBufferSize = instances.size() * sizeof(VkAccelerationStructureInstanceKHR);
+	//Resources of a previous build are not reused, since the instance count might have changed
+	if (tlas.m_accelerationStructure != VK_NULL_HANDLE)
+	{
+		tlas.destroy();
+	}
 
-	//Allocate instance buffer
-	Buffer instanceBuffer = m_renderDevice->createBuffer(instanceBufferSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	VkDeviceAddress instanceAddress = m_renderDevice->getBufferAddress(instanceBuffer.buffer);
+	tlas.m_device = this;
+	tlas.m_instances = instances;
+	tlas.m_buildFlags = flags;
+	tlas.m_ringIndex = 0;
 
-	//Copy instance content
-	VkAccelerationStructureInstanceKHR* instanceMemory = nullptr;
-	VK_CHECK(vkMapMemory(m_renderDevice->getDevice(), instanceBuffer.memory, 0, instanceBufferSize, 0, (void**)&instanceMemory));
+	//Allocate instance buffer (with a slice per frame for updates, see "Note on TLAS updates")
+	uint32_t sliceCount = tlas.canUpdate() ? TLAS_INSTANCE_RING_SIZE : 1;
+	VkDeviceSize instanceBufferSize = std::max<VkDeviceSize>(instances.size(), 1) * sizeof(VkAccelerationStructureInstanceKHR) * sliceCount;
 
-	for (size_t i = 0; i < instances.size(); ++i)
-	{
-		memcpy(&instanceMemory[i], &instances[i], sizeof(VkAccelerationStructureInstanceKHR));
-	}
+	tlas.m_instanceBuffer = m_renderDevice->createBuffer(instanceBufferSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-	vkUnmapMemory(m_renderDevice->getDevice(), instanceBuffer.memory);
+	//Copy instance content (the memory stays mapped for updates)
+	tlas.m_mappedInstances = (VkAccelerationStructureInstanceKHR*)tlas.m_instanceBuffer.allocation.mappedData;
+
+	memcpy(tlas.m_mappedInstances, instances.data(), instances.size() * sizeof(VkAccelerationStructureInstanceKHR));
 
 	std::cout << "Creating TLAS... ";
 
@@ -511,7 +1150,6 @@ void RaytracingDevice::buildTLAS(TopLevelAS& tlas, const std::vector<VkAccelerat
 	topASGeometry.geometry.instances = {};
 	topASGeometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
 	topASGeometry.geometry.instances.arrayOfPointers = VK_FALSE;
-	topASGeometry.geometry.instances.data.deviceAddress = instanceAddress;
 
 	VkAccelerationStructureBuildGeometryInfoKHR buildInfo = {};
 	buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
@@ -537,12 +1175,12 @@ void RaytracingDevice::buildTLAS(TopLevelAS& tlas, const std::vector<VkAccelerat
 	createInfo.buffer = tlas.m_accelStorageBuffer.buffer;
 	VK_CHECK(vkCreateAccelerationStructureKHR(m_renderDevice->getDevice(), &createInfo, nullptr, &tlas.m_accelerationStructure));
 
-	//Create scratch memory
-	Buffer scratchBuffer = m_renderDevice->createBuffer(sizeInfo.buildScratchSize, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VkDeviceAddress scratchAddress = m_renderDevice->getBufferAddress(scratchBuffer.buffer);
+	//Create scratch memory (large enough for both builds and updates)
+	VkDeviceSize scratchAlignment = std::max<VkDeviceSize>(m_accelStructProperties.minAccelerationStructureScratchOffsetAlignment, 1);
+	VkDeviceSize scratchSize = tlas.canUpdate() ? std::max(sizeInfo.buildScratchSize, sizeInfo.updateScratchSize) : sizeInfo.buildScratchSize;
 
-	buildInfo.dstAccelerationStructure = tlas.m_accelerationStructure;
-	buildInfo.scratchData.deviceAddress = scratchAddress;
+	tlas.m_scratchBuffer = m_renderDevice->createBuffer(scratchSize + scratchAlignment, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	tlas.m_scratchAddress = UINT32_ALIGN(m_renderDevice->getBufferAddress(tlas.m_scratchBuffer.buffer), scratchAlignment);
 
 	std::cout << "Building... ";
 
@@ -559,22 +1197,23 @@ void RaytracingDevice::buildTLAS(TopLevelAS& tlas, const std::vector<VkAccelerat
 							 VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
 							 0, 1, &barrier, 0, nullptr, 0, nullptr);
 
-		VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo = {};
-		buildRangeInfo.primitiveCount = (uint32_t)instances.size();
-		buildRangeInfo.primitiveOffset = 0;
-		buildRangeInfo.firstVertex = 0;
-		buildRangeInfo.transformOffset = 0;
-
-		const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &buildRangeInfo;
-
-		vkCmdBuildAccelerationStructuresKHR(commandBuffer[0], 1, &buildInfo, &pBuildRangeInfo);
+		tlas.recordBuild(commandBuffer[0], VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR);
 	});
 
 	std::cout << "Finished!" << std::endl;
 	std::cout << "    -Child instances: " << instances.size() << std::endl;
 
-	m_renderDevice->destroyBuffer(instanceBuffer);
-	m_renderDevice->destroyBuffer(scratchBuffer);
+	//Instances that can't be updated don't need to be kept around
+	if (!tlas.canUpdate())
+	{
+		tlas.m_mappedInstances = nullptr;
+
+		m_renderDevice->destroyBuffer(tlas.m_instanceBuffer);
+		m_renderDevice->destroyBuffer(tlas.m_scratchBuffer);
+
+		tlas.m_instanceBuffer = {};
+		tlas.m_scratchBuffer = {};
+	}
 }
 
 std::vector<const char*> RaytracingDevice::getRequiredExtensions() const
@@ -596,10 +1235,98 @@ void TopLevelAS::init(const RaytracingDevice* device)
 
 void TopLevelAS::destroy()
 {
+	const RenderDevice* renderDevice = m_device->getRenderDevice();
+
 	if (m_accelerationStructure != VK_NULL_HANDLE)
 	{
-		vkDestroyAccelerationStructureKHR(m_device->getRenderDevice()->getDevice(), m_accelerationStructure, nullptr);
+		vkDestroyAccelerationStructureKHR(renderDevice->getDevice(), m_accelerationStructure, nullptr);
+		m_accelerationStructure = VK_NULL_HANDLE;
 	}
 
-	m_device->getRenderDevice()->destroyBuffer(m_accelStorageBuffer);
+	m_mappedInstances = nullptr;
+
+	renderDevice->destroyBuffer(m_accelStorageBuffer);
+	renderDevice->destroyBuffer(m_scratchBuffer);
+	renderDevice->destroyBuffer(m_instanceBuffer);
+
+	m_accelStorageBuffer = {};
+	m_scratchBuffer = {};
+	m_instanceBuffer = {};
+
+	m_instances.clear();
+}
+
+void TopLevelAS::recordBuild(VkCommandBuffer commandBuffer, VkBuildAccelerationStructureModeKHR mode) const
+{
+	VkDeviceSize sliceOffset = (VkDeviceSize)m_ringIndex * m_instances.size() * sizeof(VkAccelerationStructureInstanceKHR);
+
+	VkAccelerationStructureGeometryKHR topASGeometry = {};
+	topASGeometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+	topASGeometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+	topASGeometry.geometry.instances = {};
+	topASGeometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+	topASGeometry.geometry.instances.arrayOfPointers = VK_FALSE;
+	topASGeometry.geometry.instances.data.deviceAddress = m_device->getRenderDevice()->getBufferAddress(m_instanceBuffer.buffer) + sliceOffset;
+
+	VkAccelerationStructureBuildGeometryInfoKHR buildInfo = {};
+	buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+	buildInfo.flags = m_buildFlags;
+	buildInfo.geometryCount = 1;
+	buildInfo.pGeometries = &topASGeometry;
+	buildInfo.mode = mode;
+	buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+	buildInfo.srcAccelerationStructure = mode == VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR ? m_accelerationStructure : VK_NULL_HANDLE;
+	buildInfo.dstAccelerationStructure = m_accelerationStructure;
+	buildInfo.scratchData.deviceAddress = m_scratchAddress;
+
+	VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo = {};
+	buildRangeInfo.primitiveCount = (uint32_t)m_instances.size();
+	buildRangeInfo.primitiveOffset = 0;
+	buildRangeInfo.firstVertex = 0;
+	buildRangeInfo.transformOffset = 0;
+
+	const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &buildRangeInfo;
+
+	vkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &buildInfo, &pBuildRangeInfo);
+}
+
+void TopLevelAS::updateInstances(VkCommandBuffer commandBuffer, const std::vector<std::pair<uint32_t, glm::mat4>>& transforms)
+{
+	if (!canUpdate())
+	{
+		FATAL_ERROR("TLAS was not built with VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR");
+		return;
+	}
+
+	for (const std::pair<uint32_t, glm::mat4>& transform : transforms)
+	{
+		writeInstanceTransform(m_instances[transform.first], transform.second);
+	}
+
+	//Write the instances into the next slice of the ring
+	m_ringIndex = (m_ringIndex + 1) % TLAS_INSTANCE_RING_SIZE;
+
+	memcpy(m_mappedInstances + (size_t)m_ringIndex * m_instances.size(), m_instances.data(), m_instances.size() * sizeof(VkAccelerationStructureInstanceKHR));
+
+	//Traversal of the previous frame has to finish before the TLAS is updated in place
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+	barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+
+	vkCmdPipelineBarrier(commandBuffer,
+						 VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+						 VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+						 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	recordBuild(commandBuffer, VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR);
+
+	//The rays traced in this frame have to see the updated TLAS
+	barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+	barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+
+	vkCmdPipelineBarrier(commandBuffer,
+						 VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+						 VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+						 0, 1, &barrier, 0, nullptr, 0, nullptr);
 }
\ No newline at end of file
@@ -5,6 +5,21 @@
 #include <vector>
 #include <memory>
 
+//Maximum size of the scratch memory shared by a batch of BLAS builds
+#define BLAS_SCRATCH_POOL_BUDGET (128ull * 1024 * 1024)
+
+//Maximum number of BLAS builds recorded with a single command
+#define BLAS_BUILD_BATCH_MAX_COUNT 256
+
+//Size of the memory that uncompacted BLASes are built into before they are compacted (unless a single batch needs more)
+#define BLAS_BUILD_STORAGE_BUDGET (128ull * 1024 * 1024)
+
+//Size of the memory blocks that compact BLASes are sub-allocated from
+#define BLAS_COMPACT_BLOCK_SIZE (32ull * 1024 * 1024)
+
+//Number of instance buffer slices a TLAS cycles through when it's updated (must exceed the number of frames in flight)
+#define TLAS_INSTANCE_RING_SIZE 3
+
 struct RaytracingDeviceFeatures
 {
 	VkPhysicalDeviceAccelerationStructureFeaturesKHR accelStructFeatures = {};
@@ -14,6 +29,9 @@ struct RaytracingDeviceFeatures
 	VkPhysicalDeviceHostQueryResetFeatures hostQueryReset = {};
 	VkPhysicalDeviceScalarBlockLayoutFeatures scalarBlockLayout = {};
 
+	//Core features (passed separately from the pNext chain)
+	VkPhysicalDeviceFeatures deviceFeatures = {};
+
 	void* pNext = nullptr;
 };
 
@@ -44,10 +62,23 @@ struct BLASCreateInfo
 	VkBuildAccelerationStructureFlagsKHR flags = 0;
 };
 
+//How `buildBLAS` records the builds (see "Note on batched BLAS builds")
+enum class BLASBuildMode
+{
+	//One build per command buffer, all sharing the same scratch memory
+	Serial,
+
+	//Batches of builds recorded with a single command, each build with its own scratch memory
+	Batched,
+
+	//Builds on the CPU with deferred host operations (see "Note on host BLAS builds")
+	Host
+};
+
 struct BLASBuildResult
 {
 	std::vector<BottomLevelAS> blasList;
-	VkDeviceMemory memory;
+	std::vector<Allocation> memoryBlocks;
 };
 
 class TopLevelAS;
@@ -64,19 +95,38 @@ private:
 	VkPhysicalDeviceProperties m_physicalDeviceProperties = {};
 	VkPhysicalDeviceAccelerationStructurePropertiesKHR m_accelStructProperties = {};
 	VkPhysicalDeviceRayTracingPipelinePropertiesKHR m_rtPipelineProperties = {};
+	VkPhysicalDeviceIDProperties m_deviceIDProperties = {};
+	VkPhysicalDeviceMaintenance3Properties m_maintenance3Properties = {};
 
 	RenderDevice* m_renderDevice = nullptr;
+private:
+	//Creates the acceleration structure and its (unbound) buffer
+	BottomLevelAS prepareBLAS(const BLASCreateInfo& createInfo, VkAccelerationStructureBuildTypeKHR buildType, VkMemoryRequirements& memRequirements) const;
+
+	BLASBuildResult buildBLASOnHost(std::vector<BLASCreateInfo>& blasList) const;
+	void joinDeferredOperation(VkDeferredOperationKHR operation) const;
 public:
 	RaytracingDevice() {}
 	~RaytracingDevice();
 
 	RaytracingDeviceFeatures* init(RenderDevice* renderDevice);
 
-	std::shared_ptr<const BLASGeometryInfo> compileGeometry(VkBuffer vertexBuffer, unsigned int vertexSize, unsigned int maxVertex, VkBuffer indexBuffer, unsigned int indexCount, VkDeviceOrHostAddressConstKHR transformData, VkGeometryFlagsKHR flags) const;
+	std::shared_ptr<const BLASGeometryInfo> compileGeometry(VkDeviceAddress vertexAddress, unsigned int vertexSize, unsigned int maxVertex, VkDeviceAddress indexAddress, VkIndexType indexType, unsigned int indexCount, VkDeviceOrHostAddressConstKHR transformData, VkGeometryFlagsKHR flags) const;
+
+	//Geometry for host builds, which read the vertex and index data from host memory
+	std::shared_ptr<const BLASGeometryInfo> compileHostGeometry(const void* vertexData, unsigned int vertexSize, unsigned int maxVertex, const void* indexData, VkIndexType indexType, unsigned int indexCount, VkGeometryFlagsKHR flags) const;
+
 	VkAccelerationStructureInstanceKHR compileInstances(const BottomLevelAS& blas, glm::mat4 transform, uint32_t instanceCustomIndex, uint32_t mask, uint32_t instanceShaderBindingTableRecordOffset, VkGeometryInstanceFlagsKHR flags) const;
 
-	BLASBuildResult buildBLAS(std::vector<BLASCreateInfo>& blasList) const;
+	BLASBuildResult buildBLAS(std::vector<BLASCreateInfo>& blasList, BLASBuildMode mode = BLASBuildMode::Batched) const;
 	void destroyBLAS(const BottomLevelAS& blas) const;
+	void destroyBLAS(const BLASBuildResult& buildResult) const;
+
+	//Serialized BLASes can be deserialized on devices with the same driver (see "Note on the BLAS cache")
+	std::vector<std::vector<uint8_t>> serializeBLAS(const BLASBuildResult& buildResult) const;
+
+	//Returns false (without creating anything) if any of the serialized BLASes isn't compatible with the device
+	bool deserializeBLAS(std::vector<BLASCreateInfo>& blasList, const std::vector<std::pair<const uint8_t*, size_t>>& serializedBLASes, BLASBuildResult& buildResult) const;
 
 	void buildTLAS(TopLevelAS& tlas, const std::vector<VkAccelerationStructureInstanceKHR>& instances, VkBuildAccelerationStructureFlagsKHR flags) const;
 
@@ -85,20 +135,62 @@ public:
 	inline const RenderDevice* getRenderDevice() const { return m_renderDevice; }
 	inline const VkPhysicalDeviceLimits& getPhysicalDeviceLimits() const { return m_physicalDeviceProperties.limits; }
 	inline VkPhysicalDeviceRayTracingPipelinePropertiesKHR getRTPipelineProperties() const { return m_rtPipelineProperties; }
+	inline const VkPhysicalDeviceAccelerationStructurePropertiesKHR& getAccelStructProperties() const { return m_accelStructProperties; }
+
+	inline const uint8_t* getDeviceUUID() const { return m_deviceIDProperties.deviceUUID; }
+	inline uint32_t getDriverVersion() const { return m_physicalDeviceProperties.driverVersion; }
+
+	//The largest allocation that can be made, which is often only a fraction of the heap (2-4GB)
+	inline VkDeviceSize getMaxMemoryAllocationSize() const { return m_maintenance3Properties.maxMemoryAllocationSize; }
+
+	inline bool isTextureCompressionBCSupported() const { return m_physicalDeviceFeatures.textureCompressionBC == VK_TRUE; }
+	inline bool isHostBuildSupported() const { return m_accelStructFeatures.accelerationStructureHostCommands == VK_TRUE; }
 };
 
+/*
+ ------------------------------
+	  Note on TLAS updates
+ ------------------------------
+
+ The TLAS keeps its storage, scratch and instance buffers after it has been built, so that it can be refitted
+ with new instance transforms without allocating anything. The instance buffer is split into
+ TLAS_INSTANCE_RING_SIZE slices: every call to `updateInstances` writes the instances into the next slice and
+ records a VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR build into the frame's command buffer, so the slice
+ that a frame in flight reads from is never overwritten.
+
+ Updates are only possible if the TLAS was built with VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR. They
+ keep the topology of the original build, so the traversal gets slower the more the instances have moved. The TLAS
+ should be rebuilt with `RaytracingDevice::buildTLAS` when instances are added or removed, or have moved a lot.
+*/
 class TopLevelAS
 {
 private:
-	VkAccelerationStructureKHR m_accelerationStructure;
-	Buffer m_accelStorageBuffer;
+	VkAccelerationStructureKHR m_accelerationStructure = VK_NULL_HANDLE;
+	Buffer m_accelStorageBuffer = {};
+
+	Buffer m_scratchBuffer = {};
+	VkDeviceAddress m_scratchAddress = 0;
+
+	Buffer m_instanceBuffer = {};
+	VkAccelerationStructureInstanceKHR* m_mappedInstances = nullptr;
+	uint32_t m_ringIndex = 0;
+
+	std::vector<VkAccelerationStructureInstanceKHR> m_instances;
+	VkBuildAccelerationStructureFlagsKHR m_buildFlags = 0;
 
 	const RaytracingDevice* m_device = nullptr;
+private:
+	void recordBuild(VkCommandBuffer commandBuffer, VkBuildAccelerationStructureModeKHR mode) const;
 public:
 	void init(const RaytracingDevice* device);
 	void destroy();
 
+	//Replaces the transforms of the given instances (by index) and records a refit into `commandBuffer`
+	void updateInstances(VkCommandBuffer commandBuffer, const std::vector<std::pair<uint32_t, glm::mat4>>& transforms);
+
 	inline VkAccelerationStructureKHR get() const { return m_accelerationStructure; }
+	inline uint32_t getInstanceCount() const { return (uint32_t)m_instances.size(); }
+	inline bool canUpdate() const { return (m_buildFlags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR) != 0; }
 
 	friend class RaytracingDevice;
 };
\ No newline at end of file
@@ -267,7 +267,7 @@ bool NativeRaytracingPipeline::init(const RaytracingDevice* raytracingDevice, Vk
 
 	uint32_t sbtSize = m_sbtNumEntries * m_sbtHandleAlignedSize;
 
-	Buffer stagingBuffer = renderDevice->createBuffer(sbtSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	Buffer stagingBuffer = renderDevice->createBuffer(sbtSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, MemoryStrategy::Linear);
 	m_sbtBuffer = renderDevice->createBuffer(sbtSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
 													  VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
@@ -276,8 +276,7 @@ bool NativeRaytracingPipeline::init(const RaytracingDevice* raytracingDevice, Vk
 	VK_CHECK(vkGetRayTracingShaderGroupHandlesKHR(device, m_pipeline, 0, m_sbtNumEntries, m_sbtNumEntries * m_sbtHandleSize, shaderHandles));
 
 	//Write handles to SBT bufer
-	uint8_t* memory = nullptr;
-	VK_CHECK(vkMapMemory(device, stagingBuffer.memory, 0, sbtSize, 0, (void**)&memory));
+	uint8_t* memory = stagingBuffer.allocation.mappedData;
 
 	for (uint32_t i = 0; i < shaderGroups.size(); ++i)
 	{
@@ -285,8 +284,6 @@ bool NativeRaytracingPipeline::init(const RaytracingDevice* raytracingDevice, Vk
 		memory += m_sbtHandleAlignedSize;
 	}
 
-	vkUnmapMemory(device, stagingBuffer.memory);
-
 	renderDevice->executeCommands(1, [&](VkCommandBuffer* commandBuffers)
 	{
 		VkBufferCopy region = {};
@@ -501,6 +501,9 @@ void RenderDevice::createLogicalDevice(std::vector<const char*> extensions, std:
 
 	vkGetDeviceQueue(m_device, m_queueFamilyIndex, 0, &m_queue);
 
+	m_allocator->init(m_device, m_memProperties);
+	m_samplerCache->init(m_device);
+
 	//Create transient command pool
 	m_transientPool = createCommandPool(VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 }
@@ -555,7 +558,7 @@ uint32_t RenderDevice::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags
 	return (uint32_t)-1;
 }
 
-Buffer RenderDevice::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) const
+Buffer RenderDevice::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryStrategy strategy) const
 {
 	VkBufferCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -568,29 +571,41 @@ Buffer RenderDevice::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, V
 	VkBuffer buffer;
 	VK_CHECK(vkCreateBuffer(m_device, &createInfo, nullptr, &buffer));
 
-	VkMemoryRequirements requirements;
-	vkGetBufferMemoryRequirements(m_device, buffer, &requirements);
+	VkMemoryDedicatedRequirements dedicatedRequirements = {};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
 
-	VkMemoryAllocateFlagsInfo allocFlags = {};
-	allocFlags.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
-	allocFlags.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+	VkMemoryRequirements2 requirements = {};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	requirements.pNext = &dedicatedRequirements;
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.pNext = (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) ? &allocFlags : nullptr;
-	allocInfo.allocationSize = requirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+	VkBufferMemoryRequirementsInfo2 requirementsInfo = {};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+	requirementsInfo.buffer = buffer;
 
-	if (allocInfo.memoryTypeIndex == (uint32_t)-1)
-	{
-		FATAL_ERROR("Could not find appropriate memory type for buffer");
-	}
+	vkGetBufferMemoryRequirements2(m_device, &requirementsInfo, &requirements);
+
+	MemoryRequest request;
+	request.requirements = requirements.memoryRequirements;
+	request.properties = properties;
+	request.strategy = strategy;
+	request.deviceAddress = (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) != 0;
+	request.dedicated = dedicatedRequirements.requiresDedicatedAllocation || dedicatedRequirements.prefersDedicatedAllocation;
+	request.dedicatedBuffer = buffer;
+
+	Allocation allocation = m_allocator->allocate(request);
+	VK_CHECK(vkBindBufferMemory(m_device, buffer, allocation.memory, allocation.offset));
+
+	return { buffer, allocation };
+}
 
-	VkDeviceMemory memory;
-	VK_CHECK(vkAllocateMemory(m_device, &allocInfo, nullptr, &memory));
-	VK_CHECK(vkBindBufferMemory(m_device, buffer, memory, 0));
+Allocation RenderDevice::allocateMemory(const MemoryRequest& request) const
+{
+	return m_allocator->allocate(request);
+}
 
-	return { buffer, memory };
+void RenderDevice::freeMemory(const Allocation& allocation) const
+{
+	m_allocator->free(allocation);
 }
 
 VkDeviceAddress RenderDevice::getBufferAddress(VkBuffer buffer) const
@@ -609,10 +624,7 @@ void RenderDevice::destroyBuffer(const Buffer& buffer) const
 		vkDestroyBuffer(m_device, buffer.buffer, nullptr);
 	}
 
-	if (buffer.memory != VK_NULL_HANDLE)
-	{
-		vkFreeMemory(m_device, buffer.memory, nullptr);
-	}
+	m_allocator->free(buffer.allocation);
 }
 
 Image RenderDevice::createImage2D(int width, int height, VkFormat format, int mipLevels, VkImageUsageFlags usage, VkMemoryPropertyFlags properties) const
@@ -633,22 +645,29 @@ Image RenderDevice::createImage2D(int width, int height, VkFormat format, int mi
 	VkImage image;
 	VK_CHECK(vkCreateImage(m_device, &imageCI, nullptr, &image));
 
-	VkMemoryRequirements requirements;
-	vkGetImageMemoryRequirements(m_device, image, &requirements);
-	
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = requirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+	VkMemoryDedicatedRequirements dedicatedRequirements = {};
+	dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
 
-	if (allocInfo.memoryTypeIndex == (uint32_t)-1)
-	{
-		FATAL_ERROR("Could not find appropriate memory type for image");
-	}
+	VkMemoryRequirements2 requirements = {};
+	requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+	requirements.pNext = &dedicatedRequirements;
+
+	VkImageMemoryRequirementsInfo2 requirementsInfo = {};
+	requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+	requirementsInfo.image = image;
+
+	vkGetImageMemoryRequirements2(m_device, &requirementsInfo, &requirements);
+
+	//Render targets are usually large enough for the driver to prefer a dedicated allocation
+	MemoryRequest request;
+	request.requirements = requirements.memoryRequirements;
+	request.properties = properties;
+	request.isImage = true;
+	request.dedicated = dedicatedRequirements.requiresDedicatedAllocation || dedicatedRequirements.prefersDedicatedAllocation;
+	request.dedicatedImage = image;
 
-	VkDeviceMemory memory;
-	VK_CHECK(vkAllocateMemory(m_device, &allocInfo, nullptr, &memory));
-	VK_CHECK(vkBindImageMemory(m_device, image, memory, 0));
+	Allocation allocation = m_allocator->allocate(request);
+	VK_CHECK(vkBindImageMemory(m_device, image, allocation.memory, allocation.offset));
 
 	VkImageViewCreateInfo imageViewCI = {};
 	imageViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -668,7 +687,7 @@ Image RenderDevice::createImage2D(int width, int height, VkFormat format, int mi
 	VkImageView imageView;
 	VK_CHECK(vkCreateImageView(m_device, &imageViewCI, nullptr, &imageView));
 
-	return { image, memory, imageView };
+	return { image, allocation, imageView };
 }
 
 void RenderDevice::destroyImage(const Image& image) const
@@ -683,10 +702,12 @@ void RenderDevice::destroyImage(const Image& image) const
 		vkDestroyImage(m_device, image.image, nullptr);
 	}
 
-	if (image.memory != VK_NULL_HANDLE)
-	{
-		vkFreeMemory(m_device, image.memory, nullptr);
-	}
+	m_allocator->free(image.allocation);
+}
+
+VkSampler RenderDevice::getSampler(const VkSamplerCreateInfo& createInfo) const
+{
+	return m_samplerCache->getSampler(createInfo);
 }
 
 void RenderDevice::executeCommands(int bufferCount, const std::function<void(VkCommandBuffer*)>& func) const
@@ -878,6 +899,9 @@ void RenderDevice::destroy()
 
 	if (m_device != VK_NULL_HANDLE)
 	{
+		m_samplerCache->destroy();
+		m_allocator->destroy();
+
 		vkDestroyDevice(m_device, nullptr);
 	}
 
@@ -10,19 +10,21 @@
 #include <volk.h>
 
 #include "Window.h"
+#include "MemoryAllocator.h"
+#include "SamplerCache.h"
 
 #define UINT32_ALIGN(x, a) (((x) + ((a) - 1)) & ~((a) - 1))
 
 struct Buffer
 {
 	VkBuffer buffer = VK_NULL_HANDLE;
-	VkDeviceMemory memory = VK_NULL_HANDLE;
+	Allocation allocation = {};
 };
 
 struct Image
 {
 	VkImage image = VK_NULL_HANDLE;
-	VkDeviceMemory memory = VK_NULL_HANDLE;
+	Allocation allocation = {};
 	VkImageView imageView = VK_NULL_HANDLE;
 };
 
@@ -50,8 +52,14 @@ private:
 	VkCommandPool m_transientPool = VK_NULL_HANDLE;
 
 	std::unique_ptr<std::mutex> m_queueSubmitMutex;
+
+	//All device memory is allocated through the allocator (see "Note on device memory allocation")
+	std::unique_ptr<MemoryAllocator> m_allocator;
+
+	//Samplers are shared by everything that uses the same parameters (see "Note on sampler caching")
+	std::unique_ptr<SamplerCache> m_samplerCache;
 public:
-	RenderDevice() : m_queueSubmitMutex(std::make_unique<std::mutex>()) {}
+	RenderDevice() : m_queueSubmitMutex(std::make_unique<std::mutex>()), m_allocator(std::make_unique<MemoryAllocator>()), m_samplerCache(std::make_unique<SamplerCache>()) {}
 
 	void createInstance(std::vector<const char*> extensions, std::vector<const char*> validationLayers, bool enableDebugMessenger);
 	void createSurface(const Window& window);
@@ -65,13 +73,20 @@ public:
 
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
 
-	Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) const;
+	Allocation allocateMemory(const MemoryRequest& request) const;
+	void freeMemory(const Allocation& allocation) const;
+
+	//Host visible buffers stay mapped (see `Allocation::mappedData`)
+	Buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, MemoryStrategy strategy = MemoryStrategy::General) const;
 	VkDeviceAddress getBufferAddress(VkBuffer buffer) const;
 	void destroyBuffer(const Buffer& buffer) const;
 
 	Image createImage2D(int width, int height, VkFormat format, int mipLevels, VkImageUsageFlags usage, VkMemoryPropertyFlags properties) const;
 	void destroyImage(const Image& image) const;
 
+	//The returned sampler is owned by the device and must not be destroyed
+	VkSampler getSampler(const VkSamplerCreateInfo& createInfo) const;
+
 	void executeCommands(int bufferCount, const std::function<void(VkCommandBuffer*)>& func) const;
 
 	VkShaderModule compileShader(VkShaderStageFlagBits shaderType, const std::string& source, const std::vector<std::string>& definitions = {}) const;
@@ -87,6 +102,8 @@ public:
 	inline VkSurfaceKHR getSurface() const { return m_surface; }
 	inline VkPhysicalDevice getPhysicalDevice() const { return m_physicalDevice; }
 
+	inline MemoryAllocatorStats getMemoryStats() const { return m_allocator->getStats(); }
+
 	inline std::unique_ptr<std::mutex>& getQueueMutex() { return m_queueSubmitMutex; }
 	inline const std::unique_ptr<std::mutex>& getQueueMutex() const { return m_queueSubmitMutex; }
 };
@@ -0,0 +1,77 @@
+#include "SamplerCache.h"
+
+#include "RenderDevice.h"
+#include "Common.h"
+
+#include "utils/Hash.h"
+
+static uint64_t hashCreateInfo(const VkSamplerCreateInfo& info)
+{
+	uint64_t hash = Hash::value(info.flags);
+
+	hash = Hash::combine(hash, Hash::value(((uint64_t)info.magFilter << 32) | info.minFilter));
+	hash = Hash::combine(hash, Hash::value(((uint64_t)info.mipmapMode << 32) | info.borderColor));
+	hash = Hash::combine(hash, Hash::value(((uint64_t)info.addressModeU << 32) | info.addressModeV));
+	hash = Hash::combine(hash, Hash::value(((uint64_t)info.addressModeW << 32) | info.compareOp));
+	hash = Hash::combine(hash, Hash::value(((uint64_t)info.anisotropyEnable << 32) | info.compareEnable));
+	hash = Hash::combine(hash, Hash::value(info.unnormalizedCoordinates));
+
+	float lodParameters[4] = { info.mipLodBias, info.maxAnisotropy, info.minLod, info.maxLod };
+
+	return Hash::combine(hash, Hash::bytes(lodParameters, sizeof(lodParameters)));
+}
+
+static bool isEqual(const VkSamplerCreateInfo& a, const VkSamplerCreateInfo& b)
+{
+	return a.flags == b.flags && a.magFilter == b.magFilter && a.minFilter == b.minFilter && a.mipmapMode == b.mipmapMode &&
+		   a.addressModeU == b.addressModeU && a.addressModeV == b.addressModeV && a.addressModeW == b.addressModeW &&
+		   a.mipLodBias == b.mipLodBias && a.anisotropyEnable == b.anisotropyEnable && a.maxAnisotropy == b.maxAnisotropy &&
+		   a.compareEnable == b.compareEnable && a.compareOp == b.compareOp && a.minLod == b.minLod && a.maxLod == b.maxLod &&
+		   a.borderColor == b.borderColor && a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+}
+
+void SamplerCache::init(VkDevice device)
+{
+	m_device = device;
+}
+
+void SamplerCache::destroy()
+{
+	std::lock_guard<std::mutex> guard(m_mutex);
+
+	for (const auto& entry : m_samplers)
+	{
+		vkDestroySampler(m_device, entry.second.second, nullptr);
+	}
+
+	m_samplers.clear();
+}
+
+VkSampler SamplerCache::getSampler(const VkSamplerCreateInfo& createInfo)
+{
+	if (createInfo.pNext)
+	{
+		FATAL_ERROR("Samplers with a pNext chain can't be cached");
+	}
+
+	uint64_t hash = hashCreateInfo(createInfo);
+
+	std::lock_guard<std::mutex> guard(m_mutex);
+
+	auto range = m_samplers.equal_range(hash);
+
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (isEqual(it->second.first, createInfo))
+		{
+			return it->second.second;
+		}
+	}
+
+	VkSampler sampler = VK_NULL_HANDLE;
+	VK_CHECK(vkCreateSampler(m_device, &createInfo, nullptr, &sampler));
+
+	m_samplers.emplace(hash, std::make_pair(createInfo, sampler));
+
+	return sampler;
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <volk.h>
+
+#include <unordered_map>
+#include <utility>
+#include <mutex>
+
+/*
+ ------------------------------
+	  Note on sampler caching
+ ------------------------------
+
+ Samplers are tiny, but drivers limit how many of them can exist at once (maxSamplerAllocationCount, which is
+ only 4000 on some of them) and a scene only ever needs a handful of different ones. Samplers are therefore requested
+ from the cache with their create info, and create infos with the same contents share a single sampler. Cached
+ samplers live until the device is destroyed, so they must never be destroyed by the resources that use them.
+*/
+
+class SamplerCache
+{
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+
+	//Samplers bucketed by the hash of their create info
+	std::unordered_multimap<uint64_t, std::pair<VkSamplerCreateInfo, VkSampler>> m_samplers;
+
+	//Scenes are loaded on a separate thread
+	std::mutex m_mutex;
+public:
+	void init(VkDevice device);
+	void destroy();
+
+	//Returns the cached sampler for `createInfo` or creates it (the create info must not have a `pNext` chain)
+	VkSampler getSampler(const VkSamplerCreateInfo& createInfo);
+};
\ No newline at end of file
@@ -0,0 +1,345 @@
+#include "StagingRing.h"
+
+#include "Common.h"
+
+#include <algorithm>
+#include <cstring>
+
+void StagingRing::init(const RenderDevice* device, VkDeviceSize size, uint32_t segmentCount, bool batchCopies)
+{
+	m_device = device;
+	m_batchCopies = batchCopies;
+	m_stats = {};
+
+	VkDevice deviceHandle = m_device->getDevice();
+
+	//Create buffer (segments are kept aligned so that they can be used for any copy)
+	m_segmentSize = (size / segmentCount) & ~(VkDeviceSize)255;
+
+	m_buffer = m_device->createBuffer(m_segmentSize * segmentCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+	m_mappedMemory = m_buffer.allocation.mappedData;
+
+	//Create segments
+	m_commandPool = m_device->createCommandPool(VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+
+	m_segments.resize(segmentCount);
+
+	std::vector<VkCommandBuffer> commandBuffers(segmentCount);
+
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = m_commandPool;
+	allocInfo.commandBufferCount = segmentCount;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+	VK_CHECK(vkAllocateCommandBuffers(deviceHandle, &allocInfo, commandBuffers.data()));
+
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+	for (uint32_t i = 0; i < segmentCount; ++i)
+	{
+		m_segments[i].commandBuffer = commandBuffers[i];
+
+		VK_CHECK(vkCreateFence(deviceHandle, &fenceCreateInfo, nullptr, &m_segments[i].fence));
+	}
+
+	m_currentSegment = 0;
+	m_segmentOffset = 0;
+	m_isRecording = false;
+}
+
+void StagingRing::destroy()
+{
+	VkDevice deviceHandle = m_device->getDevice();
+
+	finish();
+
+	for (Segment& segment : m_segments)
+	{
+		vkDestroyFence(deviceHandle, segment.fence, nullptr);
+	}
+
+	m_segments.clear();
+
+	vkDestroyCommandPool(deviceHandle, m_commandPool, nullptr);
+	m_commandPool = VK_NULL_HANDLE;
+
+	m_mappedMemory = nullptr;
+
+	m_device->destroyBuffer(m_buffer);
+	m_buffer = {};
+}
+
+void StagingRing::beginSegment()
+{
+	Segment& segment = m_segments[m_currentSegment];
+
+	//Wait for the GPU to finish copying out of the segment
+	if (segment.isPending)
+	{
+		if (vkGetFenceStatus(m_device->getDevice(), segment.fence) == VK_NOT_READY)
+		{
+			m_stats.stallCount++;
+		}
+
+		VK_CHECK(vkWaitForFences(m_device->getDevice(), 1, &segment.fence, VK_TRUE, UINT64_MAX));
+		VK_CHECK(vkResetFences(m_device->getDevice(), 1, &segment.fence));
+
+		segment.isPending = false;
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VK_CHECK(vkResetCommandBuffer(segment.commandBuffer, 0));
+	VK_CHECK(vkBeginCommandBuffer(segment.commandBuffer, &beginInfo));
+
+	m_segmentOffset = 0;
+	m_isRecording = true;
+}
+
+void StagingRing::flush()
+{
+	if (!m_isRecording)
+	{
+		return;
+	}
+
+	Segment& segment = m_segments[m_currentSegment];
+
+	recordPendingCopies();
+
+	VK_CHECK(vkEndCommandBuffer(segment.commandBuffer));
+
+	{
+		std::lock_guard<std::mutex> guard(*m_device->getQueueMutex());
+
+		m_device->submit({ segment.commandBuffer }, {}, {}, segment.fence);
+	}
+
+	segment.isPending = true;
+	m_isRecording = false;
+
+	m_stats.submitCount++;
+
+	m_currentSegment = (m_currentSegment + 1) % (uint32_t)m_segments.size();
+}
+
+void StagingRing::finish()
+{
+	flush();
+
+	for (Segment& segment : m_segments)
+	{
+		if (segment.isPending)
+		{
+			VK_CHECK(vkWaitForFences(m_device->getDevice(), 1, &segment.fence, VK_TRUE, UINT64_MAX));
+			VK_CHECK(vkResetFences(m_device->getDevice(), 1, &segment.fence));
+
+			segment.isPending = false;
+		}
+	}
+}
+
+VkCommandBuffer StagingRing::getCommandBuffer()
+{
+	if (!m_isRecording)
+	{
+		beginSegment();
+	}
+
+	//Commands recorded by the caller might depend on earlier copies
+	recordPendingCopies();
+
+	return m_segments[m_currentSegment].commandBuffer;
+}
+
+void StagingRing::addBufferCopy(VkBuffer dstBuffer, const VkBufferCopy& region)
+{
+	m_stats.uploadedBytes += region.size;
+
+	if (!m_batchCopies)
+	{
+		vkCmdCopyBuffer(m_segments[m_currentSegment].commandBuffer, m_buffer.buffer, dstBuffer, 1, &region);
+
+		m_stats.copyCommandCount++;
+		m_stats.copyRegionCount++;
+
+		return;
+	}
+
+	auto it = m_pendingCopyIndices.find(dstBuffer);
+
+	if (it == m_pendingCopyIndices.end())
+	{
+		it = m_pendingCopyIndices.emplace(dstBuffer, m_pendingCopies.size()).first;
+		m_pendingCopies.push_back({ dstBuffer, {} });
+	}
+
+	std::vector<VkBufferCopy>& regions = m_pendingCopies[it->second].regions;
+
+	//Merge with the previous region if they are adjacent in both buffers
+	if (!regions.empty())
+	{
+		VkBufferCopy& previous = regions.back();
+
+		if (previous.srcOffset + previous.size == region.srcOffset && previous.dstOffset + previous.size == region.dstOffset)
+		{
+			previous.size += region.size;
+			return;
+		}
+	}
+
+	regions.push_back(region);
+}
+
+void StagingRing::recordPendingCopies()
+{
+	VkCommandBuffer commandBuffer = m_segments[m_currentSegment].commandBuffer;
+
+	for (const PendingCopies& copies : m_pendingCopies)
+	{
+		vkCmdCopyBuffer(commandBuffer, m_buffer.buffer, copies.dstBuffer, (uint32_t)copies.regions.size(), copies.regions.data());
+
+		m_stats.copyCommandCount++;
+		m_stats.copyRegionCount += (uint32_t)copies.regions.size();
+	}
+
+	m_pendingCopies.clear();
+	m_pendingCopyIndices.clear();
+}
+
+uint8_t* StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& bufferOffset)
+{
+	if (size > m_segmentSize)
+	{
+		FATAL_ERROR("Staging allocation is larger than a segment\n");
+		return nullptr;
+	}
+
+	if (!m_isRecording)
+	{
+		beginSegment();
+	}
+
+	VkDeviceSize offset = UINT32_ALIGN(m_segmentOffset, alignment);
+
+	if (offset + size > m_segmentSize)
+	{
+		flush();
+		beginSegment();
+
+		offset = 0;
+	}
+
+	m_segmentOffset = offset + size;
+
+	bufferOffset = m_currentSegment * m_segmentSize + offset;
+
+	return m_mappedMemory + bufferOffset;
+}
+
+bool StagingRing::canAllocate(VkDeviceSize size, VkDeviceSize alignment) const
+{
+	//A segment that isn't being recorded will start out empty
+	VkDeviceSize offset = m_isRecording ? UINT32_ALIGN(m_segmentOffset, alignment) : 0;
+
+	return offset + size <= m_segmentSize;
+}
+
+void StagingRing::copyToBuffer(VkDeviceSize bufferOffset, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size)
+{
+	assert(m_isRecording && bufferOffset >= m_currentSegment * m_segmentSize && bufferOffset + size <= (m_currentSegment + 1) * m_segmentSize);
+
+	addBufferCopy(dstBuffer, { bufferOffset, dstOffset, size });
+}
+
+void StagingRing::uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+{
+	const uint8_t* source = (const uint8_t*)data;
+
+	while (size > 0)
+	{
+		VkDeviceSize chunkSize = std::min(size, m_segmentSize);
+
+		VkDeviceSize bufferOffset = 0;
+		uint8_t* memory = allocate(chunkSize, 16, bufferOffset);
+
+		memcpy(memory, source, chunkSize);
+
+		addBufferCopy(dstBuffer, { bufferOffset, dstOffset, chunkSize });
+
+		source += chunkSize;
+		dstOffset += chunkSize;
+		size -= chunkSize;
+	}
+}
+
+void StagingRing::uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size, const std::function<void(uint8_t*)>& writer)
+{
+	if (size > m_segmentSize)
+	{
+		std::vector<uint8_t> data(size);
+		writer(data.data());
+
+		uploadBuffer(dstBuffer, dstOffset, data.data(), size);
+
+		return;
+	}
+
+	VkDeviceSize bufferOffset = 0;
+	uint8_t* memory = allocate(size, 16, bufferOffset);
+
+	writer(memory);
+
+	addBufferCopy(dstBuffer, { bufferOffset, dstOffset, size });
+}
+
+void StagingRing::uploadImage(VkImage dstImage, uint32_t mipLevel, uint32_t width, uint32_t height, uint32_t texelSize, const void* data, uint32_t blockExtent)
+{
+	const uint8_t* source = (const uint8_t*)data;
+
+	//Rows are rows of blocks for compressed formats
+	uint32_t blockWidth = (width + blockExtent - 1) / blockExtent;
+	uint32_t blockHeight = (height + blockExtent - 1) / blockExtent;
+
+	VkDeviceSize rowSize = (VkDeviceSize)blockWidth * texelSize;
+	uint32_t maxRowsPerCopy = (uint32_t)std::min<VkDeviceSize>(m_segmentSize / rowSize, blockHeight);
+
+	if (maxRowsPerCopy == 0)
+	{
+		FATAL_ERROR("Image row doesn't fit into a staging segment\n");
+		return;
+	}
+
+	for (uint32_t row = 0; row < blockHeight; row += maxRowsPerCopy)
+	{
+		uint32_t rowCount = std::min(maxRowsPerCopy, blockHeight - row);
+		VkDeviceSize chunkSize = rowCount * rowSize;
+
+		VkDeviceSize bufferOffset = 0;
+		uint8_t* memory = allocate(chunkSize, 16, bufferOffset);
+
+		memcpy(memory, source + row * rowSize, chunkSize);
+
+		VkBufferImageCopy region = {};
+		region.bufferOffset = bufferOffset;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageSubresource.mipLevel = mipLevel;
+		region.imageOffset = { 0, (int32_t)(row * blockExtent), 0 };
+		region.imageExtent = { width, std::min(rowCount * blockExtent, height - row * blockExtent), 1 };
+
+		vkCmdCopyBufferToImage(m_segments[m_currentSegment].commandBuffer, m_buffer.buffer, dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+		m_stats.uploadedBytes += chunkSize;
+		m_stats.copyCommandCount++;
+		m_stats.copyRegionCount++;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "RenderDevice.h"
+
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+/*
+ ------------------------------
+	  Note on the staging ring
+ ------------------------------
+
+ The staging ring is a fixed-size, persistently mapped staging buffer that is split into
+ segments. Data is written to the current segment and the copies that read from it are
+ recorded into the segment's command buffer. When a segment is full it is submitted with its
+ own fence and the ring moves on to the next segment, waiting only if the GPU hasn't finished
+ copying out of it yet. This lets the CPU fill one segment while the GPU copies the previous
+ ones, and keeps the amount of host memory used for staging constant regardless of how much
+ data is uploaded.
+
+ Buffer copies are not recorded right away. Instead, the regions are collected per destination buffer
+ (merging adjacent ones) and recorded with a single `vkCmdCopyBuffer` per buffer when the segment is
+ submitted. Uploads that don't fit into a segment are split into multiple copies (images are split by rows).
+ Commands recorded into `getCommandBuffer()` (eg. layout transitions) are executed in order with
+ the copies, since all segments are submitted to the same queue in order.
+*/
+
+struct StagingRingStats
+{
+	VkDeviceSize uploadedBytes = 0;
+
+	uint32_t submitCount = 0;
+	uint32_t copyCommandCount = 0;
+	uint32_t copyRegionCount = 0;
+
+	//How many times the CPU had to wait for the GPU to free a segment
+	uint32_t stallCount = 0;
+};
+
+class StagingRing
+{
+private:
+	struct PendingCopies
+	{
+		VkBuffer dstBuffer;
+		std::vector<VkBufferCopy> regions;
+	};
+
+	struct Segment
+	{
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+
+		//True if the segment was submitted and its fence hasn't been waited on yet
+		bool isPending = false;
+	};
+
+	Buffer m_buffer;
+	uint8_t* m_mappedMemory = nullptr;
+
+	VkCommandPool m_commandPool = VK_NULL_HANDLE;
+
+	std::vector<Segment> m_segments;
+	VkDeviceSize m_segmentSize = 0;
+
+	uint32_t m_currentSegment = 0;
+	VkDeviceSize m_segmentOffset = 0;
+	bool m_isRecording = false;
+
+	bool m_batchCopies = true;
+	std::vector<PendingCopies> m_pendingCopies;
+	std::unordered_map<VkBuffer, size_t> m_pendingCopyIndices;
+
+	StagingRingStats m_stats;
+
+	const RenderDevice* m_device = nullptr;
+private:
+	void beginSegment();
+
+	void addBufferCopy(VkBuffer dstBuffer, const VkBufferCopy& region);
+	void recordPendingCopies();
+public:
+	//If `batchCopies` is false, every buffer copy is recorded as a separate command
+	void init(const RenderDevice* device, VkDeviceSize size, uint32_t segmentCount, bool batchCopies = true);
+	void destroy();
+
+	//Reserves `size` bytes in the current segment (starting a new segment if they don't fit) and
+	//returns a pointer to them. `size` must not be larger than `getMaxAllocationSize()`.
+	uint8_t* allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& bufferOffset);
+
+	//Returns true if `size` bytes can be allocated without submitting the current segment. Pointers
+	//returned by `allocate()` stay valid until the segment they were allocated from is submitted.
+	bool canAllocate(VkDeviceSize size, VkDeviceSize alignment) const;
+
+	//Copies memory returned by `allocate()` to `dstBuffer`. Must be called before the segment is submitted.
+	void copyToBuffer(VkDeviceSize bufferOffset, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size);
+
+	//Copies `data` to `dstBuffer`, splitting it into multiple copies if it doesn't fit into a segment
+	void uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+
+	//Lets `writer` write the data directly into staging memory (a temporary copy is only made if
+	//the data doesn't fit into a segment)
+	void uploadBuffer(VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size, const std::function<void(uint8_t*)>& writer);
+
+	//Copies tightly packed pixel data to an image that is in the TRANSFER_DST_OPTIMAL layout. For block-compressed
+	//formats, `texelSize` is the size of a block and `blockExtent` is its width/height in texels.
+	void uploadImage(VkImage dstImage, uint32_t mipLevel, uint32_t width, uint32_t height, uint32_t texelSize, const void* data, uint32_t blockExtent = 1);
+
+	//Submits the current segment
+	void flush();
+
+	//Submits the current segment and waits for all uploads to finish
+	void finish();
+
+	//The command buffer of the current segment
+	VkCommandBuffer getCommandBuffer();
+
+	inline VkBuffer getBuffer() const { return m_buffer.buffer; }
+	inline VkDeviceSize getMaxAllocationSize() const { return m_segmentSize; }
+
+	inline const StagingRingStats& getStats() const { return m_stats; }
+};
\ No newline at end of file
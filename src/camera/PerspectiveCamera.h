@@ -31,7 +31,7 @@ public:
 		m_device = device;
 
 		m_dataBuffer = m_device->createBuffer(sizeof(Data), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-		vkMapMemory(m_device->getDevice(), m_dataBuffer.memory, 0, sizeof(Data), 0, &m_dataPtr);
+		m_dataPtr = m_dataBuffer.allocation.mappedData;
 	}
 
 	void onUpdated(glm::vec3 position, glm::quat rotation, int width, int heigth) override
@@ -72,7 +72,6 @@ public:
 
 	void destroy() override
 	{
-		vkUnmapMemory(m_device->getDevice(), m_dataBuffer.memory);
 		m_device->destroyBuffer(m_dataBuffer);
 	}
 };
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "BLASCache.h"
+
+#include "SceneCache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static const char s_blasCacheMagic[4] = { 'V', 'K', 'R', 'B' };
+
+template<typename T>
+static bool isBLASRangeValid(uint64_t offset, uint64_t count, size_t fileSize)
+{
+	return offset <= fileSize && count <= (fileSize - offset) / sizeof(T);
+}
+
+bool BLASCache::validate(const BLASCacheKey& key)
+{
+	size_t fileSize = m_file.getSize();
+
+	if (fileSize < sizeof(BLASCacheHeader))
+	{
+		return false;
+	}
+
+	m_header = (const BLASCacheHeader*)m_file.getData();
+
+	if (memcmp(m_header->magic, s_blasCacheMagic, sizeof(s_blasCacheMagic)) != 0 || m_header->version != BLAS_CACHE_VERSION || !(m_header->key == key))
+	{
+		return false;
+	}
+
+	if (!isBLASRangeValid<CachedBLAS>(m_header->blasTableOffset, m_header->blasCount, fileSize))
+	{
+		return false;
+	}
+
+	m_blasTable = (const CachedBLAS*)(m_file.getData() + m_header->blasTableOffset);
+
+	for (uint32_t i = 0; i < m_header->blasCount; ++i)
+	{
+		if (!isBLASRangeValid<uint8_t>(m_blasTable[i].dataOffset, m_blasTable[i].dataSize, fileSize))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::shared_ptr<BLASCache> BLASCache::open(const std::string& cachePath, const BLASCacheKey& key)
+{
+	std::shared_ptr<BLASCache> cache = std::make_shared<BLASCache>();
+
+	if (!cache->m_file.open(cachePath))
+	{
+		return nullptr;
+	}
+
+	if (!cache->validate(key))
+	{
+		std::cout << "BLAS cache '" << cachePath << "' is out of date" << std::endl;
+		return nullptr;
+	}
+
+	return cache;
+}
+
+bool BLASCache::write(const std::string& cachePath, const BLASCacheKey& key, const std::vector<std::vector<uint8_t>>& serializedBLASes)
+{
+	std::string temporaryPath = cachePath + ".tmp";
+
+	std::ofstream file(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+
+	if (!file)
+	{
+		std::cerr << "Unable to create BLAS cache '" << temporaryPath << "'" << std::endl;
+		return false;
+	}
+
+	BLASCacheHeader header = {};
+	memcpy(header.magic, s_blasCacheMagic, sizeof(s_blasCacheMagic));
+	header.version = BLAS_CACHE_VERSION;
+	header.key = key;
+	header.blasCount = (uint32_t)serializedBLASes.size();
+	header.blasTableOffset = sizeof(BLASCacheHeader);
+
+	//The data of each BLAS follows the table (16-byte aligned like the scene cache)
+	std::vector<CachedBLAS> blasTable(serializedBLASes.size());
+
+	uint64_t offset = header.blasTableOffset + blasTable.size() * sizeof(CachedBLAS);
+
+	for (size_t i = 0; i < serializedBLASes.size(); ++i)
+	{
+		offset = (offset + 15) & ~15ull;
+
+		blasTable[i].dataOffset = offset;
+		blasTable[i].dataSize = serializedBLASes[i].size();
+
+		offset += serializedBLASes[i].size();
+	}
+
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)blasTable.data(), blasTable.size() * sizeof(CachedBLAS));
+
+	uint64_t writtenSize = header.blasTableOffset + blasTable.size() * sizeof(CachedBLAS);
+
+	for (size_t i = 0; i < serializedBLASes.size(); ++i)
+	{
+		static const char padding[16] = {};
+
+		file.write(padding, blasTable[i].dataOffset - writtenSize);
+		file.write((const char*)serializedBLASes[i].data(), serializedBLASes[i].size());
+
+		writtenSize = blasTable[i].dataOffset + blasTable[i].dataSize;
+	}
+
+	bool failed = !file;
+
+	file.close();
+
+	std::error_code error;
+
+	if (failed)
+	{
+		std::cerr << "Unable to write BLAS cache '" << temporaryPath << "'" << std::endl;
+
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+
+	//Move the finished file into place, so that a partially written file is never picked up
+	std::filesystem::rename(temporaryPath, cachePath, error);
+
+	if (error)
+	{
+		std::cerr << "Unable to write BLAS cache '" << cachePath << "': " << error.message() << std::endl;
+
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+
+	return true;
+}
+
+std::string BLASCache::getCachePath(const std::string& scenePath)
+{
+	//Kept next to the scene cache, under the same name
+	return std::filesystem::path(SceneCache::getCachePath(scenePath)).replace_extension(".vkrblas").string();
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+
+#include "utils/MappedFile.h"
+
+/*
+ ------------------------------
+	  Note on the BLAS cache
+ ------------------------------
+
+ Even when the scene itself comes from the scene cache, every BLAS is rebuilt on every load. After the BLASes
+ of a scene are built, the loader serializes them (`vkCmdCopyAccelerationStructureToMemoryKHR`) into a
+ `.vkrblas` file next to the scene cache. Subsequent loads deserialize them straight into acceleration
+ structures (`vkCmdCopyMemoryToAccelerationStructureKHR`) and skip building altogether.
+
+ Serialized acceleration structures can only be used by compatible devices and drivers, so the cache is keyed by
+ the device UUID, the driver version and a hash of the geometry (see `BLASCacheKey`). On top of that, every
+ serialized BLAS is checked with `vkGetDeviceAccelerationStructureCompatibilityKHR` before it is used, and the
+ BLASes are rebuilt if any of them is incompatible.
+*/
+
+//Bump this whenever the layout of the cache file changes
+#define BLAS_CACHE_VERSION 1
+
+struct BLASCacheKey
+{
+	//`VkPhysicalDeviceIDProperties::deviceUUID`
+	uint8_t deviceUUID[16] = {};
+	uint32_t driverVersion = 0;
+	uint32_t reserved = 0;
+
+	//Hash of the scene geometry and of how it is split into BLASes
+	uint64_t geometryHash = 0;
+
+	bool operator==(const BLASCacheKey& other) const
+	{
+		return memcmp(deviceUUID, other.deviceUUID, sizeof(deviceUUID)) == 0 && driverVersion == other.driverVersion && geometryHash == other.geometryHash;
+	}
+};
+
+struct BLASCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+
+	BLASCacheKey key;
+
+	uint32_t blasCount;
+	uint32_t reserved;
+
+	uint64_t blasTableOffset;
+};
+
+struct CachedBLAS
+{
+	//Offsets are relative to the start of the file
+	uint64_t dataOffset;
+	uint64_t dataSize;
+};
+
+class BLASCache
+{
+private:
+	MappedFile m_file;
+
+	const BLASCacheHeader* m_header = nullptr;
+	const CachedBLAS* m_blasTable = nullptr;
+private:
+	bool validate(const BLASCacheKey& key);
+public:
+	//Returns `nullptr` if the cache file doesn't exist or can't be used with `key`
+	static std::shared_ptr<BLASCache> open(const std::string& cachePath, const BLASCacheKey& key);
+
+	//Writes the serialized BLASes (in the order they are passed to `buildBLAS`) to a new cache file
+	static bool write(const std::string& cachePath, const BLASCacheKey& key, const std::vector<std::vector<uint8_t>>& serializedBLASes);
+
+	static std::string getCachePath(const std::string& scenePath);
+
+	inline uint32_t getBLASCount() const { return m_header->blasCount; }
+
+	inline const uint8_t* getBLASData(uint32_t index) const { return m_file.getData() + m_blasTable[index].dataOffset; }
+	inline size_t getBLASDataSize(uint32_t index) const { return (size_t)m_blasTable[index].dataSize; }
+};
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "GeometryLayout.h"
+
+#include "api/RenderDevice.h"
+
+#include <glm/glm.hpp>
+
+VkIndexType GeometryLayout::getIndexType(uint32_t vertexCount)
+{
+	return vertexCount <= 0x10000 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+}
+
+VkDeviceSize GeometryLayout::getIndexDataSize(uint32_t vertexCount, uint32_t faceCount)
+{
+	VkDeviceSize indexSize = getIndexType(vertexCount) == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+	return UINT32_ALIGN(faceCount * 3 * indexSize, sizeof(uint32_t));
+}
+
+void GeometryLayout::getVertexRangeSizes(uint32_t vertexCount, bool compactVertices, VkDeviceSize sizes[GEOMETRY_VERTEX_RANGE_COUNT])
+{
+	//Compact vertices store normals and texture coordinates in a single word (see "Note on vertex conversion")
+	VkDeviceSize texCoordSize = compactVertices ? sizeof(uint32_t) : sizeof(glm::vec2);
+	VkDeviceSize normalSize = compactVertices ? sizeof(uint32_t) : sizeof(glm::vec3);
+
+	sizes[0] = vertexCount * sizeof(glm::vec3);
+	sizes[1] = vertexCount * texCoordSize;
+	sizes[2] = vertexCount * normalSize;
+}
+
+VkDeviceSize GeometryLayout::layoutRanges(const VkDeviceSize* sizes, uint32_t count, VkDeviceSize rangeAlignment, VkDeviceSize* offsets)
+{
+	VkDeviceSize end = 0;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		offsets[i] = UINT32_ALIGN(end, rangeAlignment);
+		end = offsets[i] + sizes[i];
+	}
+
+	return end;
+}
+
+VkDeviceSize GeometryLayout::getVertexDataSize(uint32_t vertexCount, bool compactVertices, VkDeviceSize rangeAlignment)
+{
+	VkDeviceSize sizes[GEOMETRY_VERTEX_RANGE_COUNT];
+	VkDeviceSize offsets[GEOMETRY_VERTEX_RANGE_COUNT];
+
+	getVertexRangeSizes(vertexCount, compactVertices, sizes);
+
+	return layoutRanges(sizes, GEOMETRY_VERTEX_RANGE_COUNT, rangeAlignment, offsets);
+}
+
+VkDeviceSize GeometryLayout::getIndexRangeSize(uint32_t vertexCount, uint32_t faceCount, VkDeviceSize rangeAlignment)
+{
+	VkDeviceSize size = getIndexDataSize(vertexCount, faceCount);
+	VkDeviceSize offset;
+
+	return layoutRanges(&size, 1, rangeAlignment, &offset);
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <volk.h>
+
+#include <cstdint>
+
+/*
+ ------------------------------
+	Note on geometry layout
+ ------------------------------
+
+ The vertex data of a mesh is stored as three ranges (positions, texture coordinates and normals) and its index data
+ as a single range. The ranges are placed one after the other, each aligned to the range alignment of the scene.
+
+ The loader lays out the geometry buffers with these functions, and the scene cache uses the same functions to check
+ that the cooked ranges of every mesh have exactly the size that the loader will copy them into.
+*/
+
+#define GEOMETRY_VERTEX_RANGE_COUNT 3
+
+class GeometryLayout
+{
+public:
+	//Meshes whose indices all fit into 16 bits get a 16-bit index buffer
+	static VkIndexType getIndexType(uint32_t vertexCount);
+
+	//The size of a mesh's index data. 16-bit indices are padded to a whole number of words,
+	//since the shaders read them as pairs packed into 32-bit values.
+	static VkDeviceSize getIndexDataSize(uint32_t vertexCount, uint32_t faceCount);
+
+	//The sizes of the position, texture coordinate and normal ranges of a mesh
+	static void getVertexRangeSizes(uint32_t vertexCount, bool compactVertices, VkDeviceSize sizes[GEOMETRY_VERTEX_RANGE_COUNT]);
+
+	//Places `count` ranges one after the other, each aligned to `rangeAlignment`, and
+	//writes their offsets to `offsets`. Returns the total size of the ranges.
+	static VkDeviceSize layoutRanges(const VkDeviceSize* sizes, uint32_t count, VkDeviceSize rangeAlignment, VkDeviceSize* offsets);
+
+	//The total size of the vertex and index ranges of a mesh
+	static VkDeviceSize getVertexDataSize(uint32_t vertexCount, bool compactVertices, VkDeviceSize rangeAlignment);
+	static VkDeviceSize getIndexRangeSize(uint32_t vertexCount, uint32_t faceCount, VkDeviceSize rangeAlignment);
+};
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include "MeshOptimizer.h"
+
+#include "utils/Hash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#define EMPTY_SLOT 0xFFFFFFFFu
+
+uint32_t MeshOptimizer::optimize(const std::vector<VertexStream>& streams, uint32_t vertexCount, uint32_t* indices, uint32_t faceCount)
+{
+	size_t indexCount = (size_t)faceCount * 3;
+
+	weldVertices(streams, vertexCount, indices, indexCount);
+	sortTriangles(streams[0].data, indices, faceCount);
+
+	return reorderVertices(streams, vertexCount, indices, indexCount);
+}
+
+uint32_t MeshOptimizer::weldVertices(const std::vector<VertexStream>& streams, uint32_t vertexCount, uint32_t* indices, size_t indexCount)
+{
+	auto hashVertex = [&](uint32_t vertex)
+	{
+		uint64_t hash = 0;
+
+		for (const VertexStream& stream : streams)
+		{
+			hash = Hash::bytes(stream.data + (size_t)vertex * stream.componentCount, stream.componentCount * sizeof(float), hash);
+		}
+
+		return hash;
+	};
+
+	auto areEqual = [&](uint32_t a, uint32_t b)
+	{
+		for (const VertexStream& stream : streams)
+		{
+			if (memcmp(stream.data + (size_t)a * stream.componentCount, stream.data + (size_t)b * stream.componentCount, stream.componentCount * sizeof(float)) != 0)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	};
+
+	//Open addressing table with a load factor of at most 0.5
+	size_t tableSize = 1;
+	while (tableSize < (size_t)vertexCount * 2)
+	{
+		tableSize <<= 1;
+	}
+
+	std::vector<uint32_t> table(tableSize, EMPTY_SLOT);
+	std::vector<uint32_t> remap(vertexCount);
+
+	uint32_t uniqueCount = 0;
+
+	for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+	{
+		size_t slot = hashVertex(vertex) & (tableSize - 1);
+
+		while (table[slot] != EMPTY_SLOT && !areEqual(table[slot], vertex))
+		{
+			slot = (slot + 1) & (tableSize - 1);
+		}
+
+		if (table[slot] == EMPTY_SLOT)
+		{
+			table[slot] = vertex;
+			uniqueCount++;
+		}
+
+		remap[vertex] = table[slot];
+	}
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		indices[i] = remap[indices[i]];
+	}
+
+	return uniqueCount;
+}
+
+void MeshOptimizer::sortTriangles(const float* positions, uint32_t* indices, uint32_t faceCount)
+{
+	if (faceCount < 2)
+	{
+		return;
+	}
+
+	//Compute the centroids (scaled by 3) and their bounds
+	std::vector<float> centroids((size_t)faceCount * 3);
+
+	float minBounds[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+	float maxBounds[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+
+	for (uint32_t face = 0; face < faceCount; ++face)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float centroid = positions[3 * (size_t)indices[3 * (size_t)face] + axis] +
+							 positions[3 * (size_t)indices[3 * (size_t)face + 1] + axis] +
+							 positions[3 * (size_t)indices[3 * (size_t)face + 2] + axis];
+
+			centroids[3 * (size_t)face + axis] = centroid;
+
+			minBounds[axis] = std::min(minBounds[axis], centroid);
+			maxBounds[axis] = std::max(maxBounds[axis], centroid);
+		}
+	}
+
+	//Quantize the centroids to a 1024^3 grid that covers the bounds
+	float scale[3];
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		float extent = maxBounds[axis] - minBounds[axis];
+
+		scale[axis] = extent > 0.0f ? 1023.0f / extent : 0.0f;
+	}
+
+	std::vector<std::pair<uint32_t, uint32_t>> keys(faceCount);
+
+	for (uint32_t face = 0; face < faceCount; ++face)
+	{
+		uint32_t cell[3];
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float position = (centroids[3 * (size_t)face + axis] - minBounds[axis]) * scale[axis];
+
+			cell[axis] = (uint32_t)std::min(std::max(position + 0.5f, 0.0f), 1023.0f);
+		}
+
+		keys[face] = { getMortonCode(cell[0], cell[1], cell[2]), face };
+	}
+
+	//Ties are broken by the original order, so the result is deterministic
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<uint32_t> sortedIndices((size_t)faceCount * 3);
+
+	for (uint32_t i = 0; i < faceCount; ++i)
+	{
+		memcpy(&sortedIndices[3 * (size_t)i], &indices[3 * (size_t)keys[i].second], 3 * sizeof(uint32_t));
+	}
+
+	memcpy(indices, sortedIndices.data(), sortedIndices.size() * sizeof(uint32_t));
+}
+
+uint32_t MeshOptimizer::reorderVertices(const std::vector<VertexStream>& streams, uint32_t vertexCount, uint32_t* indices, size_t indexCount)
+{
+	std::vector<uint32_t> oldToNew(vertexCount, EMPTY_SLOT);
+	std::vector<uint32_t> newToOld;
+	newToOld.reserve(vertexCount);
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		uint32_t& newIndex = oldToNew[indices[i]];
+
+		if (newIndex == EMPTY_SLOT)
+		{
+			newIndex = (uint32_t)newToOld.size();
+			newToOld.push_back(indices[i]);
+		}
+
+		indices[i] = newIndex;
+	}
+
+	uint32_t newVertexCount = (uint32_t)newToOld.size();
+
+	//Move the vertex data (the new vertices are a permutation of a subset of the old ones)
+	std::vector<float> reordered;
+
+	for (const VertexStream& stream : streams)
+	{
+		reordered.resize((size_t)newVertexCount * stream.componentCount);
+
+		for (uint32_t vertex = 0; vertex < newVertexCount; ++vertex)
+		{
+			memcpy(&reordered[(size_t)vertex * stream.componentCount], stream.data + (size_t)newToOld[vertex] * stream.componentCount, stream.componentCount * sizeof(float));
+		}
+
+		memcpy(stream.data, reordered.data(), reordered.size() * sizeof(float));
+	}
+
+	return newVertexCount;
+}
+
+uint32_t MeshOptimizer::getMortonCode(uint32_t x, uint32_t y, uint32_t z)
+{
+	auto expandBits = [](uint32_t value)
+	{
+		value &= 0x3FF;
+		value = (value | (value << 16)) & 0x030000FF;
+		value = (value | (value << 8)) & 0x0300F00F;
+		value = (value | (value << 4)) & 0x030C30C3;
+		value = (value | (value << 2)) & 0x09249249;
+
+		return value;
+	};
+
+	return (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ ------------------------------
+	Note on mesh optimization
+ ------------------------------
+
+ Meshes are uploaded in the order the importer produced them, which usually follows the order in which
+ they were modelled rather than where the triangles are. Before upload, the optimizer can:
+	1. Weld vertices whose attributes are bitwise identical
+	2. Sort the triangles along a Morton curve through their centroids
+	3. Renumber the vertices in the order they are first referenced by the sorted triangles
+
+ Triangles that are close in space end up close in the index buffer, so the BLAS builder gets leaves
+ with tighter bounds and the vertex fetches of neighbouring hits land in the same cache lines. Vertices
+ that aren't referenced by any triangle are dropped by the last step.
+
+ The optimizer works on arrays of floats (one `VertexStream` per attribute) and rewrites them in place,
+ so it doesn't depend on the importer's types.
+*/
+
+struct VertexStream
+{
+	float* data;
+	uint32_t componentCount;
+};
+
+class MeshOptimizer
+{
+public:
+	//Runs all the steps on a triangle list. `streams[0]` must hold the positions (3 components).
+	//The streams and the indices are rewritten in place and the new vertex count is returned.
+	static uint32_t optimize(const std::vector<VertexStream>& streams, uint32_t vertexCount, uint32_t* indices, uint32_t faceCount);
+
+	//Points the indices of duplicate vertices to the first one of them. Returns the number of unique vertices.
+	static uint32_t weldVertices(const std::vector<VertexStream>& streams, uint32_t vertexCount, uint32_t* indices, size_t indexCount);
+
+	static void sortTriangles(const float* positions, uint32_t* indices, uint32_t faceCount);
+
+	//Renumbers the vertices in the order of first use and moves their data accordingly. Returns the new vertex count.
+	static uint32_t reorderVertices(const std::vector<VertexStream>& streams, uint32_t vertexCount, uint32_t* indices, size_t indexCount);
+
+	//Interleaves the lower 10 bits of each coordinate
+	static uint32_t getMortonCode(uint32_t x, uint32_t y, uint32_t z);
+};
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "MipGenerator.h"
+
+#include "utils/ThreadPool.h"
+
+#include <algorithm>
+
+//Number of rows filtered by a single task
+#define MIP_ROWS_PER_TASK 64
+
+uint32_t MipGenerator::getMipLevelCount(uint32_t width, uint32_t height)
+{
+	uint32_t levelCount = 1;
+
+	for (uint32_t size = std::max(width, height); size > 1; size >>= 1)
+	{
+		levelCount++;
+	}
+
+	return levelCount;
+}
+
+uint32_t MipGenerator::getMipSize(uint32_t size, uint32_t level)
+{
+	return std::max(size >> level, 1u);
+}
+
+size_t MipGenerator::getMipOffset(uint32_t width, uint32_t height, uint32_t level)
+{
+	return getMipChainSize(width, height, level);
+}
+
+size_t MipGenerator::getMipChainSize(uint32_t width, uint32_t height, uint32_t levelCount)
+{
+	size_t size = 0;
+
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		size += 4 * (size_t)getMipSize(width, level) * getMipSize(height, level);
+	}
+
+	return size;
+}
+
+void MipGenerator::generateMipChain(uint8_t* chain, uint32_t width, uint32_t height, uint32_t levelCount)
+{
+	for (uint32_t level = 1; level < levelCount; ++level)
+	{
+		uint32_t srcWidth = getMipSize(width, level - 1);
+		uint32_t srcHeight = getMipSize(height, level - 1);
+
+		uint32_t dstWidth = getMipSize(width, level);
+		uint32_t dstHeight = getMipSize(height, level);
+
+		const uint8_t* src = chain + getMipOffset(width, height, level - 1);
+		uint8_t* dst = chain + getMipOffset(width, height, level);
+
+		size_t taskCount = (dstHeight + MIP_ROWS_PER_TASK - 1) / MIP_ROWS_PER_TASK;
+
+		ThreadPool::global().parallelFor(taskCount, [&](size_t task)
+		{
+			uint32_t firstRow = (uint32_t)task * MIP_ROWS_PER_TASK;
+			uint32_t lastRow = std::min(firstRow + MIP_ROWS_PER_TASK, dstHeight);
+
+			for (uint32_t y = firstRow; y < lastRow; ++y)
+			{
+				const uint8_t* srcRow0 = src + 4 * (size_t)srcWidth * std::min(2 * y, srcHeight - 1);
+				const uint8_t* srcRow1 = src + 4 * (size_t)srcWidth * std::min(2 * y + 1, srcHeight - 1);
+
+				uint8_t* dstRow = dst + 4 * (size_t)dstWidth * y;
+
+				for (uint32_t x = 0; x < dstWidth; ++x)
+				{
+					uint32_t x0 = 4 * std::min(2 * x, srcWidth - 1);
+					uint32_t x1 = 4 * std::min(2 * x + 1, srcWidth - 1);
+
+					for (uint32_t c = 0; c < 4; ++c)
+					{
+						uint32_t sum = srcRow0[x0 + c] + srcRow0[x1 + c] + srcRow1[x0 + c] + srcRow1[x1 + c];
+
+						dstRow[4 * x + c] = (uint8_t)((sum + 2) / 4);
+					}
+				}
+			}
+		});
+	}
+}
\ No newline at end of file
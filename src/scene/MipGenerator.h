@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ ------------------------------
+	Note on mipmap generation
+ ------------------------------
+
+ Mip chains are generated on the CPU while the texture is being decoded, so that cooked scenes
+ can store them and the upload path doesn't need any extra GPU work (or format blit support).
+ Every level is computed from the previous one with a 2x2 box filter. Levels with odd sizes clamp
+ the filter footprint to the edge of the previous level.
+
+ The levels of a chain are stored tightly packed one after the other, starting from level 0.
+ Only RGBA8 textures are supported.
+*/
+
+class MipGenerator
+{
+public:
+	//The number of levels in a full mip chain (down to 1x1)
+	static uint32_t getMipLevelCount(uint32_t width, uint32_t height);
+
+	//The width (or height) of a level and the offset of a level within the chain
+	static uint32_t getMipSize(uint32_t size, uint32_t level);
+	static size_t getMipOffset(uint32_t width, uint32_t height, uint32_t level);
+
+	static size_t getMipChainSize(uint32_t width, uint32_t height, uint32_t levelCount);
+
+	//Generates levels [1, levelCount) of `chain` from level 0, which must already be in place.
+	//The rows of large levels are filtered in parallel on the global thread pool.
+	static void generateMipChain(uint8_t* chain, uint32_t width, uint32_t height, uint32_t levelCount);
+};
\ No newline at end of file
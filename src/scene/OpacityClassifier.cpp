@@ -0,0 +1,269 @@
+#include "OpacityClassifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define ALPHA_COVERAGE_MIXED (ALPHA_COVERAGE_OPAQUE | ALPHA_COVERAGE_TRANSPARENT)
+
+//Conservative triangle-box overlap test (degenerate triangles are only tested against their bounds)
+static bool overlapsBox(const glm::vec2 triangle[3], glm::vec2 boxMin, glm::vec2 boxMax)
+{
+	glm::vec2 triangleMin = glm::min(glm::min(triangle[0], triangle[1]), triangle[2]);
+	glm::vec2 triangleMax = glm::max(glm::max(triangle[0], triangle[1]), triangle[2]);
+
+	if (triangleMax.x < boxMin.x || triangleMax.y < boxMin.y || triangleMin.x > boxMax.x || triangleMin.y > boxMax.y)
+	{
+		return false;
+	}
+
+	glm::vec2 e0 = triangle[1] - triangle[0];
+	glm::vec2 e1 = triangle[2] - triangle[0];
+
+	float area = e0.x * e1.y - e0.y * e1.x;
+
+	if (std::abs(area) <= 1e-12f)
+	{
+		return true;
+	}
+
+	float orientation = area > 0.0f ? 1.0f : -1.0f;
+
+	//The box is outside if the corner that is furthest inside an edge is still outside of it
+	for (int i = 0; i < 3; ++i)
+	{
+		glm::vec2 a = triangle[i];
+		glm::vec2 edge = (triangle[(i + 1) % 3] - a) * orientation;
+
+		glm::vec2 corner(edge.y < 0.0f ? boxMax.x : boxMin.x, edge.x > 0.0f ? boxMax.y : boxMin.y);
+
+		if (edge.x * (corner.y - a.y) - edge.y * (corner.x - a.x) < 0.0f)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//Moves a texel space coordinate into a repetition of the texture (odd repetitions of a mirrored texture are flipped)
+static float mapToTile(float coordinate, float tile, float size, TextureWrap wrap)
+{
+	float tileCoordinate = coordinate - tile * size;
+
+	if (wrap == TextureWrap::MirroredRepeat && std::fmod(std::abs(tile), 2.0f) == 1.0f)
+	{
+		return size - tileCoordinate;
+	}
+
+	return tileCoordinate;
+}
+
+AlphaMask::AlphaMask(const uint8_t* pixels, uint32_t width, uint32_t height) :
+	m_width(width), m_height(height)
+{
+	while ((std::max(width, height) + m_blockSize - 1) / m_blockSize > ALPHA_MASK_MAX_SIZE)
+	{
+		m_blockSize *= 2;
+	}
+
+	glm::uvec2 size((width + m_blockSize - 1) / m_blockSize, (height + m_blockSize - 1) / m_blockSize);
+
+	std::vector<uint8_t> cells((size_t)size.x * size.y, 0);
+
+	for (uint32_t y = 0; y < height; ++y)
+	{
+		const uint8_t* row = pixels + 4 * (size_t)y * width;
+		uint8_t* cellRow = cells.data() + (size_t)(y / m_blockSize) * size.x;
+
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			uint32_t alpha = row[4 * x + 3];
+
+			uint8_t coverage = alpha + ALPHA_MASK_MARGIN >= ALPHA_MASK_CUTOFF ? ALPHA_COVERAGE_OPAQUE : 0;
+			coverage |= alpha < ALPHA_MASK_CUTOFF + ALPHA_MASK_MARGIN ? ALPHA_COVERAGE_TRANSPARENT : 0;
+
+			cellRow[x / m_blockSize] |= coverage;
+		}
+	}
+
+	m_levels.push_back(std::move(cells));
+	m_levelSizes.push_back(size);
+
+	//Every cell of a coarser level combines the (up to) four cells below it
+	while (size.x > 1 || size.y > 1)
+	{
+		glm::uvec2 parentSize((size.x + 1) / 2, (size.y + 1) / 2);
+
+		std::vector<uint8_t> parentCells((size_t)parentSize.x * parentSize.y, 0);
+		const std::vector<uint8_t>& childCells = m_levels.back();
+
+		for (uint32_t y = 0; y < size.y; ++y)
+		{
+			for (uint32_t x = 0; x < size.x; ++x)
+			{
+				parentCells[(size_t)(y / 2) * parentSize.x + x / 2] |= childCells[(size_t)y * size.x + x];
+			}
+		}
+
+		m_levels.push_back(std::move(parentCells));
+		m_levelSizes.push_back(parentSize);
+
+		size = parentSize;
+	}
+}
+
+uint8_t AlphaMask::getCoverage(uint32_t level, uint32_t x, uint32_t y, const glm::vec2 triangle[3]) const
+{
+	//The texels covered by the cell (in texel space)
+	uint32_t cellSize = m_blockSize << level;
+
+	glm::vec2 cellMin((float)(x * cellSize), (float)(y * cellSize));
+	glm::vec2 cellMax((float)std::min((x + 1) * cellSize, m_width), (float)std::min((y + 1) * cellSize, m_height));
+
+	//Bilinear filtering also reads the neighbours of the texels under the footprint
+	if (!overlapsBox(triangle, cellMin - 1.0f, cellMax + 1.0f))
+	{
+		return 0;
+	}
+
+	const glm::uvec2& size = m_levelSizes[level];
+	uint8_t coverage = m_levels[level][(size_t)y * size.x + x];
+
+	if (level == 0 || coverage != ALPHA_COVERAGE_MIXED)
+	{
+		return coverage;
+	}
+
+	//The cell has both kinds of texels, so check which of its children the triangle touches
+	const glm::uvec2& childSize = m_levelSizes[level - 1];
+
+	coverage = 0;
+
+	for (uint32_t childY = 2 * y; childY < std::min(2 * y + 2, childSize.y); ++childY)
+	{
+		for (uint32_t childX = 2 * x; childX < std::min(2 * x + 2, childSize.x); ++childX)
+		{
+			coverage |= getCoverage(level - 1, childX, childY, triangle);
+
+			if (coverage == ALPHA_COVERAGE_MIXED)
+			{
+				return coverage;
+			}
+		}
+	}
+
+	return coverage;
+}
+
+uint8_t AlphaMask::getTriangleCoverage(glm::vec2 t0, glm::vec2 t1, glm::vec2 t2, TextureWrap wrapU, TextureWrap wrapV) const
+{
+	glm::vec2 textureSize((float)m_width, (float)m_height);
+	glm::vec2 triangle[3] = { t0 * textureSize, t1 * textureSize, t2 * textureSize };
+
+	glm::vec2 triangleMin = glm::min(glm::min(triangle[0], triangle[1]), triangle[2]);
+	glm::vec2 triangleMax = glm::max(glm::max(triangle[0], triangle[1]), triangle[2]);
+
+	if (!std::isfinite(triangleMin.x) || !std::isfinite(triangleMin.y) || !std::isfinite(triangleMax.x) || !std::isfinite(triangleMax.y))
+	{
+		return getTextureCoverage();
+	}
+
+	//The repetitions of the texture that the footprint touches
+	glm::vec2 firstTile = glm::floor((triangleMin - 1.0f) / textureSize);
+	glm::vec2 lastTile = glm::floor((triangleMax + 1.0f) / textureSize);
+
+	uint8_t coverage = 0;
+
+	//Clamping wrap modes don't repeat the texture, the parts of the footprint outside of it sample the edge or the border
+	TextureWrap wrapModes[2] = { wrapU, wrapV };
+
+	for (int axis = 0; axis < 2; ++axis)
+	{
+		if (wrapModes[axis] != TextureWrap::ClampToEdge && wrapModes[axis] != TextureWrap::ClampToBorder)
+		{
+			continue;
+		}
+
+		//Filtering near the edge of a texture with a border blends in the border, but clamping to the edge doesn't
+		if (wrapModes[axis] == TextureWrap::ClampToBorder && (firstTile[axis] < 0.0f || lastTile[axis] > 0.0f))
+		{
+			coverage |= ALPHA_COVERAGE_TRANSPARENT;
+		}
+		else if (wrapModes[axis] == TextureWrap::ClampToEdge && (triangleMin[axis] < 0.0f || triangleMax[axis] > textureSize[axis]))
+		{
+			coverage |= getTextureCoverage();
+		}
+
+		firstTile[axis] = std::max(firstTile[axis], 0.0f);
+		lastTile[axis] = std::min(lastTile[axis], 0.0f);
+	}
+
+	glm::vec2 tileCount = glm::max(lastTile - firstTile + 1.0f, glm::vec2(0.0f));
+
+	if (coverage == ALPHA_COVERAGE_MIXED || tileCount.x * tileCount.y > ALPHA_MASK_MAX_TILE_COUNT)
+	{
+		return coverage | getTextureCoverage();
+	}
+
+	uint32_t rootLevel = (uint32_t)m_levels.size() - 1;
+
+	for (float tileY = firstTile.y; tileY <= lastTile.y; ++tileY)
+	{
+		for (float tileX = firstTile.x; tileX <= lastTile.x; ++tileX)
+		{
+			glm::vec2 tileTriangle[3];
+
+			for (int i = 0; i < 3; ++i)
+			{
+				tileTriangle[i].x = mapToTile(triangle[i].x, tileX, textureSize.x, wrapU);
+				tileTriangle[i].y = mapToTile(triangle[i].y, tileY, textureSize.y, wrapV);
+			}
+
+			coverage |= getCoverage(rootLevel, 0, 0, tileTriangle);
+
+			if (coverage == ALPHA_COVERAGE_MIXED)
+			{
+				return coverage;
+			}
+		}
+	}
+
+	return coverage;
+}
+
+TriangleOpacity OpacityClassifier::sortTriangles(const AlphaMask& mask, TextureWrap wrapU, TextureWrap wrapV, const glm::vec2* texCoords, uint32_t* indices, uint32_t faceCount)
+{
+	//0 = opaque, 1 = mixed, 2 = transparent
+	std::vector<uint8_t> classes(faceCount);
+	uint32_t classCounts[3] = {};
+
+	for (uint32_t i = 0; i < faceCount; ++i)
+	{
+		const uint32_t* triangle = indices + 3 * (size_t)i;
+
+		uint8_t coverage = mask.getTriangleCoverage(texCoords[triangle[0]], texCoords[triangle[1]], texCoords[triangle[2]], wrapU, wrapV);
+
+		classes[i] = coverage == ALPHA_COVERAGE_OPAQUE ? 0 : (coverage == ALPHA_COVERAGE_TRANSPARENT ? 2 : 1);
+		classCounts[classes[i]]++;
+	}
+
+	//Counting sort, which keeps the order of the triangles within each class
+	uint32_t classOffsets[3] = { 0, classCounts[0], classCounts[0] + classCounts[1] };
+
+	std::vector<uint32_t> sortedIndices(3 * (size_t)faceCount);
+
+	for (uint32_t i = 0; i < faceCount; ++i)
+	{
+		memcpy(&sortedIndices[3 * (size_t)classOffsets[classes[i]]++], indices + 3 * (size_t)i, 3 * sizeof(uint32_t));
+	}
+
+	memcpy(indices, sortedIndices.data(), sortedIndices.size() * sizeof(uint32_t));
+
+	TriangleOpacity opacity;
+	opacity.isClassified = true;
+	opacity.opaqueFaceCount = classCounts[0];
+	opacity.mixedFaceCount = classCounts[1];
+
+	return opacity;
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ ------------------------------
+	Note on triangle opacity
+ ------------------------------
+
+ The any-hit shaders discard hits where the albedo alpha is below 0.5. Marking a whole mesh as non-opaque
+ because some of its texels have alpha makes every one of its triangles pay for an any-hit invocation, even
+ though most triangles of a typical foliage mesh only cover texels that are either fully opaque or fully cut out.
+
+ Before upload, the triangles of every mesh whose material has alpha are classified by rasterizing their UV
+ footprint against an `AlphaMask` of the albedo texture:
+	- Opaque triangles only cover texels that are never discarded
+	- Transparent triangles only cover texels that are always discarded
+	- Mixed triangles cover both (or texels close to the cutoff)
+
+ The triangles are then sorted into opaque, mixed and transparent ones in the index buffer. The BLAS gets one
+ geometry with VK_GEOMETRY_OPAQUE_BIT_KHR for the opaque range and one without it for the mixed range, and the
+ transparent triangles are left out entirely. Each geometry has its own geometry record, which tells the shaders
+ the first triangle of its range.
+
+ The any-hit shaders sample the base level with bilinear filtering, so the footprint of a triangle is grown by a texel
+ and mapped onto the texture with the wrap modes of the material: repeated and mirrored footprints are tested against
+ every repetition of the texture they touch, while the parts of a footprint that are clamped to the edge count as the
+ whole texture and the parts outside of a texture with a transparent border as transparent. The mask stores, for every
+ block of texels, whether it contains opaque or transparent texels, and coarser levels combine the blocks below them,
+ so that large triangles can be classified without visiting every texel. Classification is conservative: when in
+ doubt, a triangle is mixed.
+
+ Block compression can move the alpha of a texel far across the cutoff (BC7 mode 6 shares its endpoints between the
+ color and alpha channels), so the mask of a compressed texture is built from its decompressed base level rather
+ than from the source image. This also applies to textures that are read from the compressed texture cache.
+*/
+
+//Texels with alpha at or above the cutoff pass the alpha test of the any-hit shaders (0.5)
+#define ALPHA_MASK_CUTOFF 128
+
+//Texels within this distance of the cutoff count as both opaque and transparent, which covers the
+//rounding of the filtering hardware (block compression isn't covered, so masks of compressed
+//textures are built from the decompressed texels)
+#define ALPHA_MASK_MARGIN 8
+
+//Maximum size of the finest level of a mask (larger textures are covered by blocks of texels)
+#define ALPHA_MASK_MAX_SIZE 1024
+
+//Maximum number of texture repetitions a triangle's footprint is tested against before it's
+//compared to the whole texture
+#define ALPHA_MASK_MAX_TILE_COUNT 16
+
+#define ALPHA_COVERAGE_OPAQUE 1
+#define ALPHA_COVERAGE_TRANSPARENT 2
+
+//How texture coordinates outside of [0, 1] are mapped onto a texture (along one axis)
+enum class TextureWrap : uint32_t
+{
+	Repeat,
+	MirroredRepeat,
+	ClampToEdge,
+
+	//Texels outside of the texture are transparent black (Assimp's decal mode)
+	ClampToBorder
+};
+
+class AlphaMask
+{
+private:
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+
+	//The number of texels (along each axis) covered by a cell of the finest level
+	uint32_t m_blockSize = 1;
+
+	//ALPHA_COVERAGE_* bits of every cell, from the finest level to a single cell
+	std::vector<std::vector<uint8_t>> m_levels;
+	std::vector<glm::uvec2> m_levelSizes;
+private:
+	uint8_t getCoverage(uint32_t level, uint32_t x, uint32_t y, const glm::vec2 triangle[3]) const;
+public:
+	//Builds the mask from the base level of an RGBA8 texture
+	AlphaMask(const uint8_t* pixels, uint32_t width, uint32_t height);
+
+	//The ALPHA_COVERAGE_* bits of all the texels a triangle with these texture coordinates can sample
+	uint8_t getTriangleCoverage(glm::vec2 t0, glm::vec2 t1, glm::vec2 t2, TextureWrap wrapU, TextureWrap wrapV) const;
+
+	inline uint8_t getTextureCoverage() const { return m_levels.back()[0]; }
+};
+
+//How the triangles of a mesh are split (they are sorted into opaque, mixed and transparent ones)
+struct TriangleOpacity
+{
+	//False if the triangles weren't classified, in which case the opacity of the material applies to all of them
+	bool isClassified = false;
+
+	uint32_t opaqueFaceCount = 0;
+	uint32_t mixedFaceCount = 0;
+};
+
+class OpacityClassifier
+{
+public:
+	//Classifies the triangles of a mesh and sorts `indices` accordingly (the order within each class is kept)
+	static TriangleOpacity sortTriangles(const AlphaMask& mask, TextureWrap wrapU, TextureWrap wrapV, const glm::vec2* texCoords, uint32_t* indices, uint32_t faceCount);
+};
\ No newline at end of file
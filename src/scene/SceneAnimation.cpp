@@ -0,0 +1,701 @@
+#include "SceneAnimation.h"
+
+#include <Common.h>
+
+#include <assimp/scene.h>
+
+#include <glm/gtx/transform.hpp>
+
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <cmath>
+#include <cstring>
+
+//Must match `DeformParameters` in `deform.comp`
+struct DeformParameters
+{
+	VkDeviceAddress outputPositions;
+	VkDeviceAddress restPositions;
+	VkDeviceAddress morphOffsets;
+	VkDeviceAddress boneIndices;
+	VkDeviceAddress boneWeights;
+	VkDeviceAddress boneMatrices;
+	VkDeviceAddress morphWeights;
+
+	uint32_t vertexCount;
+	uint32_t boneCount;
+	uint32_t morphTargetCount;
+};
+
+/**************************************/
+/*          Animation import          */
+/**************************************/
+
+//The same layout as the matrices built by `flattenSceneGraph` (the transpose of the regular matrix)
+static glm::mat4 toSceneMatrix(const aiMatrix4x4& m)
+{
+	return {
+		{ m.a1, m.a2, m.a3, m.a4 },
+		{ m.b1, m.b2, m.b3, m.b4 },
+		{ m.c1, m.c2, m.c3, m.c4 },
+		{ m.d1, m.d2, m.d3, m.d4 }
+	};
+}
+
+static void addNodes(const aiNode* node, uint32_t parent, const std::unordered_map<std::string, uint32_t>& channelIndices, std::vector<const aiNode*>& nodePointers, std::vector<AnimatedNode>& nodes)
+{
+	auto it = channelIndices.find(node->mName.C_Str());
+
+	uint32_t channel = it != channelIndices.end() ? it->second : (uint32_t)-1;
+	bool isAnimated = channel != (uint32_t)-1 || (parent != (uint32_t)-1 && nodes[parent].isAnimated);
+
+	uint32_t index = (uint32_t)nodes.size();
+
+	nodes.push_back({ parent, toSceneMatrix(node->mTransformation), channel, isAnimated });
+	nodePointers.push_back(node);
+
+	for (unsigned int i = 0; i < node->mNumChildren; ++i)
+	{
+		addNodes(node->mChildren[i], index, channelIndices, nodePointers, nodes);
+	}
+}
+
+static void importBones(const aiMesh* mesh, const std::unordered_map<std::string, uint32_t>& nodeIndices, DeformableMesh& deformable)
+{
+	std::vector<std::vector<std::pair<float, uint32_t>>> influences(mesh->mNumVertices);
+
+	for (unsigned int i = 0; i < mesh->mNumBones; ++i)
+	{
+		const aiBone* bone = mesh->mBones[i];
+
+		auto it = nodeIndices.find(bone->mName.C_Str());
+
+		deformable.boneNodes.push_back(it != nodeIndices.end() ? it->second : (uint32_t)-1);
+		deformable.boneOffsets.push_back(glm::transpose(toSceneMatrix(bone->mOffsetMatrix)));
+
+		for (unsigned int j = 0; j < bone->mNumWeights; ++j)
+		{
+			const aiVertexWeight& weight = bone->mWeights[j];
+
+			if (weight.mVertexId < mesh->mNumVertices && weight.mWeight > 0.0f)
+			{
+				influences[weight.mVertexId].push_back(std::make_pair(weight.mWeight, i));
+			}
+		}
+	}
+
+	deformable.boneIndices.resize(mesh->mNumVertices, glm::uvec4(0));
+	deformable.boneWeights.resize(mesh->mNumVertices, glm::vec4(0.0f));
+
+	for (unsigned int vertex = 0; vertex < mesh->mNumVertices; ++vertex)
+	{
+		std::vector<std::pair<float, uint32_t>>& vertexInfluences = influences[vertex];
+
+		//Keep the strongest influences and renormalize their weights
+		std::sort(vertexInfluences.begin(), vertexInfluences.end(), std::greater<std::pair<float, uint32_t>>());
+
+		size_t count = std::min<size_t>(vertexInfluences.size(), ANIMATION_MAX_VERTEX_BONES);
+
+		float totalWeight = 0.0f;
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			totalWeight += vertexInfluences[i].first;
+		}
+
+		//Vertices without influences keep zero weights, which the deform shader leaves unskinned
+		if (totalWeight <= 0.0f)
+		{
+			continue;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			deformable.boneIndices[vertex][(int)i] = vertexInfluences[i].second;
+			deformable.boneWeights[vertex][(int)i] = vertexInfluences[i].first / totalWeight;
+		}
+	}
+}
+
+static void importMorphTargets(const aiMesh* mesh, const aiAnimation* animation, const std::string& nodeName, double ticksPerSecond, DeformableMesh& deformable)
+{
+	deformable.morphTargetCount = mesh->mNumAnimMeshes;
+	deformable.morphOffsets.resize((size_t)mesh->mNumAnimMeshes * mesh->mNumVertices, glm::vec3(0.0f));
+
+	for (unsigned int target = 0; target < mesh->mNumAnimMeshes; ++target)
+	{
+		const aiAnimMesh* animMesh = mesh->mAnimMeshes[target];
+
+		deformable.morphWeights.push_back(animMesh->mWeight);
+
+		//Morph targets without positions only change attributes that aren't deformed
+		if (!animMesh->HasPositions() || animMesh->mNumVertices != mesh->mNumVertices)
+		{
+			continue;
+		}
+
+		for (unsigned int vertex = 0; vertex < mesh->mNumVertices; ++vertex)
+		{
+			const aiVector3D offset = animMesh->mVertices[vertex] - mesh->mVertices[vertex];
+
+			deformable.morphOffsets[(size_t)target * mesh->mNumVertices + vertex] = glm::vec3(offset.x, offset.y, offset.z);
+		}
+	}
+
+	//Morph channels are named after the node that holds the mesh (some importers append "*<mesh index>")
+	for (unsigned int i = 0; i < animation->mNumMorphMeshChannels; ++i)
+	{
+		const aiMeshMorphAnim* channel = animation->mMorphMeshChannels[i];
+		std::string channelName = channel->mName.C_Str();
+
+		if (channelName != nodeName && channelName.rfind(nodeName + "*", 0) != 0)
+		{
+			continue;
+		}
+
+		for (unsigned int j = 0; j < channel->mNumKeys; ++j)
+		{
+			const aiMeshMorphKey& key = channel->mKeys[j];
+
+			std::vector<float> weights(mesh->mNumAnimMeshes, 0.0f);
+
+			for (unsigned int k = 0; k < key.mNumValuesAndWeights; ++k)
+			{
+				if (key.mValues[k] < mesh->mNumAnimMeshes)
+				{
+					weights[key.mValues[k]] = (float)key.mWeights[k];
+				}
+			}
+
+			deformable.morphKeys.push_back({ key.mTime / ticksPerSecond, std::move(weights) });
+		}
+
+		break;
+	}
+}
+
+std::shared_ptr<SceneAnimationData> SceneAnimationData::import(const aiScene* scene)
+{
+	if (!scene->HasAnimations())
+	{
+		return nullptr;
+	}
+
+	if (scene->mNumAnimations > 1)
+	{
+		std::cout << "Scene has " << scene->mNumAnimations << " animations, only the first one is played" << std::endl;
+	}
+
+	const aiAnimation* animation = scene->mAnimations[0];
+	double ticksPerSecond = animation->mTicksPerSecond > 0.0 ? animation->mTicksPerSecond : 25.0;
+
+	std::shared_ptr<SceneAnimationData> data = std::make_shared<SceneAnimationData>();
+	data->duration = animation->mDuration / ticksPerSecond;
+
+	//Copy the keyframes of the node channels
+	std::unordered_map<std::string, uint32_t> channelIndices;
+
+	for (unsigned int i = 0; i < animation->mNumChannels; ++i)
+	{
+		const aiNodeAnim* nodeAnim = animation->mChannels[i];
+
+		AnimationChannel channel;
+
+		for (unsigned int j = 0; j < nodeAnim->mNumPositionKeys; ++j)
+		{
+			const aiVectorKey& key = nodeAnim->mPositionKeys[j];
+			channel.positions.push_back({ key.mTime / ticksPerSecond, glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z) });
+		}
+
+		for (unsigned int j = 0; j < nodeAnim->mNumRotationKeys; ++j)
+		{
+			const aiQuatKey& key = nodeAnim->mRotationKeys[j];
+			channel.rotations.push_back({ key.mTime / ticksPerSecond, glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z) });
+		}
+
+		for (unsigned int j = 0; j < nodeAnim->mNumScalingKeys; ++j)
+		{
+			const aiVectorKey& key = nodeAnim->mScalingKeys[j];
+			channel.scalings.push_back({ key.mTime / ticksPerSecond, glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z) });
+		}
+
+		channelIndices.emplace(nodeAnim->mNodeName.C_Str(), (uint32_t)data->channels.size());
+		data->channels.push_back(std::move(channel));
+	}
+
+	//Flatten the node hierarchy (in the same order as `flattenSceneGraph`)
+	std::vector<const aiNode*> nodePointers;
+
+	addNodes(scene->mRootNode, (uint32_t)-1, channelIndices, nodePointers, data->nodes);
+
+	std::unordered_map<std::string, uint32_t> nodeIndices;
+	std::vector<uint32_t> meshNodes(scene->mNumMeshes, (uint32_t)-1);
+
+	for (uint32_t i = 0; i < (uint32_t)nodePointers.size(); ++i)
+	{
+		nodeIndices.emplace(nodePointers[i]->mName.C_Str(), i);
+
+		for (unsigned int j = 0; j < nodePointers[i]->mNumMeshes; ++j)
+		{
+			uint32_t& meshNode = meshNodes[nodePointers[i]->mMeshes[j]];
+			meshNode = meshNode == (uint32_t)-1 ? i : meshNode;
+		}
+	}
+
+	//Copy the bones and morph targets of the meshes that use them
+	data->meshDeformables.resize(scene->mNumMeshes, (uint32_t)-1);
+
+	for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+	{
+		const aiMesh* mesh = scene->mMeshes[i];
+
+		if ((!mesh->HasBones() && mesh->mNumAnimMeshes == 0) || meshNodes[i] == (uint32_t)-1)
+		{
+			continue;
+		}
+
+		DeformableMesh deformable;
+		deformable.meshIndex = i;
+		deformable.nodeIndex = meshNodes[i];
+
+		deformable.restPositions.resize(mesh->mNumVertices);
+		memcpy(deformable.restPositions.data(), mesh->mVertices, mesh->mNumVertices * sizeof(glm::vec3));
+
+		if (mesh->HasBones())
+		{
+			importBones(mesh, nodeIndices, deformable);
+		}
+
+		if (mesh->mNumAnimMeshes > 0)
+		{
+			importMorphTargets(mesh, animation, nodePointers[meshNodes[i]]->mName.C_Str(), ticksPerSecond, deformable);
+		}
+
+		data->meshDeformables[i] = (uint32_t)data->deformableMeshes.size();
+		data->deformableMeshes.push_back(std::move(deformable));
+	}
+
+	std::cout << "Scene animation: " << data->channels.size() << " animated nodes, " << data->deformableMeshes.size() << " deformable meshes, " << data->duration << "s" << std::endl;
+
+	return data;
+}
+
+/**************************************/
+/*        Animation evaluation        */
+/**************************************/
+
+//Finds the keys around `time` and the interpolation factor between them (keys are sorted by time)
+template<typename T>
+static size_t findKey(const std::vector<AnimationKey<T>>& keys, double time, float& factor)
+{
+	auto next = std::upper_bound(keys.begin(), keys.end(), time, [](double t, const AnimationKey<T>& key) { return t < key.time; });
+
+	if (next == keys.begin() || next == keys.end())
+	{
+		factor = 0.0f;
+		return next == keys.begin() ? 0 : keys.size() - 1;
+	}
+
+	size_t index = (next - keys.begin()) - 1;
+	double span = keys[index + 1].time - keys[index].time;
+
+	factor = span > 0.0 ? (float)((time - keys[index].time) / span) : 0.0f;
+
+	return index;
+}
+
+static glm::vec3 interpolate(const std::vector<AnimationKey<glm::vec3>>& keys, double time, const glm::vec3& fallback)
+{
+	if (keys.empty())
+	{
+		return fallback;
+	}
+
+	float factor;
+	size_t index = findKey(keys, time, factor);
+
+	return factor > 0.0f ? glm::mix(keys[index].value, keys[index + 1].value, factor) : keys[index].value;
+}
+
+static glm::quat interpolate(const std::vector<AnimationKey<glm::quat>>& keys, double time, const glm::quat& fallback)
+{
+	if (keys.empty())
+	{
+		return fallback;
+	}
+
+	float factor;
+	size_t index = findKey(keys, time, factor);
+
+	return factor > 0.0f ? glm::slerp(keys[index].value, keys[index + 1].value, factor) : keys[index].value;
+}
+
+void SceneAnimator::evaluateNodes(double time)
+{
+	const std::vector<AnimatedNode>& nodes = m_data->nodes;
+
+	for (size_t i = 0; i < nodes.size(); ++i)
+	{
+		const AnimatedNode& node = nodes[i];
+
+		glm::mat4 localTransform = glm::transpose(node.transform);
+
+		if (node.channel != (uint32_t)-1)
+		{
+			const AnimationChannel& channel = m_data->channels[node.channel];
+
+			//Components without keys keep the node's own value
+			glm::vec3 translation = glm::vec3(localTransform[3]);
+			glm::vec3 scale = glm::vec3(glm::length(glm::vec3(localTransform[0])), glm::length(glm::vec3(localTransform[1])), glm::length(glm::vec3(localTransform[2])));
+			glm::quat rotation = glm::quat_cast(glm::mat3(glm::vec3(localTransform[0]) / scale.x, glm::vec3(localTransform[1]) / scale.y, glm::vec3(localTransform[2]) / scale.z));
+
+			translation = interpolate(channel.positions, time, translation);
+			rotation = interpolate(channel.rotations, time, rotation);
+			scale = interpolate(channel.scalings, time, scale);
+
+			localTransform = glm::translate(translation) * glm::mat4_cast(rotation) * glm::scale(scale);
+		}
+
+		if (node.parent == (uint32_t)-1)
+		{
+			m_worldTransforms[i] = localTransform;
+			m_sceneTransforms[i] = glm::transpose(localTransform);
+		}
+		else
+		{
+			m_worldTransforms[i] = m_worldTransforms[node.parent] * localTransform;
+			m_sceneTransforms[i] = m_sceneTransforms[node.parent] * glm::transpose(localTransform);
+		}
+	}
+}
+
+void SceneAnimator::writeFrameData(uint8_t* frameData, double time) const
+{
+	for (const DeformableBLAS& deformableBLAS : m_deformables)
+	{
+		const DeformableMesh& deformable = m_data->deformableMeshes[deformableBLAS.deformableIndex];
+
+		//Bone matrices take the rest positions from mesh space to the bone's space and back to mesh space in the current pose
+		glm::mat4 meshToWorld = m_worldTransforms[deformable.nodeIndex];
+		glm::mat4 worldToMesh = glm::inverse(meshToWorld);
+
+		glm::mat4* boneMatrices = (glm::mat4*)(frameData + deformableBLAS.boneMatrixOffset);
+
+		for (size_t i = 0; i < deformable.boneNodes.size(); ++i)
+		{
+			uint32_t boneNode = deformable.boneNodes[i];
+
+			boneMatrices[i] = boneNode != (uint32_t)-1 ? worldToMesh * m_worldTransforms[boneNode] * deformable.boneOffsets[i] : glm::mat4(1.0f);
+		}
+
+		//Morph weights are interpolated linearly between the keys
+		float* morphWeights = (float*)(frameData + deformableBLAS.morphWeightOffset);
+
+		if (deformable.morphKeys.empty())
+		{
+			memcpy(morphWeights, deformable.morphWeights.data(), deformable.morphTargetCount * sizeof(float));
+		}
+		else
+		{
+			float factor;
+			size_t index = findKey(deformable.morphKeys, time, factor);
+
+			for (uint32_t i = 0; i < deformable.morphTargetCount; ++i)
+			{
+				float weight = deformable.morphKeys[index].value[i];
+
+				morphWeights[i] = factor > 0.0f ? weight + (deformable.morphKeys[index + 1].value[i] - weight) * factor : weight;
+			}
+		}
+	}
+}
+
+/**************************************/
+/*          Animation updates         */
+/**************************************/
+
+bool SceneAnimator::init(const RaytracingDevice* device, std::shared_ptr<const SceneAnimationData> data, const BLASBuildResult& blases,
+						 const std::vector<std::pair<uint32_t, uint32_t>>& deformableBLASes, const std::vector<VkDeviceAddress>& outputAddresses,
+						 const std::vector<std::pair<uint32_t, uint32_t>>& instanceNodes, StagingRing& stagingRing)
+{
+	m_device = device;
+	m_data = data;
+	m_instanceNodes = instanceNodes;
+
+	const RenderDevice* renderDevice = device->getRenderDevice();
+	VkDevice deviceHandle = renderDevice->getDevice();
+
+	m_sceneTransforms.resize(data->nodes.size());
+	m_worldTransforms.resize(data->nodes.size());
+
+	//Create deformation pipeline
+	ShaderSource source = Resources::loadShader("asset://shaders/animation/deform.comp");
+
+	if (!source.wasLoadedSuccessfully)
+	{
+		std::cerr << "Unable to load the deformation shader" << std::endl;
+		return false;
+	}
+
+	VkShaderModule shaderModule = renderDevice->compileShader(VK_SHADER_STAGE_COMPUTE_BIT, source.code);
+
+	if (shaderModule == VK_NULL_HANDLE)
+	{
+		return false;
+	}
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(DeformParameters);
+
+	VkPipelineLayoutCreateInfo layoutCI = {};
+	layoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutCI.pushConstantRangeCount = 1;
+	layoutCI.pPushConstantRanges = &pushConstantRange;
+
+	VK_CHECK(vkCreatePipelineLayout(deviceHandle, &layoutCI, nullptr, &m_pipelineLayout));
+
+	VkComputePipelineCreateInfo pipelineCI = {};
+	pipelineCI.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCI.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineCI.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineCI.stage.module = shaderModule;
+	pipelineCI.stage.pName = "main";
+	pipelineCI.layout = m_pipelineLayout;
+
+	VK_CHECK(vkCreateComputePipelines(deviceHandle, VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &m_pipeline));
+
+	vkDestroyShaderModule(deviceHandle, shaderModule, nullptr);
+
+	//Upload the source data of the deformable meshes
+	VkDeviceSize scratchAlignment = std::max<VkDeviceSize>(device->getAccelStructProperties().minAccelerationStructureScratchOffsetAlignment, 1);
+	VkDeviceSize scratchSize = 0;
+
+	for (size_t i = 0; i < deformableBLASes.size(); ++i)
+	{
+		const DeformableMesh& deformable = data->deformableMeshes[deformableBLASes[i].first];
+		size_t vertexCount = deformable.restPositions.size();
+
+		DeformableBLAS deformableBLAS = {};
+		deformableBLAS.deformableIndex = deformableBLASes[i].first;
+		deformableBLAS.blasIndex = deformableBLASes[i].second;
+		deformableBLAS.outputAddress = outputAddresses[i];
+
+		VkDeviceSize restPositionSize = vertexCount * sizeof(glm::vec3);
+		VkDeviceSize boneIndexSize = deformable.boneIndices.size() * sizeof(glm::uvec4);
+		VkDeviceSize boneWeightSize = deformable.boneWeights.size() * sizeof(glm::vec4);
+		VkDeviceSize morphOffsetSize = deformable.morphOffsets.size() * sizeof(glm::vec3);
+
+		VkDeviceSize boneIndexOffset = UINT32_ALIGN(restPositionSize, 16);
+		VkDeviceSize boneWeightOffset = boneIndexOffset + UINT32_ALIGN(boneIndexSize, 16);
+		VkDeviceSize morphOffsetOffset = boneWeightOffset + UINT32_ALIGN(boneWeightSize, 16);
+
+		deformableBLAS.sourceBuffer = renderDevice->createBuffer(morphOffsetOffset + std::max<VkDeviceSize>(morphOffsetSize, 16), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		VkDeviceAddress sourceAddress = renderDevice->getBufferAddress(deformableBLAS.sourceBuffer.buffer);
+
+		deformableBLAS.restPositionAddress = sourceAddress;
+		deformableBLAS.boneIndexAddress = sourceAddress + boneIndexOffset;
+		deformableBLAS.boneWeightAddress = sourceAddress + boneWeightOffset;
+		deformableBLAS.morphOffsetAddress = sourceAddress + morphOffsetOffset;
+
+		stagingRing.uploadBuffer(deformableBLAS.sourceBuffer.buffer, 0, deformable.restPositions.data(), restPositionSize);
+
+		if (boneIndexSize > 0)
+		{
+			stagingRing.uploadBuffer(deformableBLAS.sourceBuffer.buffer, boneIndexOffset, deformable.boneIndices.data(), boneIndexSize);
+			stagingRing.uploadBuffer(deformableBLAS.sourceBuffer.buffer, boneWeightOffset, deformable.boneWeights.data(), boneWeightSize);
+		}
+
+		if (morphOffsetSize > 0)
+		{
+			stagingRing.uploadBuffer(deformableBLAS.sourceBuffer.buffer, morphOffsetOffset, deformable.morphOffsets.data(), morphOffsetSize);
+		}
+
+		//Lay out the frame data
+		deformableBLAS.boneMatrixOffset = m_frameSliceSize;
+		deformableBLAS.morphWeightOffset = deformableBLAS.boneMatrixOffset + UINT32_ALIGN(deformable.boneNodes.size() * sizeof(glm::mat4), 16);
+
+		m_frameSliceSize = deformableBLAS.morphWeightOffset + UINT32_ALIGN(deformable.morphTargetCount * sizeof(float), 16);
+
+		//Every BLAS gets its own scratch memory, large enough for both refits and rebuilds
+		const BottomLevelAS& blas = blases.blasList[deformableBLAS.blasIndex];
+
+		std::vector<uint32_t> maxPrimitiveCounts;
+
+		for (const VkAccelerationStructureBuildRangeInfoKHR& rangeInfo : blas.geometryInfo->rangeInfoArray)
+		{
+			maxPrimitiveCounts.push_back(rangeInfo.primitiveCount);
+		}
+
+		VkAccelerationStructureBuildSizesInfoKHR sizeInfo = {};
+		sizeInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+
+		vkGetAccelerationStructureBuildSizesKHR(deviceHandle, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &blas.buildInfo, maxPrimitiveCounts.data(), &sizeInfo);
+
+		deformableBLAS.scratchOffset = scratchSize;
+		scratchSize += UINT32_ALIGN(std::max(sizeInfo.buildScratchSize, sizeInfo.updateScratchSize), scratchAlignment);
+
+		m_deformables.push_back(deformableBLAS);
+	}
+
+	//The data of every frame in flight is kept in its own slice
+	m_frameSliceSize = UINT32_ALIGN(std::max<VkDeviceSize>(m_frameSliceSize, 16), (VkDeviceSize)256);
+
+	m_frameBuffer = renderDevice->createBuffer(m_frameSliceSize * ANIMATION_FRAME_SLICE_COUNT, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+	m_mappedFrameData = m_frameBuffer.allocation.mappedData;
+
+	if (scratchSize > 0)
+	{
+		m_scratchBuffer = renderDevice->createBuffer(scratchSize + scratchAlignment, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		m_scratchAddress = UINT32_ALIGN(renderDevice->getBufferAddress(m_scratchBuffer.buffer), scratchAlignment);
+	}
+
+	return true;
+}
+
+void SceneAnimator::update(VkCommandBuffer commandBuffer, double deltaTime, const BLASBuildResult& blases, TopLevelAS& tlas)
+{
+	const RenderDevice* renderDevice = m_device->getRenderDevice();
+
+	m_time = m_data->duration > 0.0 ? std::fmod(m_time + deltaTime, m_data->duration) : 0.0;
+
+	evaluateNodes(m_time);
+
+	//Write the bone matrices and morph weights into the next slice
+	m_frameSlice = (m_frameSlice + 1) % ANIMATION_FRAME_SLICE_COUNT;
+
+	VkDeviceSize frameOffset = m_frameSlice * m_frameSliceSize;
+	VkDeviceAddress frameAddress = renderDevice->getBufferAddress(m_frameBuffer.buffer) + frameOffset;
+
+	writeFrameData(m_mappedFrameData + frameOffset, m_time);
+
+	if (!m_deformables.empty())
+	{
+		//The previous frame has to be done reading the positions and the BLASes before they are overwritten
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+
+		vkCmdPipelineBarrier(commandBuffer,
+							 VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+							 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+							 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		//Deform the meshes
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+
+		for (const DeformableBLAS& deformableBLAS : m_deformables)
+		{
+			const DeformableMesh& deformable = m_data->deformableMeshes[deformableBLAS.deformableIndex];
+
+			DeformParameters parameters = {};
+			parameters.outputPositions = deformableBLAS.outputAddress;
+			parameters.restPositions = deformableBLAS.restPositionAddress;
+			parameters.morphOffsets = deformableBLAS.morphOffsetAddress;
+			parameters.boneIndices = deformableBLAS.boneIndexAddress;
+			parameters.boneWeights = deformableBLAS.boneWeightAddress;
+			parameters.boneMatrices = frameAddress + deformableBLAS.boneMatrixOffset;
+			parameters.morphWeights = frameAddress + deformableBLAS.morphWeightOffset;
+			parameters.vertexCount = (uint32_t)deformable.restPositions.size();
+			parameters.boneCount = (uint32_t)deformable.boneNodes.size();
+			parameters.morphTargetCount = deformable.morphTargetCount;
+
+			vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DeformParameters), &parameters);
+			vkCmdDispatch(commandBuffer, (parameters.vertexCount + ANIMATION_WORKGROUP_SIZE - 1) / ANIMATION_WORKGROUP_SIZE, 1, 1);
+		}
+
+		//The builds and the hit shaders read the deformed positions
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer,
+							 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+							 VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+							 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		//Refit the BLASes (or rebuild them in place every now and then, see "Note on scene animation")
+		bool rebuild = ++m_framesSinceRebuild >= ANIMATION_BLAS_REBUILD_INTERVAL;
+
+		if (rebuild)
+		{
+			m_framesSinceRebuild = 0;
+		}
+
+		std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos;
+		std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> ppBuildRangeInfos;
+
+		for (const DeformableBLAS& deformableBLAS : m_deformables)
+		{
+			const BottomLevelAS& blas = blases.blasList[deformableBLAS.blasIndex];
+
+			VkAccelerationStructureBuildGeometryInfoKHR buildInfo = blas.buildInfo;
+			buildInfo.mode = rebuild ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+			buildInfo.srcAccelerationStructure = rebuild ? VK_NULL_HANDLE : blas.accelerationStructure;
+			buildInfo.dstAccelerationStructure = blas.accelerationStructure;
+			buildInfo.scratchData.deviceAddress = m_scratchAddress + deformableBLAS.scratchOffset;
+
+			buildInfos.push_back(buildInfo);
+			ppBuildRangeInfos.push_back(blas.geometryInfo->rangeInfoArray.data());
+		}
+
+		vkCmdBuildAccelerationStructuresKHR(commandBuffer, (uint32_t)buildInfos.size(), buildInfos.data(), ppBuildRangeInfos.data());
+
+		//The TLAS update reads the BLASes
+		barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+		barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+
+		vkCmdPipelineBarrier(commandBuffer,
+							 VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+							 VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+							 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	//Refit the TLAS with the animated instance transforms (the bounds of the deformed BLASes have changed as well)
+	m_instanceTransforms.clear();
+
+	for (const std::pair<uint32_t, uint32_t>& instanceNode : m_instanceNodes)
+	{
+		m_instanceTransforms.push_back(std::make_pair(instanceNode.first, m_sceneTransforms[instanceNode.second]));
+	}
+
+	tlas.updateInstances(commandBuffer, m_instanceTransforms);
+}
+
+void SceneAnimator::destroy()
+{
+	const RenderDevice* renderDevice = m_device->getRenderDevice();
+	VkDevice deviceHandle = renderDevice->getDevice();
+
+	for (const DeformableBLAS& deformableBLAS : m_deformables)
+	{
+		renderDevice->destroyBuffer(deformableBLAS.sourceBuffer);
+	}
+
+	m_deformables.clear();
+
+	m_mappedFrameData = nullptr;
+
+	renderDevice->destroyBuffer(m_frameBuffer);
+	renderDevice->destroyBuffer(m_scratchBuffer);
+
+	m_frameBuffer = {};
+	m_scratchBuffer = {};
+
+	if (m_pipeline != VK_NULL_HANDLE)
+	{
+		vkDestroyPipeline(deviceHandle, m_pipeline, nullptr);
+		m_pipeline = VK_NULL_HANDLE;
+	}
+
+	if (m_pipelineLayout != VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineLayout(deviceHandle, m_pipelineLayout, nullptr);
+		m_pipelineLayout = VK_NULL_HANDLE;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <memory>
+#include <string>
+
+#include "api/RaytracingDevice.h"
+#include "api/StagingRing.h"
+
+struct aiScene;
+
+/*
+ ------------------------------
+	 Note on scene animation
+ ------------------------------
+
+ The first animation of an imported scene is played back in a loop. Its data (node channels, bones and morph
+ targets) is copied out of the Assimp scene when the scene is described, since the importer is freed after loading.
+
+ Every frame, `SceneAnimator::update` evaluates the node transforms on the CPU and then records:
+	1. A compute dispatch per deformable mesh (a mesh with bones or morph targets) that writes the deformed
+	   positions into the position range of the mesh's vertex buffer, which is also what its BLAS is built from.
+	   The bone matrices and morph weights are read from a host-visible buffer with ANIMATION_FRAME_SLICE_COUNT
+	   slices, so that the slice of a frame in flight is never overwritten.
+	2. A refit (VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR) of the BLAS of every deformable mesh. Refitting
+	   keeps the topology of the original build, so the BLASes are rebuilt in place every
+	   ANIMATION_BLAS_REBUILD_INTERVAL frames to limit the decay in traversal performance.
+	3. An update of the TLAS with the transforms of the instances whose node is animated (see "Note on TLAS updates").
+
+ Instances that are animated in either way are marked as dynamic when the scene graph is flattened. Dynamic instances
+ are never merged with other meshes, deformable meshes never share their geometry, and their BLASes are built with
+ ALLOW_UPDATE and without compaction (a compacted BLAS can't be rebuilt in place). Only the positions are deformed,
+ so the shading normals of deformable meshes keep their rest pose. Scenes with animations aren't cooked into the
+ scene cache, since the cache doesn't store animation data.
+*/
+
+//Number of frames between full rebuilds of the refitted BLASes
+#define ANIMATION_BLAS_REBUILD_INTERVAL 64
+
+//Number of slices of the per-frame animation data (must exceed the number of frames in flight)
+#define ANIMATION_FRAME_SLICE_COUNT 3
+
+//Maximum number of bones that influence a single vertex
+#define ANIMATION_MAX_VERTEX_BONES 4
+
+//Number of vertices deformed by a single workgroup (must match `deform.comp`)
+#define ANIMATION_WORKGROUP_SIZE 64
+
+template<typename T>
+struct AnimationKey
+{
+	//In seconds
+	double time;
+	T value;
+};
+
+//The keyframes of a single animated node
+struct AnimationChannel
+{
+	std::vector<AnimationKey<glm::vec3>> positions;
+	std::vector<AnimationKey<glm::quat>> rotations;
+	std::vector<AnimationKey<glm::vec3>> scalings;
+};
+
+struct AnimatedNode
+{
+	//Nodes are stored in pre-order, so the parent of a node always comes before it
+	uint32_t parent;
+
+	//The transform relative to the parent, used when the node doesn't have a channel
+	glm::mat4 transform;
+
+	//Index into `SceneAnimationData::channels` (or -1)
+	uint32_t channel;
+
+	//True if the node or any of its ancestors has a channel
+	bool isAnimated;
+};
+
+//The bones and morph targets of a mesh, in the vertex order of the uploaded mesh
+struct DeformableMesh
+{
+	uint32_t meshIndex;
+
+	//The node that holds the mesh. The deformed positions are relative to it, like the undeformed ones.
+	uint32_t nodeIndex;
+
+	std::vector<glm::vec3> restPositions;
+
+	//The node of each bone (or -1) and the transform from mesh space to the bone's space
+	std::vector<uint32_t> boneNodes;
+	std::vector<glm::mat4> boneOffsets;
+
+	//Up to ANIMATION_MAX_VERTEX_BONES bones per vertex, with weights that add up to 1, or to 0 for vertices
+	//that no bone influences (empty if there are no bones)
+	std::vector<glm::uvec4> boneIndices;
+	std::vector<glm::vec4> boneWeights;
+
+	//The position offsets of every morph target (`morphTargetCount` blocks of one offset per vertex)
+	uint32_t morphTargetCount = 0;
+	std::vector<glm::vec3> morphOffsets;
+
+	//The morph target weights, if they aren't animated
+	std::vector<float> morphWeights;
+	std::vector<AnimationKey<std::vector<float>>> morphKeys;
+};
+
+//Everything needed to play back the animation of a scene
+struct SceneAnimationData
+{
+	std::vector<AnimatedNode> nodes;
+	std::vector<AnimationChannel> channels;
+	std::vector<DeformableMesh> deformableMeshes;
+
+	//The index of each mesh into `deformableMeshes` (or -1)
+	std::vector<uint32_t> meshDeformables;
+
+	//In seconds
+	double duration = 0.0;
+
+	//Returns `nullptr` if the scene doesn't have any animations
+	static std::shared_ptr<SceneAnimationData> import(const aiScene* scene);
+};
+
+class SceneAnimator
+{
+private:
+	struct DeformableBLAS
+	{
+		uint32_t deformableIndex;
+
+		//Index into `BLASBuildResult::blasList`
+		uint32_t blasIndex;
+
+		Buffer sourceBuffer;
+
+		VkDeviceAddress restPositionAddress;
+		VkDeviceAddress boneIndexAddress;
+		VkDeviceAddress boneWeightAddress;
+		VkDeviceAddress morphOffsetAddress;
+
+		//The position range of the mesh's vertex buffer
+		VkDeviceAddress outputAddress;
+
+		//Offsets of the bone matrices and morph weights within a frame slice
+		VkDeviceSize boneMatrixOffset;
+		VkDeviceSize morphWeightOffset;
+
+		VkDeviceSize scratchOffset;
+	};
+
+	std::shared_ptr<const SceneAnimationData> m_data = nullptr;
+
+	std::vector<DeformableBLAS> m_deformables;
+
+	//The TLAS instances whose transforms are animated, and their nodes
+	std::vector<std::pair<uint32_t, uint32_t>> m_instanceNodes;
+
+	//The transforms of the nodes relative to the scene root, both in the layout built by `flattenSceneGraph`
+	//(which is what the TLAS instances use) and as regular matrices (which is what the bones use)
+	std::vector<glm::mat4> m_sceneTransforms;
+	std::vector<glm::mat4> m_worldTransforms;
+
+	std::vector<std::pair<uint32_t, glm::mat4>> m_instanceTransforms;
+
+	Buffer m_frameBuffer = {};
+	uint8_t* m_mappedFrameData = nullptr;
+	VkDeviceSize m_frameSliceSize = 0;
+	uint32_t m_frameSlice = 0;
+
+	Buffer m_scratchBuffer = {};
+	VkDeviceAddress m_scratchAddress = 0;
+
+	VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline m_pipeline = VK_NULL_HANDLE;
+
+	double m_time = 0.0;
+	uint32_t m_framesSinceRebuild = 0;
+
+	const RaytracingDevice* m_device = nullptr;
+private:
+	void evaluateNodes(double time);
+	void writeFrameData(uint8_t* frameData, double time) const;
+public:
+	//`deformableBLASes` holds the (deformable mesh, BLAS) pairs and `outputAddresses` the address of the position range each
+	//deformable mesh is written to. The source data is uploaded through `stagingRing`, which must be finished before the first update.
+	bool init(const RaytracingDevice* device, std::shared_ptr<const SceneAnimationData> data, const BLASBuildResult& blases,
+			  const std::vector<std::pair<uint32_t, uint32_t>>& deformableBLASes, const std::vector<VkDeviceAddress>& outputAddresses,
+			  const std::vector<std::pair<uint32_t, uint32_t>>& instanceNodes, StagingRing& stagingRing);
+	void destroy();
+
+	//Advances the animation by `deltaTime` seconds and records the deformation and acceleration structure updates
+	void update(VkCommandBuffer commandBuffer, double deltaTime, const BLASBuildResult& blases, TopLevelAS& tlas);
+};
\ No newline at end of file
@@ -0,0 +1,350 @@
+#include "SceneCache.h"
+
+#include <Common.h>
+
+#include "TextureCompression.h"
+#include "MipGenerator.h"
+#include "GeometryLayout.h"
+
+#include "utils/Hash.h"
+
+#include <filesystem>
+#include <iostream>
+
+static const char s_sceneCacheMagic[4] = { 'V', 'K', 'R', 'S' };
+
+/**************************************/
+/*          Reading the cache         */
+/**************************************/
+
+template<typename T>
+bool isRangeValid(uint64_t offset, uint64_t count, size_t fileSize)
+{
+	return offset <= fileSize && count <= (fileSize - offset) / sizeof(T);
+}
+
+bool SceneCache::validate(const SceneCacheKey& key, bool compactVertices)
+{
+	size_t fileSize = m_file.getSize();
+
+	if (fileSize < sizeof(SceneCacheHeader))
+	{
+		return false;
+	}
+
+	m_header = (const SceneCacheHeader*)m_file.getData();
+
+	if (memcmp(m_header->magic, s_sceneCacheMagic, sizeof(s_sceneCacheMagic)) != 0 || m_header->version != SCENE_CACHE_VERSION || !(m_header->key == key))
+	{
+		return false;
+	}
+
+	//Validate tables
+	if (!isRangeValid<CachedMesh>(m_header->meshTableOffset, m_header->meshCount, fileSize) ||
+		!isRangeValid<CachedTexture>(m_header->textureTableOffset, m_header->textureCount, fileSize) ||
+		!isRangeValid<CachedMaterial>(m_header->materialTableOffset, m_header->materialCount, fileSize) ||
+		!isRangeValid<CachedInstance>(m_header->instanceTableOffset, m_header->instanceCount, fileSize))
+	{
+		return false;
+	}
+
+	m_meshes = (const CachedMesh*)getData(m_header->meshTableOffset);
+	m_textures = (const CachedTexture*)getData(m_header->textureTableOffset);
+	m_materials = (const CachedMaterial*)getData(m_header->materialTableOffset);
+	m_instances = (const CachedInstance*)getData(m_header->instanceTableOffset);
+
+	//Validate the data referenced by the tables
+	for (uint32_t i = 0; i < m_header->meshCount; ++i)
+	{
+		const CachedMesh& mesh = m_meshes[i];
+
+		if (!isRangeValid<uint8_t>(mesh.vertexDataOffset, mesh.vertexDataSize, fileSize) ||
+			!isRangeValid<uint8_t>(mesh.indexDataOffset, mesh.indexDataSize, fileSize) ||
+			mesh.materialIndex >= m_header->materialCount ||
+			(uint64_t)mesh.opaqueFaceCount + mesh.mixedFaceCount > mesh.faceCount)
+		{
+			return false;
+		}
+
+		//The data is copied into ranges laid out by the loader, so it must match them exactly (see "Note on geometry layout")
+		if (mesh.vertexDataSize != GeometryLayout::getVertexDataSize(mesh.vertexCount, compactVertices, key.rangeAlignment) ||
+			mesh.indexDataSize != GeometryLayout::getIndexRangeSize(mesh.vertexCount, mesh.faceCount, key.rangeAlignment))
+		{
+			return false;
+		}
+	}
+
+	for (uint32_t i = 0; i < m_header->textureCount; ++i)
+	{
+		const CachedTexture& texture = m_textures[i];
+
+		if (!texture.isValid)
+		{
+			continue;
+		}
+
+		if (texture.width <= 0 || texture.height <= 0 || texture.format > (uint32_t)TextureFormat::BC7 || texture.mipLevelCount == 0 ||
+			texture.mipLevelCount > MipGenerator::getMipLevelCount(texture.width, texture.height))
+		{
+			return false;
+		}
+
+		//The data is the whole mip chain in the texture's format (block-compressed chains are smaller than RGBA8 ones)
+		if (!isRangeValid<uint8_t>(texture.dataOffset, texture.dataSize, fileSize) ||
+			texture.dataSize != TextureCompression::getChainSize((TextureFormat)texture.format, texture.width, texture.height, texture.mipLevelCount))
+		{
+			return false;
+		}
+	}
+
+	for (uint32_t i = 0; i < m_header->materialCount; ++i)
+	{
+		const CachedMaterial& material = m_materials[i];
+
+		if ((material.albedoTexture != (uint32_t)-1 && material.albedoTexture >= m_header->textureCount) ||
+			material.wrapU > (uint32_t)TextureWrap::ClampToBorder || material.wrapV > (uint32_t)TextureWrap::ClampToBorder)
+		{
+			return false;
+		}
+	}
+
+	for (uint32_t i = 0; i < m_header->instanceCount; ++i)
+	{
+		if (m_instances[i].meshIndex >= m_header->meshCount)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::shared_ptr<SceneCache> SceneCache::open(const std::string& cachePath, const SceneCacheKey& key, bool compactVertices)
+{
+	std::shared_ptr<SceneCache> cache = std::make_shared<SceneCache>();
+
+	if (!cache->m_file.open(cachePath))
+	{
+		return nullptr;
+	}
+
+	if (!cache->validate(key, compactVertices))
+	{
+		std::cout << "Scene cache '" << cachePath << "' is out of date" << std::endl;
+		return nullptr;
+	}
+
+	return cache;
+}
+
+bool SceneCache::createKey(const std::string& scenePath, uint64_t rangeAlignment, uint64_t optionsHash, SceneCacheKey& key)
+{
+	std::error_code error;
+
+	uintmax_t fileSize = std::filesystem::file_size(scenePath, error);
+	if (error)
+	{
+		return false;
+	}
+
+	std::filesystem::file_time_type modifiedTime = std::filesystem::last_write_time(scenePath, error);
+	if (error)
+	{
+		return false;
+	}
+
+	key.sourceSize = (uint64_t)fileSize;
+	key.sourceModifiedTime = (int64_t)modifiedTime.time_since_epoch().count();
+	key.rangeAlignment = rangeAlignment;
+	key.optionsHash = optionsHash;
+
+	return true;
+}
+
+std::string SceneCache::getCachePath(const std::string& scenePath)
+{
+	std::error_code error;
+	std::filesystem::path absolutePath = std::filesystem::absolute(scenePath, error).lexically_normal();
+
+	//The hash of the full path keeps scenes with the same file name apart
+	std::string name = absolutePath.stem().string() + "-" + Hash::toHex(Hash::string(absolutePath.string())) + ".vkrscene";
+
+	return Resources::cachePath(name);
+}
+
+/**************************************/
+/*          Writing the cache         */
+/**************************************/
+
+SceneCacheWriter::~SceneCacheWriter()
+{
+	if (m_file.is_open())
+	{
+		//`finish` was never called, so the file is incomplete
+		m_file.close();
+
+		std::error_code error;
+		std::filesystem::remove(m_temporaryPath, error);
+	}
+}
+
+bool SceneCacheWriter::begin(const std::string& cachePath, const SceneCacheKey& key, uint32_t meshCount, uint32_t textureCount)
+{
+	m_path = cachePath;
+	m_temporaryPath = cachePath + ".tmp";
+
+	m_file.open(m_temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+
+	if (!m_file)
+	{
+		std::cerr << "Unable to create scene cache '" << m_temporaryPath << "'" << std::endl;
+		return false;
+	}
+
+	memcpy(m_header.magic, s_sceneCacheMagic, sizeof(s_sceneCacheMagic));
+	m_header.version = SCENE_CACHE_VERSION;
+	m_header.key = key;
+
+	m_meshes.resize(meshCount, {});
+	m_textures.resize(textureCount, {});
+
+	//The header is written last, once all the offsets are known
+	SceneCacheHeader emptyHeader = {};
+	writeData(&emptyHeader, sizeof(emptyHeader));
+
+	return !m_failed;
+}
+
+uint64_t SceneCacheWriter::writeData(const void* data, uint64_t size)
+{
+	//Keep everything 16-byte aligned, so that the tables can be read in place
+	static const uint8_t padding[16] = {};
+
+	uint64_t paddingSize = (16 - (m_offset & 15)) & 15;
+
+	m_file.write((const char*)padding, paddingSize);
+	m_offset += paddingSize;
+
+	uint64_t offset = m_offset;
+
+	m_file.write((const char*)data, size);
+	m_offset += size;
+
+	m_failed |= !m_file;
+
+	return offset;
+}
+
+void SceneCacheWriter::writeMesh(uint32_t meshIndex, uint32_t vertexCount, uint32_t faceCount, uint32_t materialIndex, const TriangleOpacity& opacity, const void* vertexData, uint64_t vertexDataSize, const void* indexData, uint64_t indexDataSize)
+{
+	CachedMesh& mesh = m_meshes[meshIndex];
+	mesh.vertexCount = vertexCount;
+	mesh.faceCount = faceCount;
+	mesh.materialIndex = materialIndex;
+
+	mesh.isOpacityClassified = opacity.isClassified;
+	mesh.opaqueFaceCount = opacity.opaqueFaceCount;
+	mesh.mixedFaceCount = opacity.mixedFaceCount;
+
+	mesh.vertexDataOffset = writeData(vertexData, vertexDataSize);
+	mesh.vertexDataSize = vertexDataSize;
+
+	mesh.indexDataOffset = writeData(indexData, indexDataSize);
+	mesh.indexDataSize = indexDataSize;
+}
+
+void SceneCacheWriter::writeSharedMesh(uint32_t meshIndex, uint32_t sourceMeshIndex, uint32_t materialIndex)
+{
+	m_meshes[meshIndex] = m_meshes[sourceMeshIndex];
+	m_meshes[meshIndex].materialIndex = materialIndex;
+}
+
+void SceneCacheWriter::writeTexture(uint32_t textureIndex, int width, int height, uint32_t mipLevelCount, uint32_t format, bool hasAlpha, const void* data, uint64_t dataSize)
+{
+	CachedTexture& texture = m_textures[textureIndex];
+	texture.width = width;
+	texture.height = height;
+	texture.mipLevelCount = mipLevelCount;
+	texture.format = format;
+	texture.hasAlpha = hasAlpha;
+	texture.isValid = data != nullptr;
+
+	if (data)
+	{
+		texture.dataOffset = writeData(data, dataSize);
+		texture.dataSize = dataSize;
+	}
+}
+
+void SceneCacheWriter::addMaterial(uint32_t albedoTexture, TextureWrap wrapU, TextureWrap wrapV)
+{
+	CachedMaterial material = {};
+	material.albedoTexture = albedoTexture;
+	material.wrapU = (uint32_t)wrapU;
+	material.wrapV = (uint32_t)wrapV;
+
+	m_materials.push_back(material);
+}
+
+void SceneCacheWriter::addInstance(const glm::mat4& transform, uint32_t meshIndex)
+{
+	CachedInstance instance = {};
+	instance.transform = transform;
+	instance.meshIndex = meshIndex;
+
+	m_instances.push_back(instance);
+}
+
+void SceneCacheWriter::setCamera(const glm::vec3& position, const glm::quat& rotation)
+{
+	m_header.hasCamera = 1;
+	m_header.cameraPosition = position;
+	m_header.cameraRotation = rotation;
+}
+
+bool SceneCacheWriter::finish()
+{
+	//Write tables
+	m_header.meshCount = (uint32_t)m_meshes.size();
+	m_header.meshTableOffset = writeData(m_meshes.data(), m_meshes.size() * sizeof(CachedMesh));
+
+	m_header.textureCount = (uint32_t)m_textures.size();
+	m_header.textureTableOffset = writeData(m_textures.data(), m_textures.size() * sizeof(CachedTexture));
+
+	m_header.materialCount = (uint32_t)m_materials.size();
+	m_header.materialTableOffset = writeData(m_materials.data(), m_materials.size() * sizeof(CachedMaterial));
+
+	m_header.instanceCount = (uint32_t)m_instances.size();
+	m_header.instanceTableOffset = writeData(m_instances.data(), m_instances.size() * sizeof(CachedInstance));
+
+	//Write header
+	m_file.seekp(0);
+	m_file.write((const char*)&m_header, sizeof(m_header));
+
+	m_failed |= !m_file;
+
+	m_file.close();
+
+	std::error_code error;
+
+	if (m_failed)
+	{
+		std::cerr << "Unable to write scene cache '" << m_temporaryPath << "'" << std::endl;
+
+		std::filesystem::remove(m_temporaryPath, error);
+		return false;
+	}
+
+	//Move the finished file into place, so that a partially written file is never picked up
+	std::filesystem::rename(m_temporaryPath, m_path, error);
+
+	if (error)
+	{
+		std::cerr << "Unable to write scene cache '" << m_path << "': " << error.message() << std::endl;
+
+		std::filesystem::remove(m_temporaryPath, error);
+		return false;
+	}
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+
+#include "utils/MappedFile.h"
+
+#include "OpacityClassifier.h"
+
+/*
+ ------------------------------
+	  Note on the scene cache
+ ------------------------------
+
+ Importing a scene with Assimp (and converting it to the layout used by the renderer) is
+ by far the slowest part of loading a scene. The first time a scene is loaded, the loader
+ writes everything it uploads to the GPU into a `.vkrscene` file in the cache directory:
+	- The vertex and index data of every mesh, laid out exactly like the ranges created by
+	  `createBufferAllocDetails` (so they can be copied to staging memory with one memcpy, see
+	  "Note on geometry layout"), with the triangles of meshes with alpha already sorted by
+	  opacity (see "Note on triangle opacity")
+	- The decoded (or block-compressed) pixels of every texture, including the generated mip chain
+	- The material table and the flattened scene graph (one transform per mesh instance)
+	- The camera
+
+ Subsequent loads map the file into memory and skip Assimp entirely. A cache file is only
+ used if it was created from the same version of the source file, with the same device
+ alignment and the same load options (see `SceneCacheKey`).
+
+ The cache is keyed on the scene file only, so changes to external textures are not picked up
+ until the scene file changes (or the cache is disabled for a load).
+*/
+
+//Bump this whenever the layout or the contents of the cooked data change
+#define SCENE_CACHE_VERSION 8
+
+struct SceneCacheKey
+{
+	uint64_t sourceSize = 0;
+	int64_t sourceModifiedTime = 0;
+
+	//The alignment of the vertex and index ranges (GEOMETRY_RANGE_ALIGNMENT)
+	uint64_t rangeAlignment = 0;
+
+	//Hash of the load options that affect the cooked data
+	uint64_t optionsHash = 0;
+
+	bool operator==(const SceneCacheKey& other) const
+	{
+		return sourceSize == other.sourceSize && sourceModifiedTime == other.sourceModifiedTime &&
+			   rangeAlignment == other.rangeAlignment && optionsHash == other.optionsHash;
+	}
+};
+
+struct SceneCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+
+	SceneCacheKey key;
+
+	uint32_t meshCount;
+	uint32_t textureCount;
+	uint32_t materialCount;
+	uint32_t instanceCount;
+
+	uint64_t meshTableOffset;
+	uint64_t textureTableOffset;
+	uint64_t materialTableOffset;
+	uint64_t instanceTableOffset;
+
+	uint32_t hasCamera;
+	glm::vec3 cameraPosition;
+	glm::quat cameraRotation;
+};
+
+struct CachedMesh
+{
+	uint32_t vertexCount;
+	uint32_t faceCount;
+	uint32_t materialIndex;
+
+	//The triangles are sorted by opacity if they were classified (see "Note on triangle opacity")
+	uint32_t isOpacityClassified;
+	uint32_t opaqueFaceCount;
+	uint32_t mixedFaceCount;
+
+	uint32_t reserved[2];
+
+	//Offsets are relative to the start of the file
+	uint64_t vertexDataOffset;
+	uint64_t vertexDataSize;
+
+	uint64_t indexDataOffset;
+	uint64_t indexDataSize;
+};
+
+struct CachedTexture
+{
+	int32_t width;
+	int32_t height;
+	uint32_t hasAlpha;
+
+	//Textures that failed to load are stored too, so that
+	//materials resolve to the same texture slots
+	uint32_t isValid;
+
+	uint32_t mipLevelCount;
+	uint32_t format;
+
+	uint64_t dataOffset;
+	uint64_t dataSize;
+};
+
+struct CachedMaterial
+{
+	//The index of the albedo texture (or -1)
+	uint32_t albedoTexture;
+
+	//`TextureWrap` of the albedo texture along each axis
+	uint32_t wrapU;
+	uint32_t wrapV;
+
+	uint32_t reserved;
+};
+
+struct CachedInstance
+{
+	glm::mat4 transform;
+
+	uint32_t meshIndex;
+	uint32_t reserved[3];
+};
+
+class SceneCache
+{
+private:
+	MappedFile m_file;
+
+	const SceneCacheHeader* m_header = nullptr;
+
+	const CachedMesh* m_meshes = nullptr;
+	const CachedTexture* m_textures = nullptr;
+	const CachedMaterial* m_materials = nullptr;
+	const CachedInstance* m_instances = nullptr;
+private:
+	bool validate(const SceneCacheKey& key, bool compactVertices);
+public:
+	//Returns `nullptr` if the cache file doesn't exist or can't be used with `key`. The vertex layout
+	//(`compactVertices`) is needed to check the sizes of the cooked vertex data.
+	static std::shared_ptr<SceneCache> open(const std::string& cachePath, const SceneCacheKey& key, bool compactVertices);
+
+	//Returns false if the source file can't be found
+	static bool createKey(const std::string& scenePath, uint64_t rangeAlignment, uint64_t optionsHash, SceneCacheKey& key);
+	static std::string getCachePath(const std::string& scenePath);
+
+	inline uint32_t getMeshCount() const { return m_header->meshCount; }
+	inline uint32_t getTextureCount() const { return m_header->textureCount; }
+	inline uint32_t getMaterialCount() const { return m_header->materialCount; }
+	inline uint32_t getInstanceCount() const { return m_header->instanceCount; }
+
+	inline const CachedMesh& getMesh(uint32_t index) const { return m_meshes[index]; }
+	inline const CachedTexture& getTexture(uint32_t index) const { return m_textures[index]; }
+	inline const CachedMaterial& getMaterial(uint32_t index) const { return m_materials[index]; }
+	inline const CachedInstance& getInstance(uint32_t index) const { return m_instances[index]; }
+
+	inline const uint8_t* getData(uint64_t offset) const { return m_file.getData() + offset; }
+
+	inline bool hasCamera() const { return m_header->hasCamera != 0; }
+	inline glm::vec3 getCameraPosition() const { return m_header->cameraPosition; }
+	inline glm::quat getCameraRotation() const { return m_header->cameraRotation; }
+};
+
+class SceneCacheWriter
+{
+private:
+	std::string m_path;
+	std::string m_temporaryPath;
+	std::ofstream m_file;
+
+	uint64_t m_offset = 0;
+	bool m_failed = false;
+
+	SceneCacheHeader m_header = {};
+
+	std::vector<CachedMesh> m_meshes;
+	std::vector<CachedTexture> m_textures;
+	std::vector<CachedMaterial> m_materials;
+	std::vector<CachedInstance> m_instances;
+private:
+	uint64_t writeData(const void* data, uint64_t size);
+public:
+	SceneCacheWriter() {}
+	SceneCacheWriter(const SceneCacheWriter&) = delete;
+	~SceneCacheWriter();
+
+	bool begin(const std::string& cachePath, const SceneCacheKey& key, uint32_t meshCount, uint32_t textureCount);
+
+	void writeMesh(uint32_t meshIndex, uint32_t vertexCount, uint32_t faceCount, uint32_t materialIndex, const TriangleOpacity& opacity, const void* vertexData, uint64_t vertexDataSize, const void* indexData, uint64_t indexDataSize);
+
+	//Writes a mesh that references the data of an already written mesh
+	void writeSharedMesh(uint32_t meshIndex, uint32_t sourceMeshIndex, uint32_t materialIndex);
+
+	//Pass `nullptr` as `data` for textures that failed to load
+	void writeTexture(uint32_t textureIndex, int width, int height, uint32_t mipLevelCount, uint32_t format, bool hasAlpha, const void* data, uint64_t dataSize);
+
+	void addMaterial(uint32_t albedoTexture, TextureWrap wrapU, TextureWrap wrapV);
+	void addInstance(const glm::mat4& transform, uint32_t meshIndex);
+	void setCamera(const glm::vec3& position, const glm::quat& rotation);
+
+	//Writes the tables and moves the file into place. Nothing is written if this is never called.
+	bool finish();
+
+	SceneCacheWriter& operator=(const SceneCacheWriter&) = delete;
+};
\ No newline at end of file
@@ -2,6 +2,19 @@
 
 #include <Common.h>
 
+#include "SceneCache.h"
+#include "BLASCache.h"
+#include "VertexConversion.h"
+#include "MipGenerator.h"
+#include "TextureCompression.h"
+#include "MeshOptimizer.h"
+#include "SceneAnimation.h"
+#include "OpacityClassifier.h"
+#include "GeometryLayout.h"
+
+#include "utils/ThreadPool.h"
+#include "utils/Hash.h"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
@@ -11,11 +24,30 @@
 #include <assimp/ProgressHandler.hpp>
 
 #include <glm/gtx/transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <filesystem>
 #include <vector>
 #include <chrono>
 #include <array>
+#include <unordered_map>
+#include <map>
+#include <functional>
+#include <algorithm>
+
+//Size of the staging memory used to upload a scene
+#define STAGING_RING_SIZE (128ull * 1024 * 1024)
+#define STAGING_RING_SEGMENT_COUNT 4
+
+//Number of vertices converted by a single task
+#define VERTEX_CONVERSION_CHUNK_SIZE (64 * 1024)
+
+//Limits on the meshes that are merged into multi-geometry BLASes
+#define MERGED_MESH_MAX_FACE_COUNT 1024
+#define MERGED_MESH_MAX_GEOMETRY_COUNT 256
+
+//Alignment of the vertex and index data within the geometry buffers (see "Note on geometry buffers")
+#define GEOMETRY_RANGE_ALIGNMENT 16
 
 #define DESC_SET_WRITE_BUFFER(e, desc, bind, arr, type)	\
 if (arr.size() > 0) {									\
@@ -57,817 +89,2270 @@ public:
 	}
 };
 
-/**************************************/
-/*       Load scene vertex data       */
-/**************************************/
-
-void parseSceneGraphNode(const RaytracingDevice* device, std::vector<VkAccelerationStructureInstanceKHR>& instances, const BLASBuildResult& buildResult,
-						 const aiScene* scene, aiNode* node, glm::mat4 transform, std::vector<uint32_t>& materialIndices, const std::vector<bool>& isMaterialOpaque)
-{
-	glm::mat4 nodeTransform = {
-		{ node->mTransformation.a1, node->mTransformation.a2, node->mTransformation.a3, node->mTransformation.a4 },
-		{ node->mTransformation.b1, node->mTransformation.b2, node->mTransformation.b3, node->mTransformation.b4 },
-		{ node->mTransformation.c1, node->mTransformation.c2, node->mTransformation.c3, node->mTransformation.c4 },
-		{ node->mTransformation.d1, node->mTransformation.d2, node->mTransformation.d3, node->mTransformation.d4 }
-	};
-
-	transform *= nodeTransform;
-
-	//Add BLAS instances to TLAS
-	for (unsigned int i = 0; i < node->mNumMeshes; ++i)
-	{
-		uint32_t materialIndex = scene->mMeshes[node->mMeshes[i]]->mMaterialIndex;
-		
-		//Compute geometry flags
-		VkGeometryInstanceFlagsKHR flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-		flags |= isMaterialOpaque[materialIndex] ? VK_GEOMETRY_INSTANCE_FORCE_OPAQUE_BIT_KHR : VK_GEOMETRY_INSTANCE_FORCE_NO_OPAQUE_BIT_KHR;
-
-		//Add instance
-		instances.push_back(device->compileInstances(buildResult.blasList[node->mMeshes[i]], transform, node->mMeshes[i]/*gl_InstanceCustomIndexEXT*/, 0xFF, 0, flags));
-		materialIndices.push_back(materialIndex);
-	}
-
-	//Traverse children
-	for (unsigned int i = 0; i < node->mNumChildren; ++i)
-	{
-		parseSceneGraphNode(device, instances, buildResult, scene, node->mChildren[i], transform, materialIndices, isMaterialOpaque);
-	}
-}
-
 template<int N>
 struct BufferAllocDetails
 {
-	VkBuffer buffer;
-
-	//The offset of the buffer within the allocation it takes its memory from
-	VkDeviceSize pageOffset;
-
-	//The actual size of the buffer (as returned by `vkGetBufferMemoryRequirements`)
-	VkDeviceSize actualSize;
+	//The geometry buffer (and memory block) the data is packed into and its offset within it
+	uint32_t memoryBlock;
+	VkDeviceSize bufferOffset;
 
 	//The total size of the ranges
 	VkDeviceSize totalRangeSize;
 
-	//The offset of each range WITHIN the buffer and its size
+	//The offset of each range relative to `bufferOffset` and its size
 	std::array<std::pair<VkDeviceSize, VkDeviceSize>, N> ranges;
 };
 
 typedef BufferAllocDetails<3> VertexBufferAllocDetails;
 typedef BufferAllocDetails<1> IndexBufferAllocDetails;
 
+//Places a resource at the end of the last memory block, or in a new block if it doesn't fit (see "Note on scene memory")
+void packIntoMemoryBlocks(const VkMemoryRequirements& memRequirements, VkDeviceSize maxBlockSize, std::vector<VkDeviceSize>& blockSizes, uint32_t& memoryBlock, VkDeviceSize& pageOffset)
+{
+	pageOffset = blockSizes.empty() ? 0 : UINT32_ALIGN(blockSizes.back(), memRequirements.alignment);
+
+	if (blockSizes.empty() || pageOffset + memRequirements.size > maxBlockSize)
+	{
+		blockSizes.push_back(0);
+		pageOffset = 0;
+	}
+
+	memoryBlock = (uint32_t)blockSizes.size() - 1;
+	blockSizes.back() = pageOffset + memRequirements.size;
+}
+
 template<int N>
-BufferAllocDetails<N> createBufferAllocDetails(VkDevice deviceHandle, VkDeviceSize sizes[N], VkDeviceSize rangeAlignment, VkBufferUsageFlags bufferUsage, VkDeviceSize& totalSceneSize, uint32_t& mutualMemoryTypeBits)
+BufferAllocDetails<N> createBufferAllocDetails(VkDeviceSize sizes[N], VkDeviceSize rangeAlignment, VkDeviceSize maxBlockSize, std::vector<VkDeviceSize>& blockSizes)
 {
 	BufferAllocDetails<N> allocDetails;
 
+	//The ranges are laid out like the scene cache expects them (see "Note on geometry layout")
+	VkDeviceSize offsets[N];
+	allocDetails.totalRangeSize = GeometryLayout::layoutRanges(sizes, N, rangeAlignment, offsets);
+
 	for (int i = 0; i < N; ++i)
 	{
-		VkDeviceSize offset = i > 0 ? (offset = allocDetails.ranges[i - 1].first + allocDetails.ranges[i - 1].second) : 0;
-
-		allocDetails.ranges[i] = std::make_pair(UINT32_ALIGN(offset, rangeAlignment), sizes[i]);
+		allocDetails.ranges[i] = std::make_pair(offsets[i], sizes[i]);
 	}
 
-	allocDetails.totalRangeSize = allocDetails.ranges.back().first + allocDetails.ranges.back().second;
+	//The data is packed into the geometry buffers like resources into memory blocks
+	VkMemoryRequirements rangeRequirements = {};
+	rangeRequirements.size = allocDetails.totalRangeSize;
+	rangeRequirements.alignment = rangeAlignment;
 
-	VkBufferCreateInfo bufferCI = {};
-	bufferCI.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferCI.size = allocDetails.totalRangeSize;
-	bufferCI.usage = bufferUsage;
-	bufferCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	bufferCI.queueFamilyIndexCount = 0;
-	bufferCI.pQueueFamilyIndices = nullptr;
+	packIntoMemoryBlocks(rangeRequirements, maxBlockSize, blockSizes, allocDetails.memoryBlock, allocDetails.bufferOffset);
 
-	VK_CHECK(vkCreateBuffer(deviceHandle, &bufferCI, nullptr, &allocDetails.buffer));
+	return allocDetails;
+}
 
-	//Compute offset and alignment, and update memory type bits
-	VkMemoryRequirements memRequirements;
-	vkGetBufferMemoryRequirements(deviceHandle, allocDetails.buffer, &memRequirements);
+double secondsBetween(std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point end)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000000.0;
+}
 
-	allocDetails.pageOffset = UINT32_ALIGN(totalSceneSize, memRequirements.alignment);
-	allocDetails.actualSize = memRequirements.size;
+/**************************************/
+/*         Scene description          */
+/**************************************/
 
-	totalSceneSize = allocDetails.pageOffset + allocDetails.actualSize;
+struct SceneMesh
+{
+	uint32_t vertexCount;
+	uint32_t faceCount;
+	uint32_t materialIndex;
+};
 
-	//By ANDing the memory type bits of all the buffers together, we are
-	//keeping only the memory types that are supported by all buffers
-	mutualMemoryTypeBits &= memRequirements.memoryTypeBits;
+struct SceneMaterial
+{
+	//The index of the albedo texture into `SceneDescription::textureDecoders` (or -1)
+	uint32_t albedoTexture = (uint32_t)-1;
 
-	return allocDetails;
-}
+	//How the albedo texture is sampled outside of [0, 1]
+	TextureWrap wrapU = TextureWrap::Repeat;
+	TextureWrap wrapV = TextureWrap::Repeat;
+};
 
-void loadSceneGraph(const RaytracingDevice* device, const aiScene* scene, Scene& representation, std::vector<uint32_t>& materialIndices)
+struct SceneInstance
 {
-	/*
-	 ------------------------------
-			Note on alignemt
-	 ------------------------------
+	glm::mat4 transform;
+	uint32_t meshIndex;
 
-	 There are two alignemts that are of interest: 
-		1. VkPhysicalDeviceLimits::minStorageBufferOffsetAlignment
-		2. VkMemoryRequirements::alignment
+	//The node of the instance in `SceneAnimationData::nodes` (only set for animated scenes)
+	uint32_t nodeIndex = (uint32_t)-1;
 
-	 When allocating a buffer, its offset within the allocation it takes its memory from must be a multiple of
-	 `VkMemoryRequirements::alignment`.
+	//The instance's transform is animated or its mesh is deformed (see "Note on scene animation")
+	bool isDynamic = false;
+};
 
-	 When binding a range of a buffer to a descriptor of type VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, its offset
-	 within the buffer must be a multiple of `VkPhysicalDeviceLimits::minStorageBufferOffsetAlignment`.
-	 This means that range offsets do not also need to be aligned to `VkMemoryRequirements::alignment`.
-	*/
+struct DecodedTexture
+{
+	int width = 0;
+	int height = 0;
+	int channelCount = 0;
+	uint32_t mipLevelCount = 1;
+	TextureFormat format = TextureFormat::RGBA8;
 
-	//Parse meshes
-	std::vector<BLASCreateInfo> blasCreateInfos;
-	
-	VkDevice deviceHandle = device->getRenderDevice()->getDevice();
+	bool hasAlpha = false;
+
+	//Only built for textures with alpha of imported scenes (see "Note on triangle opacity")
+	std::shared_ptr<const AlphaMask> alphaMask = nullptr;
+
+	//All the levels of the mip chain, tightly packed
+	std::shared_ptr<uint8_t> textureData = nullptr;
+};
 
-	const VkBufferUsageFlags vertexBufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
-	const VkBufferUsageFlags indexBufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
-	const VkBufferUsageFlags stagingBufferUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+//Everything the loader needs to know about a scene, regardless of whether
+//it was imported with Assimp or read from the scene cache
+struct SceneDescription
+{
+	std::vector<SceneMesh> meshes;
 
-	const VkMemoryPropertyFlags vertexMemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-	const VkMemoryPropertyFlags indexMemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-	const VkMemoryPropertyFlags stagingMemoryProperty = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+	//The scene graph flattened into one entry per mesh instance
+	std::vector<SceneInstance> instances;
 
-	//Calculate total allocation size
-	VkDeviceSize totalSceneSize = 0;
-	VkDeviceSize rangeAlingment = device->getPhysicalDeviceLimits().minStorageBufferOffsetAlignment;
+	std::vector<SceneMaterial> materials;
 
-	std::vector<VertexBufferAllocDetails> vertexBufferRanges;
-	std::vector<IndexBufferAllocDetails> indexBufferRanges;
+	//Loads a unique texture. Called from worker threads, so they must not touch any Vulkan objects.
+	std::vector<std::function<bool(DecodedTexture&)>> textureDecoders;
 
-	uint32_t mutualMemoryTypeBits = 0xFFFFFFFF;
+	//Store normals and texture coordinates in 32 bits each (see `VertexConversion`)
+	bool compactVertices = false;
 
-	//Calculate details of vertex buffers
-	for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+	//Write the vertex and index data of a mesh to host memory, laid out according to the alloc details
+	std::function<void(uint32_t, uint8_t*, const VertexBufferAllocDetails&)> writeVertexData;
+	std::function<void(uint32_t, uint8_t*, const IndexBufferAllocDetails&)> writeIndexData;
+
+	//Hashes the data written for a mesh. Meshes with equal hashes (and sizes) share their buffers and BLAS.
+	std::function<uint64_t(uint32_t)> hashGeometry;
+
+	//How the triangles of each mesh were sorted when the scene was cooked (empty if they are classified while loading)
+	std::vector<TriangleOpacity> meshOpacity;
+
+	//The animation of the scene (or `nullptr` if the scene is static)
+	std::shared_ptr<const SceneAnimationData> animation = nullptr;
+
+	bool hasCamera = false;
+	glm::vec3 cameraPosition;
+	glm::quat cameraRotation;
+};
+
+/**************************************/
+/*       Load scene vertex data       */
+/**************************************/
+
+/*
+ ------------------------------
+	Note on shared geometry
+ ------------------------------
+
+ Scenes exported from CAD tools or put together from kits often contain many byte-identical copies of the
+ same mesh, each as a separate mesh rather than as instances of one. Meshes are grouped by the hash of their
+ vertex and index data, and only the first mesh of each group (the group's geometry) is uploaded and gets a
+ BLAS. `Scene::meshBuffers` has one entry per geometry, and every instance of a mesh references the BLAS of
+ its geometry, with the geometry index as its custom index. Materials are assigned per instance, so meshes
+ that only differ in their material still share geometry, unless the triangles of a mesh are sorted by the
+ alpha of its material (see "Note on triangle opacity").
+*/
+
+void findSharedGeometry(const SceneDescription& description, const std::vector<std::shared_ptr<const AlphaMask>>& materialAlphaMasks, std::vector<uint32_t>& meshGeometries, std::vector<uint32_t>& geometryMeshes)
+{
+	std::vector<uint64_t> hashes(description.meshes.size());
+
+	ThreadPool::global().parallelFor(description.meshes.size(), [&](size_t i)
 	{
-		const aiMesh* mesh = scene->mMeshes[i];
+		const SceneMesh& mesh = description.meshes[i];
 
-		VkDeviceSize sizes[3] = { mesh->mNumVertices * sizeof(glm::vec3),
-								  mesh->mNumVertices * sizeof(glm::vec2),
-								  mesh->mNumVertices * sizeof(glm::vec3) };
+		hashes[i] = Hash::combine(description.hashGeometry((uint32_t)i), ((uint64_t)mesh.vertexCount << 32) | mesh.faceCount);
 
-		vertexBufferRanges.push_back(createBufferAllocDetails<3>(deviceHandle, sizes, rangeAlingment, vertexBufferUsage, totalSceneSize, mutualMemoryTypeBits));
-	}
+		//Deformable meshes are written to by the animation, so they can't share their buffers
+		if (description.animation && description.animation->meshDeformables[i] != (uint32_t)-1)
+		{
+			hashes[i] = Hash::combine(hashes[i], Hash::value((uint64_t)i));
+		}
 
-	//Calculate details of index buffers
-	for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+		//The triangles of meshes with alpha masks are sorted by the opacity of their material's texture
+		if (materialAlphaMasks[mesh.materialIndex])
+		{
+			hashes[i] = Hash::combine(hashes[i], Hash::value((uint64_t)mesh.materialIndex));
+		}
+	});
+
+	std::unordered_map<uint64_t, uint32_t> geometryIndices;
+
+	meshGeometries.resize(description.meshes.size());
+
+	for (uint32_t i = 0; i < (uint32_t)description.meshes.size(); ++i)
 	{
-		const aiMesh* mesh = scene->mMeshes[i];
+		auto it = geometryIndices.emplace(hashes[i], (uint32_t)geometryMeshes.size()).first;
 
-		VkDeviceSize sizes[1] = { mesh->mNumFaces * (3 * sizeof(uint32_t)) };
+		if (it->second == geometryMeshes.size())
+		{
+			geometryMeshes.push_back(i);
+		}
 
-		indexBufferRanges.push_back(createBufferAllocDetails<1>(deviceHandle, sizes, rangeAlingment, vertexBufferUsage, totalSceneSize, mutualMemoryTypeBits));
+		meshGeometries[i] = it->second;
 	}
 
-	if (!mutualMemoryTypeBits)
+	if (geometryMeshes.size() < description.meshes.size())
 	{
-		FATAL_ERROR("Could not find memory type that supports all scene buffers");
+		std::cout << "Sharing geometry: " << description.meshes.size() << " meshes use " << geometryMeshes.size() << " unique geometries" << std::endl;
 	}
+}
 
-	//Allocate scene memory
-	uint32_t sceneMemTypeIndex = device->getRenderDevice()->findMemoryType(mutualMemoryTypeBits, vertexMemoryProperty);
+//Sorts the triangles of a converted mesh by opacity (see "Note on triangle opacity"). The texture
+//coordinates and indices are read back, so the mesh must have been converted into host memory.
+TriangleOpacity classifyMeshTriangles(const SceneMesh& mesh, const AlphaMask& mask, const SceneMaterial& material, bool compactVertices, const uint8_t* vertexMemory, uint8_t* indexMemory,
+									  const VertexBufferAllocDetails& vertexDetails, const IndexBufferAllocDetails& indexDetails)
+{
+	std::vector<glm::vec2> texCoords(mesh.vertexCount);
+
+	const uint8_t* texCoordMemory = vertexMemory + vertexDetails.ranges[1].first;
 
-	if (sceneMemTypeIndex == (uint32_t)-1)
+	if (compactVertices)
+	{
+		for (uint32_t i = 0; i < mesh.vertexCount; ++i)
+		{
+			texCoords[i] = glm::unpackHalf2x16(((const uint32_t*)texCoordMemory)[i]);
+		}
+	}
+	else
 	{
-		FATAL_ERROR("Could not find appropriate memory type for scene");
+		memcpy(texCoords.data(), texCoordMemory, mesh.vertexCount * sizeof(glm::vec2));
 	}
 
-	VkMemoryAllocateFlagsInfo memAllocFlags = {};
-	memAllocFlags.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
-	memAllocFlags.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+	size_t indexCount = 3 * (size_t)mesh.faceCount;
+	uint8_t* indexData = indexMemory + indexDetails.ranges[0].first;
 
-	VkMemoryAllocateInfo memAllocInfo = {};
-	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memAllocInfo.pNext = &memAllocFlags;
-	memAllocInfo.allocationSize = totalSceneSize;
-	memAllocInfo.memoryTypeIndex = sceneMemTypeIndex;
+	bool is16Bit = GeometryLayout::getIndexType(mesh.vertexCount) == VK_INDEX_TYPE_UINT16;
 
-	VkDeviceMemory sceneMemory = VK_NULL_HANDLE;
-	VK_CHECK(vkAllocateMemory(deviceHandle, &memAllocInfo, nullptr, &sceneMemory));
-	
-	//Allocate staging memory
-	Buffer stagingBuffer = device->getRenderDevice()->createBuffer(totalSceneSize, stagingBufferUsage, stagingMemoryProperty);
+	std::vector<uint32_t> indices(indexCount);
 
-	device->getRenderDevice()->executeCommands(1, [&](VkCommandBuffer* commandBuffers)
+	if (is16Bit)
 	{
-		for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
-		{
-			const aiMesh* mesh = scene->mMeshes[i];
+		std::copy((const uint16_t*)indexData, (const uint16_t*)indexData + indexCount, indices.begin());
+	}
+	else
+	{
+		memcpy(indices.data(), indexData, indexCount * sizeof(uint32_t));
+	}
+
+	TriangleOpacity opacity = OpacityClassifier::sortTriangles(mask, material.wrapU, material.wrapV, texCoords.data(), indices.data(), mesh.faceCount);
+
+	//The padding of 16-bit index data is left untouched
+	if (is16Bit)
+	{
+		std::transform(indices.begin(), indices.end(), (uint16_t*)indexData, [](uint32_t index) { return (uint16_t)index; });
+	}
+	else
+	{
+		memcpy(indexData, indices.data(), indexCount * sizeof(uint32_t));
+	}
 
-			const VertexBufferAllocDetails& vertexBufferDetails = vertexBufferRanges[i];
-			const IndexBufferAllocDetails& indexBufferDetails = indexBufferRanges[i];
+	return opacity;
+}
 
-			//Bind buffer memory
-			VK_CHECK(vkBindBufferMemory(deviceHandle, vertexBufferDetails.buffer, sceneMemory, vertexBufferDetails.pageOffset));
-			VK_CHECK(vkBindBufferMemory(deviceHandle, indexBufferDetails.buffer, sceneMemory, indexBufferDetails.pageOffset));
+void loadSceneGraph(const RaytracingDevice* device, const SceneDescription& description, Scene& representation, const SceneLoadOptions& options, const std::vector<std::shared_ptr<const AlphaMask>>& materialAlphaMasks,
+					StagingRing& stagingRing, SceneCacheWriter* cacheWriter, const std::string& blasCachePath, uint64_t sceneHash)
+{
+	auto uploadStart = std::chrono::high_resolution_clock::now();
 
-			//Write vertex data
-			void* memory = nullptr;
-			VK_CHECK(vkMapMemory(deviceHandle, stagingBuffer.memory, vertexBufferDetails.pageOffset, vertexBufferDetails.totalRangeSize, 0, &memory));
+	/*
+	 ------------------------------
+		Note on geometry buffers
+	 ------------------------------
 
-			glm::vec3* positionMemory = (glm::vec3*)((uint8_t*)memory + vertexBufferDetails.ranges[0].first);
-			glm::vec2* texCoordMemory = (glm::vec2*)((uint8_t*)memory + vertexBufferDetails.ranges[1].first);
-			glm::vec3* normalMemory = (glm::vec3*)((uint8_t*)memory + vertexBufferDetails.ranges[2].first);
+	 The vertex and index data of all meshes is packed into a few large geometry buffers (one per memory block, see
+	 "Note on scene memory") instead of giving every mesh buffers of its own. The hit shaders don't bind the buffers
+	 through descriptors, they read the device addresses of the hit mesh's data from its geometry record and access
+	 it with GL_EXT_buffer_reference. This way, the descriptor set doesn't grow with the number of meshes (which would
+	 run into maxPerStageDescriptorStorageBuffers) and large scenes don't create thousands of buffers.
 
-			for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
-			{
-				aiVector3D pos = mesh->mVertices[i];
-				positionMemory[i] = { pos.x, pos.y, pos.z };
-				
-				aiVector3D normal = mesh->mNormals[i];
-				normalMemory[i] = { normal.x, normal.y, normal.z };
+	 Every range is aligned to GEOMETRY_RANGE_ALIGNMENT, which covers the alignment that the acceleration structure
+	 builds require of vertex and index data, as well as the alignment of the buffer references in the shaders.
+	*/
 
-				aiVector3D texCoords = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0][i] : aiVector3D(0, 0, 0);
-				texCoordMemory[i] = { texCoords.x, texCoords.y };
-			}
+	//Parse meshes
+	const VkBufferUsageFlags geometryBufferUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
+	const VkMemoryPropertyFlags geometryMemoryProperty = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
 
-			vkUnmapMemory(deviceHandle, stagingBuffer.memory);
+	//Calculate the sizes of the geometry buffers (see "Note on scene memory")
+	VkDeviceSize maxBlockSize = std::min<VkDeviceSize>(SCENE_MEMORY_BLOCK_SIZE, device->getMaxMemoryAllocationSize());
+	std::vector<VkDeviceSize> geometryBufferSizes;
 
-			//Write index data
-			VK_CHECK(vkMapMemory(deviceHandle, stagingBuffer.memory, indexBufferDetails.pageOffset, indexBufferDetails.totalRangeSize, 0, &memory));
+	std::vector<VertexBufferAllocDetails> vertexBufferRanges;
+	std::vector<IndexBufferAllocDetails> indexBufferRanges;
 
-			unsigned int* indexMemory = (unsigned int*)((uint8_t*)memory + indexBufferDetails.ranges[0].first);
-			for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
-			{
-				assert(mesh->mFaces[i].mNumIndices == 3);
+	//Find meshes with identical geometry
+	std::vector<uint32_t> meshGeometries;
+	std::vector<uint32_t> geometryMeshes;
 
-				indexMemory[3 * i] = mesh->mFaces[i].mIndices[0];
-				indexMemory[3 * i + 1] = mesh->mFaces[i].mIndices[1];
-				indexMemory[3 * i + 2] = mesh->mFaces[i].mIndices[2];
-			}
+	findSharedGeometry(description, materialAlphaMasks, meshGeometries, geometryMeshes);
 
-			vkUnmapMemory(deviceHandle, stagingBuffer.memory);
+	//Host builds read the geometry from host memory, so a copy of the converted meshes is kept until the BLASes are built
+	BLASBuildMode blasBuildMode = options.blasBuildMode;
 
-			//Create BLAS for mesh
-			BLASCreateInfo blasCI = {};
-			blasCI.geometryInfo = device->compileGeometry(vertexBufferDetails.buffer, sizeof(glm::vec3), mesh->mNumVertices, indexBufferDetails.buffer, mesh->mNumFaces, { 0 }, 0);
-			blasCI.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+	if (blasBuildMode == BLASBuildMode::Host && !device->isHostBuildSupported())
+	{
+		std::cout << "Host acceleration structure builds are not supported, using batched device builds" << std::endl;
+		blasBuildMode = BLASBuildMode::Batched;
+	}
 
-			blasCreateInfos.push_back(blasCI);
+	//The BLASes of deformable meshes are refitted on the device, from the deformed positions in the geometry buffers
+	bool hasDeformableMeshes = description.animation && !description.animation->deformableMeshes.empty();
 
-			representation.meshBuffers.push_back({
-				vertexBufferDetails.buffer,
-				vertexBufferDetails.ranges[0],
-				vertexBufferDetails.ranges[1],
-				vertexBufferDetails.ranges[2],
+	if (blasBuildMode == BLASBuildMode::Host && hasDeformableMeshes)
+	{
+		std::cout << "Scene has deformable meshes, using batched device builds instead of host builds" << std::endl;
+		blasBuildMode = BLASBuildMode::Batched;
+	}
 
-				indexBufferDetails.buffer,
-				indexBufferDetails.ranges[0].first,
-				indexBufferDetails.ranges[0].second
-			});
+	bool keepHostGeometry = blasBuildMode == BLASBuildMode::Host || (options.benchmarkBLASBuilds && device->isHostBuildSupported());
+	bool convertOnHost = cacheWriter || keepHostGeometry;
 
-			//Record copy commands
-			VkBufferCopy copyRegion = { vertexBufferDetails.pageOffset, 0, vertexBufferDetails.totalRangeSize };
-			vkCmdCopyBuffer(commandBuffers[0], stagingBuffer.buffer, vertexBufferDetails.buffer, 1, &copyRegion);
+	std::vector<std::vector<uint8_t>> hostGeometry(geometryMeshes.size());
 
-			copyRegion = { indexBufferDetails.pageOffset, 0, indexBufferDetails.totalRangeSize };
-			vkCmdCopyBuffer(commandBuffers[0], stagingBuffer.buffer, indexBufferDetails.buffer, 1, &copyRegion);
-		}
-	});
+	//Calculate details of vertex buffers
+	for (uint32_t meshIndex : geometryMeshes)
+	{
+		const SceneMesh& mesh = description.meshes[meshIndex];
 
-	//Free staging buffers
-	device->getRenderDevice()->destroyBuffer(stagingBuffer);
+		VkDeviceSize sizes[3];
+		GeometryLayout::getVertexRangeSizes(mesh.vertexCount, description.compactVertices, sizes);
 
-	representation.meshMemory = sceneMemory;
+		vertexBufferRanges.push_back(createBufferAllocDetails<3>(sizes, GEOMETRY_RANGE_ALIGNMENT, maxBlockSize, geometryBufferSizes));
+	}
 
-	//Build BLAS
-	BLASBuildResult buildResult = device->buildBLAS(blasCreateInfos);
+	//Calculate details of index buffers
+	for (uint32_t meshIndex : geometryMeshes)
+	{
+		const SceneMesh& mesh = description.meshes[meshIndex];
 
-	//Parse scene graph
-	std::vector<VkAccelerationStructureInstanceKHR> accelStructInstances;
+		VkDeviceSize sizes[1] = { GeometryLayout::getIndexDataSize(mesh.vertexCount, mesh.faceCount) };
 
-	parseSceneGraphNode(device, accelStructInstances, buildResult, scene, scene->mRootNode, glm::identity<glm::mat4>(), materialIndices, representation.isMaterialOpaque);
+		indexBufferRanges.push_back(createBufferAllocDetails<1>(sizes, GEOMETRY_RANGE_ALIGNMENT, maxBlockSize, geometryBufferSizes));
+	}
 
-	//Build TLAS
-	TopLevelAS tlas;
-	tlas.init(device);
+	//Create the geometry buffers
+	for (VkDeviceSize bufferSize : geometryBufferSizes)
+	{
+		representation.geometryBuffers.push_back(device->getRenderDevice()->createBuffer(bufferSize, geometryBufferUsage, geometryMemoryProperty));
+	}
 
-	device->buildTLAS(tlas, accelStructInstances, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+	/*
+	 ------------------------------
+		Note on mesh conversion
+	 ------------------------------
 
-	representation.blasBuildResult = std::move(buildResult);
-	representation.tlas = std::move(tlas);
-}
+	 Meshes are converted in batches on the thread pool. For each batch, staging memory is reserved for
+	 as many meshes as fit into the current segment of the staging ring, every mesh is converted directly
+	 into its staging memory in parallel and then the copies are recorded. The batch is cut short rather than
+	 letting the ring submit the segment, since that would invalidate the memory the workers are writing to.
 
-/**************************************/
-/*        Load scene materials        */
-/**************************************/
+	 Meshes that don't fit into a segment on their own are uploaded one at a time through `uploadBuffer`.
+	 When the scene is being cooked, the meshes are converted into host memory instead (staging memory can
+	 be very slow to read back from), so that they can also be written to the cache. The same is done for
+	 host BLAS builds, which keep the converted meshes around until the builds are done.
+	*/
+	ThreadPool& threadPool = ThreadPool::global();
 
-bool loadMaterialTexture(const aiScene* scene, const char* scenePath, const aiMaterial* material, aiTextureType textureType, int index, std::shared_ptr<uint8_t>& output, int& width, int& height, int& channelCount)
-{
-	//Get texture path
-	aiString name;
-	if (material->Get(AI_MATKEY_TEXTURE(textureType, index), name) != AI_SUCCESS)
+	//The opacity of each geometry's triangles, if they are sorted by it (see "Note on triangle opacity")
+	std::vector<TriangleOpacity> geometryOpacity(geometryMeshes.size());
+
+	for (uint32_t i = 0; i < (uint32_t)geometryMeshes.size() && !description.meshOpacity.empty(); ++i)
 	{
-		//Material doesn't have the texture requested
-		return false;
+		geometryOpacity[i] = description.meshOpacity[geometryMeshes[i]];
 	}
 
-	//TODO: Load duplicate textures only once
-
-	//Load texture data
-	const aiTexture* texture = nullptr;
-	if (texture = scene->GetEmbeddedTexture(name.C_Str()))
+	//Writes the data of a geometry and classifies its triangles if its material has an alpha mask. Staging
+	//memory is slow to read back from, so those meshes are converted into host memory first.
+	auto convertMesh = [&](uint32_t geometryIndex, uint8_t* vertexMemory, uint8_t* indexMemory, bool isHostMemory)
 	{
-		if (texture->mHeight == 0) //Texture is compressed
-		{
-			int numChannels;
+		uint32_t meshIndex = geometryMeshes[geometryIndex];
+		const SceneMesh& mesh = description.meshes[meshIndex];
 
-			//STB will try to detect the image type automatically so, there is no need to use 'texture->achFormatHint'
-			stbi_uc* imageMemory = stbi_load_from_memory((const stbi_uc*)texture->pcData, texture->mWidth, &width, &height, &numChannels, 4);
+		const VertexBufferAllocDetails& vertexDetails = vertexBufferRanges[geometryIndex];
+		const IndexBufferAllocDetails& indexDetails = indexBufferRanges[geometryIndex];
 
-			if (!imageMemory)
-			{
-				std::cerr << "Unable to load texture (format='" << texture->achFormatHint << "', index=" << index << ") from material '" << material->GetName().C_Str() <<"'" << std::endl;
-				return false;
-			}
+		const AlphaMask* alphaMask = materialAlphaMasks[mesh.materialIndex].get();
 
-			output = std::shared_ptr<uint8_t>((uint8_t*)imageMemory, stbi_image_free);
-		}
-		else
+		if (!alphaMask)
 		{
-			width = texture->mWidth;
-			height = texture->mHeight;
-
-			size_t textureSize = 4 * (size_t)width * height;
-			output = std::shared_ptr<uint8_t>((uint8_t*)malloc(textureSize), free);
+			description.writeVertexData(meshIndex, vertexMemory, vertexDetails);
+			description.writeIndexData(meshIndex, indexMemory, indexDetails);
 
-			memcpy(output.get(), texture->pcData, textureSize);
+			return;
 		}
-	}
-	else
-	{
-		std::filesystem::path path(Resources::resolvePath(name.C_Str()));
 
-		if (path.is_relative())
+		std::vector<uint8_t> hostMemory;
+
+		uint8_t* hostVertexMemory = vertexMemory;
+		uint8_t* hostIndexMemory = indexMemory;
+
+		if (!isHostMemory)
 		{
-			path = std::filesystem::path(scenePath).replace_filename(path);
+			hostMemory.resize(vertexDetails.totalRangeSize + indexDetails.totalRangeSize);
+
+			hostVertexMemory = hostMemory.data();
+			hostIndexMemory = hostVertexMemory + vertexDetails.totalRangeSize;
 		}
 
-		std::string pathString = path.string();
+		description.writeVertexData(meshIndex, hostVertexMemory, vertexDetails);
+		description.writeIndexData(meshIndex, hostIndexMemory, indexDetails);
 
-		int numChannels;
-		stbi_uc* imageMemory = stbi_load(pathString.c_str(), &width, &height, &numChannels, 4);
+		geometryOpacity[geometryIndex] = classifyMeshTriangles(mesh, *alphaMask, description.materials[mesh.materialIndex], description.compactVertices, hostVertexMemory, hostIndexMemory, vertexDetails, indexDetails);
 
-		if (!imageMemory)
+		if (!isHostMemory)
 		{
-			std::cerr << "Unable to load texture '" << name.C_Str() << "' from material '" << material->GetName().C_Str() << "'" << std::endl;
-			return false;
+			memcpy(vertexMemory, hostVertexMemory, vertexDetails.totalRangeSize);
+			memcpy(indexMemory, hostIndexMemory, indexDetails.totalRangeSize);
 		}
+	};
 
-		output = std::shared_ptr<uint8_t>((uint8_t*)imageMemory, stbi_image_free);
-	}
+	uint32_t geometryIndex = 0;
+	while (geometryIndex < (uint32_t)geometryMeshes.size())
+	{
+		const VertexBufferAllocDetails& firstVertexDetails = vertexBufferRanges[geometryIndex];
+		const IndexBufferAllocDetails& firstIndexDetails = indexBufferRanges[geometryIndex];
 
-	channelCount = 4;
+		VkDeviceSize firstMeshSize = UINT32_ALIGN(firstVertexDetails.totalRangeSize, 16) + firstIndexDetails.totalRangeSize;
 
-	return true;
-}
+		if (!convertOnHost && firstMeshSize > stagingRing.getMaxAllocationSize())
+		{
+			uint32_t i = geometryMeshes[geometryIndex];
 
-struct ImageAllocDetails
-{
-	VkImage image;
-	VkImageView imageView;
-	VkSampler sampler;
+			if (materialAlphaMasks[description.meshes[i].materialIndex])
+			{
+				std::vector<uint8_t> hostMemory(firstVertexDetails.totalRangeSize + firstIndexDetails.totalRangeSize);
 
-	VkFormat imageFormat;
+				convertMesh(geometryIndex++, hostMemory.data(), hostMemory.data() + firstVertexDetails.totalRangeSize, true);
 
-	//The offset of the image within the allocation it takes its memory from
-	VkDeviceSize pageOffset;
+				stagingRing.uploadBuffer(representation.geometryBuffers[firstVertexDetails.memoryBlock].buffer, firstVertexDetails.bufferOffset, hostMemory.data(), firstVertexDetails.totalRangeSize);
+				stagingRing.uploadBuffer(representation.geometryBuffers[firstIndexDetails.memoryBlock].buffer, firstIndexDetails.bufferOffset, hostMemory.data() + firstVertexDetails.totalRangeSize, firstIndexDetails.totalRangeSize);
 
-	//The actual size of the image (as returned by `vkGetBufferMemoryRequirements`)
-	VkDeviceSize actualSize;
+				continue;
+			}
 
-	//The smallest amount of memory it would take to store
-	//all the pixels of the imported image (width * height * channels * bytes_per_channel)
-	VkDeviceSize baseSize;
+			geometryIndex++;
 
-	int width;
-	int height;
-	std::shared_ptr<uint8_t> textureData;
-};
+			stagingRing.uploadBuffer(representation.geometryBuffers[firstVertexDetails.memoryBlock].buffer, firstVertexDetails.bufferOffset, firstVertexDetails.totalRangeSize, [&](uint8_t* memory)
+			{
+				description.writeVertexData(i, memory, firstVertexDetails);
+			});
 
-bool pushTexture(const RaytracingDevice* device, const char* scenePath, const aiScene* scene, std::vector<ImageAllocDetails>& imageAllocDetails, int materialIndex, aiTextureType textureType, uint32_t& textureIndex)
-{
-	VkPhysicalDevice physicalDeviceHandle = device->getRenderDevice()->getPhysicalDevice();
-	VkDevice deviceHandle = device->getRenderDevice()->getDevice();
+			stagingRing.uploadBuffer(representation.geometryBuffers[firstIndexDetails.memoryBlock].buffer, firstIndexDetails.bufferOffset, firstIndexDetails.totalRangeSize, [&](uint8_t* memory)
+			{
+				description.writeIndexData(i, memory, firstIndexDetails);
+			});
 
-	int width = 0;
-	int height = 0;
-	int channelCount = 0;
-	std::shared_ptr<uint8_t> textureData = nullptr;
+			continue;
+		}
 
-	bool hasAlpha = false;
+		struct StagedMesh
+		{
+			uint32_t geometryIndex;
 
-	if (loadMaterialTexture(scene, scenePath, scene->mMaterials[materialIndex], textureType, 0, textureData, width, height, channelCount))
-	{
-		//Check if texture has alpha
-		uint32_t* pixelPointer = (uint32_t*)textureData.get();
+			uint8_t* vertexMemory;
+			uint8_t* indexMemory;
+
+			VkDeviceSize bufferOffset;
+		};
+
+		std::vector<StagedMesh> batch;
+
+		VkDeviceSize batchSize = 0;
 
-		for (int y = 0; y < height && !hasAlpha; ++y)
+		for (; geometryIndex < (uint32_t)geometryMeshes.size(); ++geometryIndex)
 		{
-			for (int x = 0; x < width; ++x)
+			VkDeviceSize vertexSize = vertexBufferRanges[geometryIndex].totalRangeSize;
+			VkDeviceSize meshSize = UINT32_ALIGN(vertexSize, 16) + indexBufferRanges[geometryIndex].totalRangeSize;
+
+			StagedMesh staged = { geometryIndex, nullptr, nullptr, 0 };
+
+			if (convertOnHost)
 			{
-				if (((pixelPointer[y * width + x] >> 24) & 0xFF) != 0xFF)
+				//Bound the amount of host memory used at once
+				if (!batch.empty() && batchSize + meshSize > stagingRing.getMaxAllocationSize())
 				{
-					hasAlpha = true;
 					break;
 				}
-			}
-		}
 
-		ImageAllocDetails allocDetails = {};
-		allocDetails.width = width;
-		allocDetails.height = height;
-		allocDetails.textureData = textureData;
-		allocDetails.baseSize = width * height * channelCount;
-
-		allocDetails.imageFormat = VK_FORMAT_R8G8B8A8_UNORM;
-
-		//Create image
-		VkImageCreateInfo imageCI = {};
-		imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-		imageCI.imageType = VK_IMAGE_TYPE_2D;
-		imageCI.format = allocDetails.imageFormat;
-		imageCI.extent = { (uint32_t)width, (uint32_t)height, 1 };
-		imageCI.mipLevels = 1;
-		imageCI.arrayLayers = 1;
-		imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
-		imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-		imageCI.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-		imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		imageCI.queueFamilyIndexCount = 0;
-		imageCI.pQueueFamilyIndices = nullptr;
-		imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		
-		VK_CHECK(vkCreateImage(deviceHandle, &imageCI, nullptr, &allocDetails.image));
-
-		//Create sampler
-		VkSamplerCreateInfo samplerCI = {};
-		samplerCI.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-		samplerCI.magFilter = VK_FILTER_LINEAR;
-		samplerCI.minFilter = VK_FILTER_LINEAR;
-		samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-		samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-		samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-		samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-		samplerCI.mipLodBias = 0.0f;
-		samplerCI.anisotropyEnable = VK_FALSE;
-		samplerCI.maxAnisotropy = 1.0f;
-		samplerCI.compareEnable = VK_FALSE;
-		samplerCI.compareOp = VK_COMPARE_OP_NEVER;
-		samplerCI.minLod = 0.0f;
-		samplerCI.maxLod = 1.0f;
-		samplerCI.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-		samplerCI.unnormalizedCoordinates = VK_FALSE;
-
-		VK_CHECK(vkCreateSampler(deviceHandle, &samplerCI, nullptr, &allocDetails.sampler));
-
-		textureIndex = (uint32_t)imageAllocDetails.size();
-		imageAllocDetails.push_back(allocDetails);
+				hostGeometry[geometryIndex].resize(meshSize);
+
+				staged.vertexMemory = hostGeometry[geometryIndex].data();
+			}
+			else
+			{
+				//Only the first mesh of a batch may start a new segment
+				if (meshSize > stagingRing.getMaxAllocationSize() || (!batch.empty() && !stagingRing.canAllocate(meshSize, 16)))
+				{
+					break;
+				}
+
+				staged.vertexMemory = stagingRing.allocate(meshSize, 16, staged.bufferOffset);
+			}
+
+			staged.indexMemory = staged.vertexMemory + UINT32_ALIGN(vertexSize, 16);
+
+			batch.push_back(staged);
+			batchSize += meshSize;
+		}
+
+		threadPool.parallelFor(batch.size(), [&](size_t i)
+		{
+			const StagedMesh& staged = batch[i];
+
+			convertMesh(staged.geometryIndex, staged.vertexMemory, staged.indexMemory, convertOnHost);
+		});
+
+		for (const StagedMesh& staged : batch)
+		{
+			uint32_t meshIndex = geometryMeshes[staged.geometryIndex];
+			const SceneMesh& mesh = description.meshes[meshIndex];
+
+			const VertexBufferAllocDetails& vertexBufferDetails = vertexBufferRanges[staged.geometryIndex];
+			const IndexBufferAllocDetails& indexBufferDetails = indexBufferRanges[staged.geometryIndex];
+
+			VkBuffer vertexBuffer = representation.geometryBuffers[vertexBufferDetails.memoryBlock].buffer;
+			VkBuffer indexBuffer = representation.geometryBuffers[indexBufferDetails.memoryBlock].buffer;
+
+			if (convertOnHost)
+			{
+				if (cacheWriter)
+				{
+					cacheWriter->writeMesh(meshIndex, mesh.vertexCount, mesh.faceCount, mesh.materialIndex, geometryOpacity[staged.geometryIndex], staged.vertexMemory, vertexBufferDetails.totalRangeSize, staged.indexMemory, indexBufferDetails.totalRangeSize);
+				}
+
+				stagingRing.uploadBuffer(vertexBuffer, vertexBufferDetails.bufferOffset, staged.vertexMemory, vertexBufferDetails.totalRangeSize);
+				stagingRing.uploadBuffer(indexBuffer, indexBufferDetails.bufferOffset, staged.indexMemory, indexBufferDetails.totalRangeSize);
+
+				if (!keepHostGeometry)
+				{
+					std::vector<uint8_t>().swap(hostGeometry[staged.geometryIndex]);
+				}
+			}
+			else
+			{
+				VkDeviceSize indexOffset = staged.bufferOffset + (staged.indexMemory - staged.vertexMemory);
+
+				stagingRing.copyToBuffer(staged.bufferOffset, vertexBuffer, vertexBufferDetails.bufferOffset, vertexBufferDetails.totalRangeSize);
+				stagingRing.copyToBuffer(indexOffset, indexBuffer, indexBufferDetails.bufferOffset, indexBufferDetails.totalRangeSize);
+			}
+		}
+	}
+
+	//Meshes that share their geometry with an earlier mesh reference its cooked data
+	if (cacheWriter)
+	{
+		for (uint32_t i = 0; i < (uint32_t)description.meshes.size(); ++i)
+		{
+			uint32_t sourceMeshIndex = geometryMeshes[meshGeometries[i]];
+
+			if (sourceMeshIndex != i)
+			{
+				cacheWriter->writeSharedMesh(i, sourceMeshIndex, description.meshes[i].materialIndex);
+			}
+		}
+	}
+
+	for (uint32_t i = 0; i < (uint32_t)geometryMeshes.size(); ++i)
+	{
+		const VertexBufferAllocDetails& vertexBufferDetails = vertexBufferRanges[i];
+		const IndexBufferAllocDetails& indexBufferDetails = indexBufferRanges[i];
+
+		VkDeviceAddress vertexAddress = device->getRenderDevice()->getBufferAddress(representation.geometryBuffers[vertexBufferDetails.memoryBlock].buffer) + vertexBufferDetails.bufferOffset;
+		VkDeviceAddress indexAddress = device->getRenderDevice()->getBufferAddress(representation.geometryBuffers[indexBufferDetails.memoryBlock].buffer) + indexBufferDetails.bufferOffset;
+
+		representation.meshBuffers.push_back({
+			vertexAddress + vertexBufferDetails.ranges[0].first,
+			vertexAddress + vertexBufferDetails.ranges[1].first,
+			vertexAddress + vertexBufferDetails.ranges[2].first,
+
+			indexAddress + indexBufferDetails.ranges[0].first,
+			GeometryLayout::getIndexType(description.meshes[geometryMeshes[i]].vertexCount)
+		});
+	}
+
+	//A range of a geometry's triangles that is put into a BLAS as one of its geometries
+	struct BLASGeometry
+	{
+		uint32_t geometryIndex;
+		uint32_t firstFace;
+		uint32_t faceCount;
+		VkGeometryFlagsKHR flags;
+	};
+
+	auto compileMeshGeometry = [&](const BLASGeometry& blasGeometry, bool onHost)
+	{
+		const SceneMesh& mesh = description.meshes[geometryMeshes[blasGeometry.geometryIndex]];
+		const MeshBuffers& buffers = representation.meshBuffers[blasGeometry.geometryIndex];
+
+		std::shared_ptr<const BLASGeometryInfo> geometryInfo = nullptr;
+
+		if (onHost)
+		{
+			//The positions are at the start of the vertex data, which is followed by the index data
+			const uint8_t* vertexData = hostGeometry[blasGeometry.geometryIndex].data();
+			const uint8_t* indexData = vertexData + UINT32_ALIGN(vertexBufferRanges[blasGeometry.geometryIndex].totalRangeSize, 16);
+
+			geometryInfo = device->compileHostGeometry(vertexData, sizeof(glm::vec3), mesh.vertexCount, indexData, buffers.indexType, mesh.faceCount, blasGeometry.flags);
+		}
+		else
+		{
+			geometryInfo = device->compileGeometry(buffers.positionAddress, sizeof(glm::vec3), mesh.vertexCount, buffers.indexAddress, buffers.indexType, mesh.faceCount, { 0 }, blasGeometry.flags);
+		}
+
+		//Restrict the geometry to its range of triangles
+		VkDeviceSize indexSize = buffers.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+		VkAccelerationStructureBuildRangeInfoKHR rangeInfo = geometryInfo->rangeInfoArray[0];
+		rangeInfo.primitiveOffset = (uint32_t)(blasGeometry.firstFace * 3 * indexSize);
+		rangeInfo.primitiveCount = blasGeometry.faceCount;
+
+		return std::make_pair(geometryInfo->geometryArray[0], rangeInfo);
+	};
+
+	auto createGeometryRecord = [&](const BLASGeometry& blasGeometry, uint32_t materialIndex)
+	{
+		const MeshBuffers& buffers = representation.meshBuffers[blasGeometry.geometryIndex];
+
+		uint32_t flags = buffers.indexType == VK_INDEX_TYPE_UINT16 ? MESH_FLAG_16_BIT_INDICES : 0;
+
+		return GeometryRecord{ buffers.positionAddress, buffers.normalAddress, buffers.texCoordAddress, buffers.indexAddress, materialIndex, flags, blasGeometry.firstFace, 0 };
+	};
+
+	//The BLAS geometries of a mesh. Meshes whose triangles were classified get an opaque and a mixed geometry (and none if
+	//all their triangles are transparent), the others a single geometry with `unclassifiedFlags` (see "Note on triangle opacity").
+	auto getBLASGeometries = [&](uint32_t geometryIndex, VkGeometryFlagsKHR unclassifiedFlags)
+	{
+		const TriangleOpacity& opacity = geometryOpacity[geometryIndex];
+
+		std::vector<BLASGeometry> geometries;
+
+		if (!opacity.isClassified)
+		{
+			geometries.push_back({ geometryIndex, 0, description.meshes[geometryMeshes[geometryIndex]].faceCount, unclassifiedFlags });
+			return geometries;
+		}
+
+		if (opacity.opaqueFaceCount > 0)
+		{
+			geometries.push_back({ geometryIndex, 0, opacity.opaqueFaceCount, VK_GEOMETRY_OPAQUE_BIT_KHR });
+		}
+
+		if (opacity.mixedFaceCount > 0)
+		{
+			geometries.push_back({ geometryIndex, opacity.opaqueFaceCount, opacity.mixedFaceCount, 0 });
+		}
+
+		return geometries;
+	};
+
+	/*
+	 ------------------------------
+		Note on merged meshes
+	 ------------------------------
+
+	 Every TLAS instance references a range of geometry records, starting at its custom index. The hit shaders
+	 read the record at `gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT`, which holds the addresses of the mesh data,
+	 the material and the first triangle of the hit geometry.
+
+	 An instance of a single mesh uses the BLAS of the mesh's geometry and records that are shared by all instances
+	 with the same geometry and material. Opacity is forced through the instance flags, unless the mesh's triangles
+	 were classified, in which case its BLAS has an opaque and a mixed geometry (see "Note on triangle opacity").
+
+	 Scenes with lots of tiny meshes spend most of the traversal in the TLAS. When merging is enabled, consecutive
+	 small meshes of the same scene graph node (which have the same transform) are put into a single BLAS with the
+	 geometries of every mesh instead, which is used by a single TLAS instance. The records of its geometries are
+	 allocated consecutively, and opacity is set per geometry.
+
+	 The BLASes are recorded as lists of `BLASGeometry`, so that they can be compiled for either device or host
+	 builds afterwards.
+	*/
+	std::vector<GeometryRecord> geometryRecords;
+	std::map<std::pair<uint32_t, uint32_t>, uint32_t> sharedRecordIndices;
+
+	std::vector<uint32_t> geometryBLASIndices(geometryMeshes.size(), (uint32_t)-1);
+	std::vector<std::vector<BLASGeometry>> blasGeometries;
+	std::vector<VkBuildAccelerationStructureFlagsKHR> blasBuildFlags;
+
+	//The (deformable mesh, BLAS) pairs and the (TLAS instance, node) pairs of dynamic instances
+	std::vector<std::pair<uint32_t, uint32_t>> deformableBLASes;
+	std::vector<std::pair<uint32_t, uint32_t>> animatedInstances;
+
+	struct SceneTLASInstance
+	{
+		glm::mat4 transform;
+		uint32_t blasIndex;
+		uint32_t firstRecord;
+		VkGeometryInstanceFlagsKHR flags;
+	};
+
+	std::vector<SceneTLASInstance> tlasInstances;
+
+	const VkBuildAccelerationStructureFlagsKHR blasFlags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+
+	//Deformable BLASes are refitted every frame and rebuilt in place (so they can't be compacted)
+	const VkBuildAccelerationStructureFlagsKHR deformableBLASFlags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+
+	auto canMerge = [&](size_t instanceIndex)
+	{
+		const SceneInstance& instance = description.instances[instanceIndex];
+
+		return options.mergeSmallMeshes && !instance.isDynamic && description.meshes[instance.meshIndex].faceCount <= MERGED_MESH_MAX_FACE_COUNT;
+	};
+
+	uint32_t mergedMeshCount = 0;
+	uint32_t mergedBLASCount = 0;
+
+	uint32_t transparentInstanceCount = 0;
+
+	for (size_t first = 0; first < description.instances.size();)
+	{
+		const SceneInstance& firstInstance = description.instances[first];
+
+		//Find the run of small meshes that share the transform of the first one
+		size_t end = first + 1;
+
+		if (canMerge(first))
+		{
+			while (end < description.instances.size() && end - first < MERGED_MESH_MAX_GEOMETRY_COUNT && canMerge(end) && description.instances[end].transform == firstInstance.transform)
+			{
+				end++;
+			}
+		}
+
+		if (end - first == 1)
+		{
+			uint32_t materialIndex = description.meshes[firstInstance.meshIndex].materialIndex;
+			uint32_t geometryIndex = meshGeometries[firstInstance.meshIndex];
+
+			uint32_t deformableIndex = description.animation ? description.animation->meshDeformables[firstInstance.meshIndex] : (uint32_t)-1;
+
+			std::vector<BLASGeometry> geometries = getBLASGeometries(geometryIndex, 0);
+
+			//Instances whose triangles are all transparent can never be hit
+			if (geometries.empty())
+			{
+				transparentInstanceCount++;
+
+				first = end;
+				continue;
+			}
+
+			//Create BLAS for geometry
+			if (geometryBLASIndices[geometryIndex] == (uint32_t)-1)
+			{
+				geometryBLASIndices[geometryIndex] = (uint32_t)blasGeometries.size();
+				blasGeometries.push_back(geometries);
+				blasBuildFlags.push_back(deformableIndex != (uint32_t)-1 ? deformableBLASFlags : blasFlags);
+
+				if (deformableIndex != (uint32_t)-1)
+				{
+					deformableBLASes.push_back(std::make_pair(deformableIndex, geometryBLASIndices[geometryIndex]));
+				}
+			}
+
+			auto it = sharedRecordIndices.emplace(std::make_pair(geometryIndex, materialIndex), (uint32_t)geometryRecords.size()).first;
+
+			if (it->second == geometryRecords.size())
+			{
+				for (const BLASGeometry& geometry : geometries)
+				{
+					geometryRecords.push_back(createGeometryRecord(geometry, materialIndex));
+				}
+			}
+
+			//Compute geometry flags (classified geometries set their opacity themselves)
+			VkGeometryInstanceFlagsKHR flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+
+			if (!geometryOpacity[geometryIndex].isClassified)
+			{
+				flags |= representation.isMaterialOpaque[materialIndex] ? VK_GEOMETRY_INSTANCE_FORCE_OPAQUE_BIT_KHR : VK_GEOMETRY_INSTANCE_FORCE_NO_OPAQUE_BIT_KHR;
+			}
+
+			if (firstInstance.isDynamic && description.animation->nodes[firstInstance.nodeIndex].isAnimated)
+			{
+				animatedInstances.push_back(std::make_pair((uint32_t)tlasInstances.size(), firstInstance.nodeIndex));
+			}
+
+			tlasInstances.push_back({ firstInstance.transform, geometryBLASIndices[geometryIndex], it->second, flags });
+		}
+		else
+		{
+			std::vector<BLASGeometry> geometries;
+
+			uint32_t firstRecord = (uint32_t)geometryRecords.size();
+
+			for (size_t i = first; i < end; ++i)
+			{
+				uint32_t meshIndex = description.instances[i].meshIndex;
+				uint32_t materialIndex = description.meshes[meshIndex].materialIndex;
+
+				VkGeometryFlagsKHR flags = representation.isMaterialOpaque[materialIndex] ? VK_GEOMETRY_OPAQUE_BIT_KHR : 0;
+
+				for (const BLASGeometry& geometry : getBLASGeometries(meshGeometries[meshIndex], flags))
+				{
+					geometries.push_back(geometry);
+					geometryRecords.push_back(createGeometryRecord(geometry, materialIndex));
+				}
+			}
+
+			if (geometries.empty())
+			{
+				transparentInstanceCount += (uint32_t)(end - first);
+
+				first = end;
+				continue;
+			}
+
+			tlasInstances.push_back({ firstInstance.transform, (uint32_t)blasGeometries.size(), firstRecord, VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR });
+			blasGeometries.push_back(std::move(geometries));
+			blasBuildFlags.push_back(blasFlags);
+
+			mergedMeshCount += (uint32_t)(end - first);
+			mergedBLASCount++;
+		}
+
+		first = end;
+	}
+
+	if (mergedBLASCount > 0)
+	{
+		std::cout << "Merged " << mergedMeshCount << " small meshes into " << mergedBLASCount << " multi-geometry BLASes" << std::endl;
+	}
+
+	uint64_t classifiedFaceCounts[3] = {};
+
+	for (uint32_t i = 0; i < (uint32_t)geometryMeshes.size(); ++i)
+	{
+		const TriangleOpacity& opacity = geometryOpacity[i];
+
+		if (opacity.isClassified)
+		{
+			classifiedFaceCounts[0] += opacity.opaqueFaceCount;
+			classifiedFaceCounts[1] += opacity.mixedFaceCount;
+			classifiedFaceCounts[2] += description.meshes[geometryMeshes[i]].faceCount - opacity.opaqueFaceCount - opacity.mixedFaceCount;
+		}
+	}
+
+	if (classifiedFaceCounts[0] + classifiedFaceCounts[1] + classifiedFaceCounts[2] > 0)
+	{
+		std::cout << "Classified triangles with alpha: " << classifiedFaceCounts[0] << " opaque, " << classifiedFaceCounts[1] << " mixed, "
+				  << classifiedFaceCounts[2] << " transparent (" << transparentInstanceCount << " fully transparent instances dropped)" << std::endl;
+	}
+
+	//Upload geometry records
+	VkDeviceSize recordBufferSize = std::max<VkDeviceSize>(geometryRecords.size(), 1) * sizeof(GeometryRecord);
+
+	representation.geometryRecordBuffer = device->getRenderDevice()->createBuffer(recordBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	geometryRecords.resize(recordBufferSize / sizeof(GeometryRecord), GeometryRecord{});
+
+	stagingRing.uploadBuffer(representation.geometryRecordBuffer.buffer, 0, geometryRecords.data(), recordBufferSize);
+
+	//The BLAS builds read the uploaded data
+	stagingRing.finish();
+
+	auto buildStart = std::chrono::high_resolution_clock::now();
+	representation.loadStatistics.meshUploadTime = secondsBetween(uploadStart, buildStart);
+
+	auto compileBLASList = [&](bool onHost)
+	{
+		std::vector<BLASCreateInfo> blasCreateInfos;
+
+		for (size_t i = 0; i < blasGeometries.size(); ++i)
+		{
+			std::shared_ptr<BLASGeometryInfo> geometryInfo = std::make_shared<BLASGeometryInfo>();
+
+			for (const BLASGeometry& geometry : blasGeometries[i])
+			{
+				std::pair<VkAccelerationStructureGeometryKHR, VkAccelerationStructureBuildRangeInfoKHR> meshGeometry = compileMeshGeometry(geometry, onHost);
+
+				geometryInfo->geometryArray.push_back(meshGeometry.first);
+				geometryInfo->rangeInfoArray.push_back(meshGeometry.second);
+			}
+
+			blasCreateInfos.push_back({ geometryInfo, blasBuildFlags[i] });
+		}
+
+		return blasCreateInfos;
+	};
+
+	//Build the same BLASes with every supported mode (the results are thrown away)
+	if (options.benchmarkBLASBuilds)
+	{
+		const char* modeNames[] = { "Serial", "Batched", "Host" };
+
+		uint64_t triangleCount = 0;
+
+		for (const std::vector<BLASGeometry>& geometries : blasGeometries)
+		{
+			for (const BLASGeometry& geometry : geometries)
+			{
+				triangleCount += geometry.faceCount;
+			}
+		}
+
+		std::vector<std::pair<BLASBuildMode, double>> timings;
+
+		for (BLASBuildMode mode : { BLASBuildMode::Serial, BLASBuildMode::Batched, BLASBuildMode::Host })
+		{
+			if (mode == BLASBuildMode::Host && (!device->isHostBuildSupported() || hasDeformableMeshes))
+			{
+				continue;
+			}
+
+			std::vector<BLASCreateInfo> blasCreateInfos = compileBLASList(mode == BLASBuildMode::Host);
+
+			auto start = std::chrono::high_resolution_clock::now();
+			BLASBuildResult result = device->buildBLAS(blasCreateInfos, mode);
+
+			timings.push_back(std::make_pair(mode, secondsBetween(start, std::chrono::high_resolution_clock::now())));
+
+			device->destroyBLAS(result);
+		}
+
+		//Device builds include compaction, host builds aren't compacted
+		std::cout << "BLAS build benchmark (" << blasGeometries.size() << " BLASes, " << triangleCount << " triangles):" << std::endl;
+
+		for (const std::pair<BLASBuildMode, double>& timing : timings)
+		{
+			std::cout << "    -" << modeNames[(int)timing.first] << ": " << (timing.second * 1000.0) << "ms (" << (triangleCount / timing.second / 1e6) << " Mtris/s)" << std::endl;
+		}
+	}
+
+	//The benchmark isn't part of the load time
+	buildStart = std::chrono::high_resolution_clock::now();
+
+	//Build BLAS (or load them from the BLAS cache, see "Note on the BLAS cache")
+	std::vector<BLASCreateInfo> blasCreateInfos = compileBLASList(blasBuildMode == BLASBuildMode::Host);
+
+	BLASBuildResult buildResult;
+	BLASCacheKey blasCacheKey;
+
+	bool loadedBLASes = false;
+
+	//Animated scenes aren't cooked, so their BLASes aren't cached either
+	if (!blasCachePath.empty() && !description.animation)
+	{
+		//The scene hash identifies the mesh data, the rest identifies how it's split into BLASes
+		uint64_t geometryHash = Hash::combine(sceneHash, Hash::value(blasFlags));
+
+		for (const std::vector<BLASGeometry>& geometries : blasGeometries)
+		{
+			geometryHash = Hash::combine(geometryHash, Hash::value((uint64_t)geometries.size()));
+
+			for (const BLASGeometry& geometry : geometries)
+			{
+				const SceneMesh& mesh = description.meshes[geometryMeshes[geometry.geometryIndex]];
+
+				uint32_t geometryDetails[5] = { mesh.vertexCount, mesh.faceCount, geometry.firstFace, geometry.faceCount, (uint32_t)geometry.flags };
+
+				geometryHash = Hash::combine(geometryHash, Hash::value(geometryDetails));
+			}
+		}
+
+		memcpy(blasCacheKey.deviceUUID, device->getDeviceUUID(), sizeof(blasCacheKey.deviceUUID));
+		blasCacheKey.driverVersion = device->getDriverVersion();
+		blasCacheKey.geometryHash = geometryHash;
+
+		std::shared_ptr<BLASCache> blasCache = BLASCache::open(blasCachePath, blasCacheKey);
+
+		if (blasCache && blasCache->getBLASCount() == (uint32_t)blasCreateInfos.size())
+		{
+			std::vector<std::pair<const uint8_t*, size_t>> serializedBLASes;
+
+			for (uint32_t i = 0; i < blasCache->getBLASCount(); ++i)
+			{
+				serializedBLASes.push_back(std::make_pair(blasCache->getBLASData(i), blasCache->getBLASDataSize(i)));
+			}
+
+			loadedBLASes = device->deserializeBLAS(blasCreateInfos, serializedBLASes, buildResult);
+
+			if (!loadedBLASes)
+			{
+				std::cout << "BLAS cache '" << blasCachePath << "' is not compatible with the device, rebuilding" << std::endl;
+			}
+		}
+	}
+
+	if (!loadedBLASes)
+	{
+		buildResult = device->buildBLAS(blasCreateInfos, blasBuildMode);
+
+		if (!blasCachePath.empty() && !description.animation && BLASCache::write(blasCachePath, blasCacheKey, device->serializeBLAS(buildResult)))
+		{
+			std::cout << "Wrote BLAS cache " << blasCachePath << std::endl;
+		}
+	}
+
+	representation.loadStatistics.blasLoadedFromCache = loadedBLASes;
+
+	//Add BLAS instances to TLAS
+	std::vector<VkAccelerationStructureInstanceKHR> accelStructInstances;
+
+	for (const SceneTLASInstance& instance : tlasInstances)
+	{
+		accelStructInstances.push_back(device->compileInstances(buildResult.blasList[instance.blasIndex], instance.transform, instance.firstRecord/*gl_InstanceCustomIndexEXT*/, 0xFF, 0, instance.flags));
+	}
+
+	//Build TLAS
+	TopLevelAS tlas;
+	tlas.init(device);
+
+	//Only animated scenes refit instance transforms, so static scenes don't pay for the
+	//ALLOW_UPDATE flag, the instance ring or the update scratch (see "Note on TLAS updates")
+	VkBuildAccelerationStructureFlagsKHR tlasFlags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+
+	if (description.animation)
+	{
+		tlasFlags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+	}
+
+	device->buildTLAS(tlas, accelStructInstances, tlasFlags);
+
+	representation.blasBuildResult = std::move(buildResult);
+	representation.tlas = std::move(tlas);
+
+	//Set up the animation (the source data is uploaded with the materials, see "Note on scene animation")
+	if (description.animation)
+	{
+		std::vector<VkDeviceAddress> outputAddresses;
+
+		for (const std::pair<uint32_t, uint32_t>& deformableBLAS : deformableBLASes)
+		{
+			uint32_t meshIndex = description.animation->deformableMeshes[deformableBLAS.first].meshIndex;
+			const MeshBuffers& buffers = representation.meshBuffers[meshGeometries[meshIndex]];
+
+			outputAddresses.push_back(buffers.positionAddress);
+		}
+
+		std::unique_ptr<SceneAnimator> animator = std::make_unique<SceneAnimator>();
+
+		if (animator->init(device, description.animation, representation.blasBuildResult, deformableBLASes, outputAddresses, animatedInstances, stagingRing))
+		{
+			representation.animator = std::move(animator);
+		}
+		else
+		{
+			std::cerr << "Unable to initialize the scene animation, the scene will be static" << std::endl;
+
+			animator->destroy();
+		}
+	}
+
+	representation.loadStatistics.accelerationStructureTime = secondsBetween(buildStart, std::chrono::high_resolution_clock::now());
+}
+
+/**************************************/
+/*        Load scene materials        */
+/**************************************/
+
+struct TextureSource
+{
+	//Set if the texture is embedded in the scene file, otherwise
+	//the texture is loaded from `path`
+	const aiTexture* embeddedTexture = nullptr;
+	std::string path;
+
+	//Hash of the embedded texture data (only set if `embeddedTexture` is set)
+	uint64_t embeddedHash = 0;
+
+	//Identifies the image contents, so that textures referenced by multiple
+	//materials are only loaded once
+	std::string key;
+
+	std::string materialName;
+};
+
+//Embedded textures are hashed once, no matter how many materials reference them
+typedef std::unordered_map<const aiTexture*, uint64_t> EmbeddedTextureHashes;
+
+bool resolveMaterialTexture(const aiScene* scene, const char* scenePath, const aiMaterial* material, aiTextureType textureType, int index,
+							EmbeddedTextureHashes& embeddedHashes, TextureSource& source)
+{
+	//Get texture path
+	aiString name;
+	if (material->Get(AI_MATKEY_TEXTURE(textureType, index), name) != AI_SUCCESS)
+	{
+		//Material doesn't have the texture requested
+		return false;
+	}
+
+	source.materialName = material->GetName().C_Str();
+
+	if (source.embeddedTexture = scene->GetEmbeddedTexture(name.C_Str()))
+	{
+		//Embedded textures don't have a path, so they are identified by their contents
+		const aiTexture* texture = source.embeddedTexture;
+		auto it = embeddedHashes.find(texture);
+
+		if (it == embeddedHashes.end())
+		{
+			size_t dataSize = texture->mHeight == 0 ? (size_t)texture->mWidth : 4 * (size_t)texture->mWidth * texture->mHeight;
+
+			it = embeddedHashes.emplace(texture, Hash::bytes(texture->pcData, dataSize)).first;
+		}
+
+		source.embeddedHash = it->second;
+		source.key = "embedded:" + std::to_string(texture->mWidth) + "x" + std::to_string(texture->mHeight) + ":" + Hash::toHex(source.embeddedHash);
+	}
+	else
+	{
+		std::filesystem::path path(Resources::resolvePath(name.C_Str()));
+
+		if (path.is_relative())
+		{
+			path = std::filesystem::path(scenePath).replace_filename(path);
+		}
+
+		source.path = path.lexically_normal().string();
+		source.key = "file:" + source.path;
+	}
+
+	return true;
+}
+
+//Converts an Assimp texture mapping mode (aiTextureMapMode) to the wrap mode that it is sampled with
+TextureWrap getTextureWrap(int mapMode)
+{
+	switch (mapMode)
+	{
+	case aiTextureMapMode_Mirror: return TextureWrap::MirroredRepeat;
+	case aiTextureMapMode_Clamp: return TextureWrap::ClampToEdge;
+	case aiTextureMapMode_Decal: return TextureWrap::ClampToBorder;
+	default: return TextureWrap::Repeat;
+	}
+}
+
+bool loadMaterialTexture(const TextureSource& source, std::shared_ptr<uint8_t>& output, int& width, int& height, int& channelCount)
+{
+	//Load texture data
+	if (const aiTexture* texture = source.embeddedTexture)
+	{
+		if (texture->mHeight == 0) //Texture is compressed
+		{
+			int numChannels;
+
+			//STB will try to detect the image type automatically so, there is no need to use 'texture->achFormatHint'
+			stbi_uc* imageMemory = stbi_load_from_memory((const stbi_uc*)texture->pcData, texture->mWidth, &width, &height, &numChannels, 4);
+
+			if (!imageMemory)
+			{
+				std::cerr << "Unable to load texture (format='" << texture->achFormatHint << "') from material '" << source.materialName <<"'" << std::endl;
+				return false;
+			}
+
+			output = std::shared_ptr<uint8_t>((uint8_t*)imageMemory, stbi_image_free);
+		}
+		else
+		{
+			width = texture->mWidth;
+			height = texture->mHeight;
+
+			size_t textureSize = 4 * (size_t)width * height;
+			output = std::shared_ptr<uint8_t>((uint8_t*)malloc(textureSize), free);
+
+			memcpy(output.get(), texture->pcData, textureSize);
+		}
+	}
+	else
+	{
+		int numChannels;
+		stbi_uc* imageMemory = stbi_load(source.path.c_str(), &width, &height, &numChannels, 4);
+
+		if (!imageMemory)
+		{
+			std::cerr << "Unable to load texture '" << source.path << "' from material '" << source.materialName << "'" << std::endl;
+			return false;
+		}
+
+		output = std::shared_ptr<uint8_t>((uint8_t*)imageMemory, stbi_image_free);
+	}
+
+	channelCount = 4;
+
+	return true;
+}
+
+struct ImageAllocDetails
+{
+	VkImage image;
+	VkImageView imageView;
+
+	VkFormat imageFormat;
+
+	//The memory block the image takes its memory from and its offset within it
+	uint32_t memoryBlock;
+	VkDeviceSize pageOffset;
+
+	//The actual size of the image (as returned by `vkGetBufferMemoryRequirements`)
+	VkDeviceSize actualSize;
+
+	//The smallest amount of memory it would take to store
+	//all the pixels of the imported image and its mip chain
+	VkDeviceSize baseSize;
+
+	int width;
+	int height;
+	uint32_t mipLevelCount;
+	TextureFormat format;
+	std::shared_ptr<uint8_t> textureData;
+};
+
+VkFormat getTextureImageFormat(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::BC1: return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+	case TextureFormat::BC7: return VK_FORMAT_BC7_UNORM_BLOCK;
+	default: return VK_FORMAT_R8G8B8A8_UNORM;
+	}
+}
+
+//Hashes the encoded source of a texture (the image file or the embedded texture data)
+bool hashTextureSource(const TextureSource& source, uint64_t& hash)
+{
+	if (source.embeddedTexture)
+	{
+		//Already hashed when the texture was resolved
+		hash = source.embeddedHash;
+		return true;
+	}
+
+	MappedFile file;
+
+	if (!file.open(source.path))
+	{
+		return false;
+	}
+
+	hash = Hash::bytes(file.getData(), file.getSize());
+	return true;
+}
+
+//Builds the alpha mask from the base level that the shaders sample, which for compressed
+//textures can differ a lot from the source image (see "Note on triangle opacity")
+std::shared_ptr<const AlphaMask> createAlphaMask(const DecodedTexture& decoded)
+{
+	if (decoded.format == TextureFormat::RGBA8)
+	{
+		return std::make_shared<AlphaMask>(decoded.textureData.get(), decoded.width, decoded.height);
+	}
+
+	std::shared_ptr<uint8_t> baseLevel = TextureCompression::decompressLevel(decoded.format, decoded.textureData.get(), decoded.width, decoded.height);
+
+	if (!baseLevel)
+	{
+		//Without a mask the triangles aren't classified and the opacity of the material applies to all of them
+		return nullptr;
+	}
+
+	return std::make_shared<AlphaMask>(baseLevel.get(), decoded.width, decoded.height);
+}
+
+bool decodeTexture(const TextureSource& source, bool compress, bool buildAlphaMask, DecodedTexture& decoded)
+{
+	uint64_t sourceHash = 0;
+	bool hasSourceHash = compress && hashTextureSource(source, sourceHash);
+
+	//Reuse the result of a previous compression of the same image
+	if (hasSourceHash)
+	{
+		CompressedTextureHeader header;
+		std::shared_ptr<uint8_t> data = TextureCompression::loadCached(sourceHash, header);
+
+		if (data)
+		{
+			decoded.width = header.width;
+			decoded.height = header.height;
+			decoded.channelCount = 4;
+			decoded.mipLevelCount = header.mipLevelCount;
+			decoded.format = header.format;
+			decoded.hasAlpha = header.hasAlpha != 0;
+			decoded.textureData = data;
+
+			if (decoded.hasAlpha && buildAlphaMask)
+			{
+				decoded.alphaMask = createAlphaMask(decoded);
+			}
+
+			return true;
+		}
+	}
+
+	if (!loadMaterialTexture(source, decoded.textureData, decoded.width, decoded.height, decoded.channelCount))
+	{
+		return false;
+	}
+
+	//Check if texture has alpha
+	uint32_t* pixelPointer = (uint32_t*)decoded.textureData.get();
+
+	for (int y = 0; y < decoded.height && !decoded.hasAlpha; ++y)
+	{
+		for (int x = 0; x < decoded.width; ++x)
+		{
+			if (((pixelPointer[y * decoded.width + x] >> 24) & 0xFF) != 0xFF)
+			{
+				decoded.hasAlpha = true;
+				break;
+			}
+		}
+	}
+
+	//Generate mip chain
+	decoded.mipLevelCount = MipGenerator::getMipLevelCount(decoded.width, decoded.height);
+
+	size_t levelSize = 4 * (size_t)decoded.width * decoded.height;
+	size_t chainSize = MipGenerator::getMipChainSize(decoded.width, decoded.height, decoded.mipLevelCount);
+
+	std::shared_ptr<uint8_t> chain((uint8_t*)malloc(chainSize), free);
+	memcpy(chain.get(), decoded.textureData.get(), levelSize);
+
+	decoded.textureData = chain;
+
+	MipGenerator::generateMipChain(decoded.textureData.get(), decoded.width, decoded.height, decoded.mipLevelCount);
+
+	//Compress texture
+	if (compress)
+	{
+		decoded.format = decoded.hasAlpha ? TextureFormat::BC7 : TextureFormat::BC1;
+		decoded.textureData = TextureCompression::compressChain(decoded.format, decoded.textureData.get(), decoded.width, decoded.height, decoded.mipLevelCount);
+
+		if (hasSourceHash)
+		{
+			CompressedTextureHeader header = {};
+			header.sourceHash = sourceHash;
+			header.format = decoded.format;
+			header.width = decoded.width;
+			header.height = decoded.height;
+			header.mipLevelCount = decoded.mipLevelCount;
+			header.hasAlpha = decoded.hasAlpha;
+			header.dataSize = TextureCompression::getChainSize(decoded.format, decoded.width, decoded.height, decoded.mipLevelCount);
+
+			if (!TextureCompression::storeCached(header, decoded.textureData.get()))
+			{
+				std::cerr << "Unable to cache compressed texture from material '" << source.materialName << "'" << std::endl;
+			}
+		}
+	}
+
+	if (decoded.hasAlpha && buildAlphaMask)
+	{
+		decoded.alphaMask = createAlphaMask(decoded);
+	}
+
+	return true;
+}
+
+ImageAllocDetails pushTexture(const RaytracingDevice* device, const DecodedTexture& decoded)
+{
+	VkDevice deviceHandle = device->getRenderDevice()->getDevice();
+
+	ImageAllocDetails allocDetails = {};
+	allocDetails.width = decoded.width;
+	allocDetails.height = decoded.height;
+	allocDetails.mipLevelCount = decoded.mipLevelCount;
+	allocDetails.format = decoded.format;
+	allocDetails.textureData = decoded.textureData;
+	allocDetails.baseSize = TextureCompression::getChainSize(decoded.format, decoded.width, decoded.height, decoded.mipLevelCount);
+
+	allocDetails.imageFormat = getTextureImageFormat(decoded.format);
+
+	//Create image
+	VkImageCreateInfo imageCI = {};
+	imageCI.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageCI.imageType = VK_IMAGE_TYPE_2D;
+	imageCI.format = allocDetails.imageFormat;
+	imageCI.extent = { (uint32_t)decoded.width, (uint32_t)decoded.height, 1 };
+	imageCI.mipLevels = allocDetails.mipLevelCount;
+	imageCI.arrayLayers = 1;
+	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCI.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageCI.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageCI.queueFamilyIndexCount = 0;
+	imageCI.pQueueFamilyIndices = nullptr;
+	imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	
+	VK_CHECK(vkCreateImage(deviceHandle, &imageCI, nullptr, &allocDetails.image));
+
+	return allocDetails;
+}
+
+VkSamplerAddressMode getSamplerAddressMode(TextureWrap wrap)
+{
+	switch (wrap)
+	{
+	case TextureWrap::MirroredRepeat: return VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
+	case TextureWrap::ClampToEdge: return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	case TextureWrap::ClampToBorder: return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
+	default: return VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	}
+}
+
+//Textures only differ in their wrap modes, so they share samplers (see "Note on sampler caching")
+VkSampler getTextureSampler(const RenderDevice* renderDevice, TextureWrap wrapU, TextureWrap wrapV)
+{
+	VkSamplerCreateInfo samplerCI = {};
+	samplerCI.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerCI.magFilter = VK_FILTER_LINEAR;
+	samplerCI.minFilter = VK_FILTER_LINEAR;
+	samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerCI.addressModeU = getSamplerAddressMode(wrapU);
+	samplerCI.addressModeV = getSamplerAddressMode(wrapV);
+	samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerCI.mipLodBias = 0.0f;
+	samplerCI.anisotropyEnable = VK_FALSE;
+	samplerCI.maxAnisotropy = 1.0f;
+	samplerCI.compareEnable = VK_FALSE;
+	samplerCI.compareOp = VK_COMPARE_OP_NEVER;
+	samplerCI.minLod = 0.0f;
+	samplerCI.maxLod = VK_LOD_CLAMP_NONE;
+	samplerCI.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+	samplerCI.unnormalizedCoordinates = VK_FALSE;
+
+	return renderDevice->getSampler(samplerCI);
+}
+
+//`materialAlphaMasks` receives the alpha mask of each material's albedo texture (or `nullptr`)
+void loadMaterials(const RaytracingDevice* device, const SceneDescription& description, Scene& representation, StagingRing& stagingRing, std::shared_ptr<SceneLoadProgress> progress,
+				   SceneCacheWriter* cacheWriter, std::vector<std::shared_ptr<const AlphaMask>>& materialAlphaMasks)
+{
+	const RenderDevice* renderDevice = device->getRenderDevice();
+	VkDevice deviceHandle = renderDevice->getDevice();
+
+	/*
+	 ------------------------------
+	      Note on texture loading
+	 ------------------------------
+
+	 Decoding textures is by far the most expensive part of loading materials, so every
+	 unique texture is decoded on the global thread pool. Each worker pushes the index
+	 of its texture to `completedTextures` when it's done, which lets this thread create
+	 the Vulkan image for a texture as soon as it is ready and keep the progress up to date.
+	 Textures read from the scene cache don't need decoding, so their jobs finish immediately.
+	*/
+	unsigned int textureCount = (unsigned int)description.textureDecoders.size();
+	unsigned int materialCount = (unsigned int)description.materials.size();
+
+	std::vector<DecodedTexture> decodedTextures(textureCount);
+	std::vector<bool> decodeSucceeded(textureCount, false);
+
+	std::mutex completionLock;
+	std::condition_variable completionSignal;
+	std::vector<unsigned int> completedTextures;
+
+	for (unsigned int i = 0; i < textureCount; ++i)
+	{
+		ThreadPool::global().submit([&, i]()
+		{
+			bool succeeded = description.textureDecoders[i](decodedTextures[i]);
+
+			//Notify while holding the lock, otherwise this thread could still be inside
+			//`notify_one` after the loader has returned and destroyed `completionSignal`
+			std::lock_guard<std::mutex> guard(completionLock);
+
+			decodeSucceeded[i] = succeeded;
+			completedTextures.push_back(i);
+
+			completionSignal.notify_one();
+		});
+	}
+
+	//Create images as their textures finish decoding
+	std::vector<ImageAllocDetails> textureImages(textureCount);
+	unsigned int processedCount = 0;
+
+	while (processedCount < textureCount)
+	{
+		std::vector<unsigned int> readyTextures;
+		std::vector<bool> readySucceeded;
+
+		{
+			std::unique_lock<std::mutex> lock(completionLock);
+			completionSignal.wait(lock, [&]() { return !completedTextures.empty(); });
+
+			readyTextures.swap(completedTextures);
+
+			for (unsigned int textureIndex : readyTextures)
+			{
+				readySucceeded.push_back(decodeSucceeded[textureIndex]);
+			}
+		}
+
+		for (size_t i = 0; i < readyTextures.size(); ++i)
+		{
+			const DecodedTexture& decoded = decodedTextures[readyTextures[i]];
+
+			if (readySucceeded[i])
+			{
+				textureImages[readyTextures[i]] = pushTexture(device, decoded);
+			}
+
+			if (cacheWriter)
+			{
+				VkDeviceSize dataSize = TextureCompression::getChainSize(decoded.format, decoded.width, decoded.height, decoded.mipLevelCount);
+
+				cacheWriter->writeTexture(readyTextures[i], decoded.width, decoded.height, decoded.mipLevelCount, (uint32_t)decoded.format, decoded.hasAlpha, readySucceeded[i] ? decoded.textureData.get() : nullptr, dataSize);
+			}
+
+			//Pixel data is now owned by the image details
+			decodedTextures[readyTextures[i]].textureData = nullptr;
+		}
+
+		processedCount += (unsigned int)readyTextures.size();
+
+		progress->setStageProgress((float)processedCount / (textureCount + 1));
+	}
+
+	//Assign texture slots in source order, so that they don't depend on the order
+	//in which the workers finished. Textures that failed to load don't get a slot.
+	std::vector<ImageAllocDetails> imageAllocDetails;
+	std::vector<uint32_t> textureSlots(textureCount, (uint32_t)-1);
+
+	for (unsigned int i = 0; i < textureCount; ++i)
+	{
+		if (decodeSucceeded[i])
+		{
+			textureSlots[i] = (uint32_t)imageAllocDetails.size();
+			imageAllocDetails.push_back(textureImages[i]);
+		}
+	}
+
+	//Materials whose textures are sampled with the same wrap modes share a sampler
+	std::map<std::pair<TextureWrap, TextureWrap>, uint32_t> samplerIndices;
+
+	for (unsigned int i = 0; i < materialCount; ++i)
+	{
+		const SceneMaterial& sceneMaterial = description.materials[i];
+
+		Material material;
+		uint32_t textureIndex = sceneMaterial.albedoTexture;
+
+		material.albedoIndex = textureIndex != (uint32_t)-1 ? textureSlots[textureIndex] : (uint32_t)-1;
+		material.samplerIndex = 0;
+
+		if (material.albedoIndex != (uint32_t)-1)
+		{
+			auto it = samplerIndices.emplace(std::make_pair(sceneMaterial.wrapU, sceneMaterial.wrapV), (uint32_t)representation.samplers.size()).first;
+
+			if (it->second == representation.samplers.size())
+			{
+				representation.samplers.push_back(getTextureSampler(device->getRenderDevice(), sceneMaterial.wrapU, sceneMaterial.wrapV));
+			}
+
+			material.samplerIndex = it->second;
+		}
+
+		bool hasAlpha = material.albedoIndex != (uint32_t)-1 && decodedTextures[textureIndex].hasAlpha;
+
+		//Add material to scene
+		representation.materials.push_back(material);
+		representation.isMaterialOpaque.push_back(!hasAlpha);
+
+		materialAlphaMasks.push_back(hasAlpha ? decodedTextures[textureIndex].alphaMask : nullptr);
 	}
-	else
+
+	if (imageAllocDetails.size() == 0)
+	{
+		//No images are used
+		representation.textureMemoryBlocks.clear();
+		progress->setStageProgress(1.0f);
+
+		return;
+	}
+
+	//Calculate memory requirements
+	//Note: Look at buffer allocation for more details
+	VkDeviceSize maxBlockSize = std::min<VkDeviceSize>(SCENE_MEMORY_BLOCK_SIZE, device->getMaxMemoryAllocationSize());
+	std::vector<VkDeviceSize> memoryBlockSizes;
+
+	VkDeviceSize imageAlignment = 1;
+
+	uint32_t mutualMemoryTypeBits = 0xFFFFFFFF;
+
+	std::vector<std::pair<VkDeviceSize, VkDeviceSize>> imageRanges;
+
+	for (size_t i = 0; i < imageAllocDetails.size(); ++i)
+	{
+		ImageAllocDetails& allocDetails = imageAllocDetails[i];
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(deviceHandle, allocDetails.image, &memRequirements);
+
+		packIntoMemoryBlocks(memRequirements, maxBlockSize, memoryBlockSizes, allocDetails.memoryBlock, allocDetails.pageOffset);
+
+		allocDetails.actualSize = memRequirements.size;
+
+		mutualMemoryTypeBits &= memRequirements.memoryTypeBits;
+		imageAlignment = std::max(imageAlignment, memRequirements.alignment);
+	}
+
+	//Allocate memory
+	if (!mutualMemoryTypeBits)
+	{
+		FATAL_ERROR("Could not find memory type that supports all images");
+	}
+
+	MemoryRequest memRequest;
+	memRequest.requirements.alignment = imageAlignment;
+	memRequest.requirements.memoryTypeBits = mutualMemoryTypeBits;
+	memRequest.properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	memRequest.isImage = true;
+
+	std::vector<Allocation> imageMemory;
+
+	for (VkDeviceSize blockSize : memoryBlockSizes)
+	{
+		memRequest.requirements.size = blockSize;
+		imageMemory.push_back(device->getRenderDevice()->allocateMemory(memRequest));
+	}
+
+	//Upload image data
+	for (size_t i = 0; i < imageAllocDetails.size(); ++i)
+	{
+		ImageAllocDetails& allocDetails = imageAllocDetails[i];
+
+		const Allocation& memory = imageMemory[allocDetails.memoryBlock];
+
+		VK_CHECK(vkBindImageMemory(deviceHandle, allocDetails.image, memory.memory, memory.offset + allocDetails.pageOffset));
+
+		//Create image view
+		VkImageViewCreateInfo imageViewCI = {};
+		imageViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		imageViewCI.image = allocDetails.image;
+		imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		imageViewCI.format = allocDetails.imageFormat;
+		imageViewCI.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCI.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCI.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCI.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+		imageViewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageViewCI.subresourceRange.baseMipLevel = 0;
+		imageViewCI.subresourceRange.levelCount = allocDetails.mipLevelCount;
+		imageViewCI.subresourceRange.baseArrayLayer = 0;
+		imageViewCI.subresourceRange.layerCount = 1;
+
+		VK_CHECK(vkCreateImageView(deviceHandle, &imageViewCI, nullptr, &allocDetails.imageView));
+
+		//Record buffer-to-image copy commands
+		VkImageMemoryBarrier imageBarrier = {};
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier.srcAccessMask = 0;
+		imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = allocDetails.image;
+		imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageBarrier.subresourceRange.baseArrayLayer = 0;
+		imageBarrier.subresourceRange.layerCount = 1;
+		imageBarrier.subresourceRange.baseMipLevel = 0;
+		imageBarrier.subresourceRange.levelCount = allocDetails.mipLevelCount;
+
+		vkCmdPipelineBarrier(stagingRing.getCommandBuffer(),
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+		for (uint32_t level = 0; level < allocDetails.mipLevelCount; ++level)
+		{
+			uint32_t levelWidth = MipGenerator::getMipSize(allocDetails.width, level);
+			uint32_t levelHeight = MipGenerator::getMipSize(allocDetails.height, level);
+
+			const uint8_t* levelData = allocDetails.textureData.get() + TextureCompression::getLevelOffset(allocDetails.format, allocDetails.width, allocDetails.height, level);
+
+			stagingRing.uploadImage(allocDetails.image, level, levelWidth, levelHeight, TextureCompression::getBlockSize(allocDetails.format), levelData,
+									TextureCompression::getBlockExtent(allocDetails.format));
+		}
+
+		//Original texture data is not needed
+		allocDetails.textureData = nullptr;
+
+		imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageBarrier.dstAccessMask = 0;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+		vkCmdPipelineBarrier(stagingRing.getCommandBuffer(),
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+	}
+
+	stagingRing.finish();
+
+	//Add textures to scene representation
+	for (size_t i = 0; i < imageAllocDetails.size(); ++i)
 	{
-		hasAlpha = true;
-		textureIndex = (uint32_t)-1;
+		ImageAllocDetails allocDetails = imageAllocDetails[i];
+
+		representation.textures.push_back(std::make_pair(allocDetails.image, allocDetails.imageView));
 	}
 
-	return hasAlpha;
+	representation.textureMemoryBlocks = imageMemory;
+
+	progress->setStageProgress(1.0f);
 }
 
-void loadMaterials(const RaytracingDevice* device, const char* scenePath, const aiScene* scene, Scene& representation, std::shared_ptr<SceneLoadProgress> progress)
+void uploadMaterials(const RaytracingDevice* device, Scene& representation, StagingRing& stagingRing)
 {
 	const RenderDevice* renderDevice = device->getRenderDevice();
-	VkDevice deviceHandle = renderDevice->getDevice();
 
-	//Load material textures
-	std::vector<ImageAllocDetails> imageAllocDetails;
+	//Write the material table, followed by the field arrays (see "Note on the material table")
+	VkDeviceSize materialCount = std::max<VkDeviceSize>(representation.materials.size(), 1);
+
+	VkDeviceSize albedoIndexOffset = sizeof(MaterialTable);
+	VkDeviceSize samplerIndexOffset = albedoIndexOffset + materialCount * sizeof(uint32_t);
+	VkDeviceSize materialBufferSize = samplerIndexOffset + materialCount * sizeof(uint32_t);
+
+	representation.materialBuffer = renderDevice->createBuffer(materialBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+															   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VkDeviceAddress materialBufferAddress = renderDevice->getBufferAddress(representation.materialBuffer.buffer);
+
+	stagingRing.uploadBuffer(representation.materialBuffer.buffer, 0, materialBufferSize, [&](uint8_t* data)
+	{
+		MaterialTable* table = (MaterialTable*)data;
+		table->albedoIndices = materialBufferAddress + albedoIndexOffset;
+		table->samplerIndices = materialBufferAddress + samplerIndexOffset;
+
+		uint32_t* albedoIndices = (uint32_t*)(data + albedoIndexOffset);
+		uint32_t* samplerIndices = (uint32_t*)(data + samplerIndexOffset);
+
+		for (size_t i = 0; i < representation.materials.size(); ++i)
+		{
+			albedoIndices[i] = representation.materials[i].albedoIndex;
+			samplerIndices[i] = representation.materials[i].samplerIndex;
+		}
+	});
+
+	stagingRing.finish();
+}
+
+void createSceneDescriptorSets(const RaytracingDevice* raytracingDevice, Scene& scene)
+{
+	VkDevice device = raytracingDevice->getRenderDevice()->getDevice();
+
+	//Create descriptor set layout (the mesh data is accessed through the geometry records, see "Note on geometry buffers").
+	//Textures and samplers are bound separately, since the scene only has a handful of distinct samplers.
+	VkDescriptorSetLayoutBinding layoutBinding[] = {
+		{ 0, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, nullptr },
+		{ 1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, (uint32_t)scene.textures.size(), VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR, nullptr },
+		{ 2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR, nullptr },
+		{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR, nullptr },
+		{ 4, VK_DESCRIPTOR_TYPE_SAMPLER, (uint32_t)scene.samplers.size(), VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR, scene.samplers.data() }
+	};
+
+	VkDescriptorSetLayoutCreateInfo layoutCI = {};
+	layoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutCI.pBindings = layoutBinding;
+	layoutCI.bindingCount = sizeof(layoutBinding) / sizeof(layoutBinding[0]);
+	
+	VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutCI, nullptr, &scene.descriptorSetLayout));
+
+	//Create descriptor pool
+	VkDescriptorPoolSize descPoolSizes[] = {
+		{ VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, std::max<uint32_t>((uint32_t)scene.textures.size(), 1) },
+		{ VK_DESCRIPTOR_TYPE_SAMPLER, std::max<uint32_t>((uint32_t)scene.samplers.size(), 1) }
+	};
+
+	VkDescriptorPoolCreateInfo descPoolCI = {};
+	descPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descPoolCI.poolSizeCount = sizeof(descPoolSizes) / sizeof(descPoolSizes[0]);
+	descPoolCI.pPoolSizes = descPoolSizes;
+	descPoolCI.maxSets = 1;
+
+	VK_CHECK(vkCreateDescriptorPool(device, &descPoolCI, nullptr, &scene.descriptorPool));
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = scene.descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &scene.descriptorSetLayout;
+
+	VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &scene.descriptorSet));
+
+	//Update scene descriptor
+	std::vector<VkWriteDescriptorSet> setWrites;
+
+	//Write TLAS (binding = 0)
+	VkAccelerationStructureKHR tlas = scene.tlas.get();
+
+	VkWriteDescriptorSetAccelerationStructureKHR tlasSetWrite = {};
+	tlasSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
+	tlasSetWrite.accelerationStructureCount = 1;
+	tlasSetWrite.pAccelerationStructures = &tlas;
+
+	setWrites.push_back({});
+	setWrites.back().sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	setWrites.back().pNext = &tlasSetWrite;
+	setWrites.back().dstSet = scene.descriptorSet;
+	setWrites.back().dstBinding = 0;
+	setWrites.back().descriptorCount = 1 ;
+	setWrites.back().descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+
+	//Write textures (binding = 1)
+	std::vector<VkDescriptorImageInfo> imageSetWrites(scene.textures.size());
+	std::transform(scene.textures.begin(), scene.textures.end(), imageSetWrites.begin(), [](const std::pair<VkImage, VkImageView>& texture)
+		{ return VkDescriptorImageInfo{ VK_NULL_HANDLE, texture.second, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }; });
+
+	DESC_SET_WRITE_IMAGE(setWrites, scene.descriptorSet, 1, imageSetWrites, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+
+	//The samplers (binding = 4) are immutable, so they don't have to be written
+
+	//Write material table (binding = 2, the field arrays are read through their device addresses)
+	std::vector<VkDescriptorBufferInfo> materialSetWrites = { { scene.materialBuffer.buffer, 0, sizeof(MaterialTable) } };
+
+	DESC_SET_WRITE_BUFFER(setWrites, scene.descriptorSet, 2, materialSetWrites, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+
+	//Write geometry record buffer (binding = 3)
+	std::vector<VkDescriptorBufferInfo> recordSetWrites = { { scene.geometryRecordBuffer.buffer, 0, VK_WHOLE_SIZE } };
+
+	DESC_SET_WRITE_BUFFER(setWrites, scene.descriptorSet, 3, recordSetWrites, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+	vkUpdateDescriptorSets(device, (uint32_t)setWrites.size(), setWrites.data(), 0, nullptr);
+}
+
+void SceneLoadStatistics::print() const
+{
+	std::cout << "Scene load statistics" << (loadedFromCache ? " (cached)" : "") << ":\n";
+	std::cout << "\t" << (loadedFromCache ? "Read cache: " : "Import: ") << importTime << "s\n";
+	std::cout << "\tMaterials: " << materialTime << "s\n";
+	std::cout << "\tMesh upload: " << meshUploadTime << "s (" << VertexConversion::getInstructionSetName() << " vertex conversion)\n";
+	std::cout << "\tAcceleration structures: " << accelerationStructureTime << "s" << (blasLoadedFromCache ? " (cached BLASes)" : "") << "\n";
+	std::cout << "\tDescriptors: " << descriptorTime << "s\n";
+	std::cout << "\tTotal: " << totalTime << "s\n";
+
+	std::cout << "\tStaging: " << stagingStats.uploadedBytes / (1024.0 * 1024.0) << " MB in " << stagingStats.submitCount << " submits, "
+			  << stagingStats.copyCommandCount << " copy commands (" << stagingStats.copyRegionCount << " regions), "
+			  << stagingStats.stallCount << " stalls" << std::endl;
+}
+
+/**************************************/
+/*         Describe scene data        */
+/**************************************/
+
+//Instances are marked as dynamic if their node is animated or their mesh is deformed. Nodes are counted in
+//pre-order, which is the order of `SceneAnimationData::nodes`.
+void flattenSceneGraph(const aiNode* node, glm::mat4 transform, const SceneAnimationData* animation, uint32_t& nodeIndex, std::vector<SceneInstance>& instances)
+{
+	uint32_t currentNode = nodeIndex++;
+
+	glm::mat4 nodeTransform = {
+		{ node->mTransformation.a1, node->mTransformation.a2, node->mTransformation.a3, node->mTransformation.a4 },
+		{ node->mTransformation.b1, node->mTransformation.b2, node->mTransformation.b3, node->mTransformation.b4 },
+		{ node->mTransformation.c1, node->mTransformation.c2, node->mTransformation.c3, node->mTransformation.c4 },
+		{ node->mTransformation.d1, node->mTransformation.d2, node->mTransformation.d3, node->mTransformation.d4 }
+	};
+
+	transform *= nodeTransform;
+
+	//Add mesh instances
+	for (unsigned int i = 0; i < node->mNumMeshes; ++i)
+	{
+		SceneInstance instance = { transform, node->mMeshes[i] };
+
+		if (animation)
+		{
+			instance.nodeIndex = currentNode;
+			instance.isDynamic = animation->nodes[currentNode].isAnimated || animation->meshDeformables[node->mMeshes[i]] != (uint32_t)-1;
+		}
+
+		instances.push_back(instance);
+	}
+
+	//Traverse children
+	for (unsigned int i = 0; i < node->mNumChildren; ++i)
+	{
+		flattenSceneGraph(node->mChildren[i], transform, animation, nodeIndex, instances);
+	}
+}
+
+void optimizeImportedMeshes(aiScene* scene)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<uint32_t> oldVertexCounts(scene->mNumMeshes, 0);
+	std::vector<uint32_t> newVertexCounts(scene->mNumMeshes, 0);
+
+	ThreadPool::global().parallelFor(scene->mNumMeshes, [&](size_t meshIndex)
+	{
+		aiMesh* mesh = scene->mMeshes[meshIndex];
+
+		oldVertexCounts[meshIndex] = newVertexCounts[meshIndex] = mesh->mNumVertices;
+
+		//Bones and morph targets reference vertices by index, so those meshes are left alone
+		if (mesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE || mesh->mNumFaces == 0 || mesh->HasBones() || mesh->mNumAnimMeshes > 0)
+		{
+			return;
+		}
+
+		//Every vertex attribute has to be moved along with the positions
+		std::vector<VertexStream> streams = { { &mesh->mVertices[0].x, 3 } };
+
+		if (mesh->HasNormals())
+		{
+			streams.push_back({ &mesh->mNormals[0].x, 3 });
+		}
+
+		if (mesh->HasTangentsAndBitangents())
+		{
+			streams.push_back({ &mesh->mTangents[0].x, 3 });
+			streams.push_back({ &mesh->mBitangents[0].x, 3 });
+		}
+
+		for (unsigned int i = 0; i < AI_MAX_NUMBER_OF_COLOR_SETS && mesh->HasVertexColors(i); ++i)
+		{
+			streams.push_back({ &mesh->mColors[i][0].r, 4 });
+		}
+
+		for (unsigned int i = 0; i < AI_MAX_NUMBER_OF_TEXTURECOORDS && mesh->HasTextureCoords(i); ++i)
+		{
+			streams.push_back({ &mesh->mTextureCoords[i][0].x, 3 });
+		}
+
+		std::vector<uint32_t> indices(3 * (size_t)mesh->mNumFaces);
+
+		for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
+		{
+			memcpy(&indices[3 * (size_t)i], mesh->mFaces[i].mIndices, 3 * sizeof(uint32_t));
+		}
+
+		//The arrays only ever shrink, so Assimp can still free them as usual
+		mesh->mNumVertices = MeshOptimizer::optimize(streams, mesh->mNumVertices, indices.data(), mesh->mNumFaces);
+
+		for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
+		{
+			memcpy(mesh->mFaces[i].mIndices, &indices[3 * (size_t)i], 3 * sizeof(uint32_t));
+		}
+
+		newVertexCounts[meshIndex] = mesh->mNumVertices;
+	});
+
+	uint64_t oldVertexCount = 0;
+	uint64_t newVertexCount = 0;
+
+	for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+	{
+		oldVertexCount += oldVertexCounts[i];
+		newVertexCount += newVertexCounts[i];
+	}
+
+	double savings = oldVertexCount > 0 ? 100.0 * (oldVertexCount - newVertexCount) / oldVertexCount : 0.0;
+
+	std::cout << "Optimized meshes: " << oldVertexCount << " -> " << newVertexCount << " vertices (" << savings << "% fewer) in "
+			  << secondsBetween(start, std::chrono::high_resolution_clock::now()) << "s" << std::endl;
+}
+
+void describeImportedScene(const aiScene* scene, const char* scenePath, bool compressTextures, bool classifyOpacity, SceneDescription& description)
+{
+	//Find the unique textures used by the scene's materials
+	std::unordered_map<std::string, uint32_t> textureCache;
+	EmbeddedTextureHashes embeddedHashes;
+
+	description.materials.resize(scene->mNumMaterials);
 
 	for (unsigned int i = 0; i < scene->mNumMaterials; ++i)
 	{
-		Material material;
+		const aiMaterial* material = scene->mMaterials[i];
 
-		bool hasAlpha = pushTexture(device, scenePath, scene, imageAllocDetails, i, aiTextureType_DIFFUSE, material.albedoIndex);
+		TextureSource source;
+		if (!resolveMaterialTexture(scene, scenePath, material, aiTextureType_DIFFUSE, 0, embeddedHashes, source))
+		{
+			continue;
+		}
 
-		//Add material to scene and update progress
-		representation.materials.push_back(material);
-		representation.isMaterialOpaque.push_back(!hasAlpha);
+		//Textures repeat unless the material says otherwise
+		int mapModeU = aiTextureMapMode_Wrap;
+		int mapModeV = aiTextureMapMode_Wrap;
+
+		material->Get(AI_MATKEY_MAPPINGMODE_U(aiTextureType_DIFFUSE, 0), mapModeU);
+		material->Get(AI_MATKEY_MAPPINGMODE_V(aiTextureType_DIFFUSE, 0), mapModeV);
+
+		description.materials[i].wrapU = getTextureWrap(mapModeU);
+		description.materials[i].wrapV = getTextureWrap(mapModeV);
+
+		auto it = textureCache.find(source.key);
+
+		if (it == textureCache.end())
+		{
+			it = textureCache.emplace(source.key, (uint32_t)description.textureDecoders.size()).first;
+
+			description.textureDecoders.push_back([source, compressTextures, classifyOpacity](DecodedTexture& decoded) { return decodeTexture(source, compressTextures, classifyOpacity, decoded); });
+		}
+
+		description.materials[i].albedoTexture = it->second;
+	}
+
+	std::cout << "Loading textures: " << description.textureDecoders.size() << " unique textures referenced by " << scene->mNumMaterials << " materials" << std::endl;
+
+	//Describe meshes
+	for (unsigned int i = 0; i < scene->mNumMeshes; ++i)
+	{
+		const aiMesh* mesh = scene->mMeshes[i];
+
+		description.meshes.push_back({ mesh->mNumVertices, mesh->mNumFaces, mesh->mMaterialIndex });
+	}
+
+	bool compactVertices = description.compactVertices;
+
+	description.writeVertexData = [scene, compactVertices](uint32_t meshIndex, uint8_t* memory, const VertexBufferAllocDetails& details)
+	{
+		const aiMesh* mesh = scene->mMeshes[meshIndex];
+
+		float* positionMemory = (float*)(memory + details.ranges[0].first);
+		uint8_t* texCoordMemory = memory + details.ranges[1].first;
+		uint8_t* normalMemory = memory + details.ranges[2].first;
 
-		progress->setStageProgress((float)i / (scene->mNumMaterials + 1));
-	}
+		size_t texCoordSize = compactVertices ? sizeof(uint32_t) : sizeof(glm::vec2);
+		size_t normalSize = compactVertices ? sizeof(uint32_t) : sizeof(glm::vec3);
 
-	if (imageAllocDetails.size() == 0)
-	{
-		//No images are used
-		representation.textureMemory = VK_NULL_HANDLE;
-		progress->setStageProgress(1.0f);
+		//Large meshes are split into chunks, so that a single mesh doesn't keep the batch waiting
+		size_t chunkCount = (mesh->mNumVertices + VERTEX_CONVERSION_CHUNK_SIZE - 1) / VERTEX_CONVERSION_CHUNK_SIZE;
 
-		return;
-	}
+		ThreadPool::global().parallelFor(chunkCount, [&](size_t chunk)
+		{
+			size_t first = chunk * VERTEX_CONVERSION_CHUNK_SIZE;
+			size_t count = std::min<size_t>(VERTEX_CONVERSION_CHUNK_SIZE, mesh->mNumVertices - first);
 
-	//Calculate memory requirements
-	//Note: Look at buffer allocation for more details
-	VkDeviceSize totalImageSize = 0;
-	uint32_t mutualMemoryTypeBits = 0xFFFFFFFF;
+			VertexConversion::copyVec3(&mesh->mVertices[first].x, positionMemory + 3 * first, count);
 
-	//Images can take up more space than their base size (eg. because
-	//of mipmapping). Allocating staging memory based on the image's
-	//actual size can be wasteful.
-	VkDeviceSize totalImageBaseSize = 0;
+			if (!mesh->HasNormals())
+			{
+				memset(normalMemory + first * normalSize, 0, count * normalSize);
+			}
+			else if (compactVertices)
+			{
+				VertexConversion::packOctahedral(&mesh->mNormals[first].x, (uint32_t*)normalMemory + first, count);
+			}
+			else
+			{
+				VertexConversion::copyVec3(&mesh->mNormals[first].x, (float*)normalMemory + 3 * first, count);
+			}
 
-	std::vector<std::pair<VkDeviceSize, VkDeviceSize>> imageRanges;
+			if (!mesh->HasTextureCoords(0))
+			{
+				memset(texCoordMemory + first * texCoordSize, 0, count * texCoordSize);
+			}
+			else if (compactVertices)
+			{
+				VertexConversion::vec3ToHalf2(&mesh->mTextureCoords[0][first].x, (uint32_t*)texCoordMemory + first, count);
+			}
+			else
+			{
+				VertexConversion::vec3ToVec2(&mesh->mTextureCoords[0][first].x, (float*)texCoordMemory + 2 * first, count);
+			}
+		});
+	};
 
-	for (size_t i = 0; i < imageAllocDetails.size(); ++i)
+	description.writeIndexData = [scene](uint32_t meshIndex, uint8_t* memory, const IndexBufferAllocDetails& details)
 	{
-		ImageAllocDetails& allocDetails = imageAllocDetails[i];
+		const aiMesh* mesh = scene->mMeshes[meshIndex];
 
-		VkMemoryRequirements memRequirements;
-		vkGetImageMemoryRequirements(deviceHandle, allocDetails.image, &memRequirements);
+		if (GeometryLayout::getIndexType(mesh->mNumVertices) == VK_INDEX_TYPE_UINT16)
+		{
+			uint16_t* indexMemory = (uint16_t*)(memory + details.ranges[0].first);
+			for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
+			{
+				assert(mesh->mFaces[i].mNumIndices == 3);
 
-		allocDetails.pageOffset = UINT32_ALIGN(totalImageSize, memRequirements.alignment);
-		allocDetails.actualSize = memRequirements.size;
+				indexMemory[3 * i] = (uint16_t)mesh->mFaces[i].mIndices[0];
+				indexMemory[3 * i + 1] = (uint16_t)mesh->mFaces[i].mIndices[1];
+				indexMemory[3 * i + 2] = (uint16_t)mesh->mFaces[i].mIndices[2];
+			}
 
-		totalImageSize = allocDetails.pageOffset + allocDetails.actualSize;
-		totalImageBaseSize += allocDetails.baseSize;
+			//Clear the padding of the last word
+			if (mesh->mNumFaces & 1)
+			{
+				indexMemory[3 * mesh->mNumFaces] = 0;
+			}
 
-		mutualMemoryTypeBits &= memRequirements.memoryTypeBits;
-	}
+			return;
+		}
 
-	//Allocate memory
-	if (!mutualMemoryTypeBits)
-	{
-		FATAL_ERROR("Could not find memory type that supports all images");
-	}
+		unsigned int* indexMemory = (unsigned int*)(memory + details.ranges[0].first);
+		for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
+		{
+			assert(mesh->mFaces[i].mNumIndices == 3);
 
-	uint32_t sceneMemTypeIndex = device->getRenderDevice()->findMemoryType(mutualMemoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			indexMemory[3 * i] = mesh->mFaces[i].mIndices[0];
+			indexMemory[3 * i + 1] = mesh->mFaces[i].mIndices[1];
+			indexMemory[3 * i + 2] = mesh->mFaces[i].mIndices[2];
+		}
+	};
 
-	if (sceneMemTypeIndex == (uint32_t)-1)
+	description.hashGeometry = [scene](uint32_t meshIndex)
 	{
-		FATAL_ERROR("Could not find appropriate memory type for scene");
-	}
+		const aiMesh* mesh = scene->mMeshes[meshIndex];
 
-	VkMemoryAllocateInfo memAllocInfo = {};
-	memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memAllocInfo.allocationSize = totalImageSize;
-	memAllocInfo.memoryTypeIndex = sceneMemTypeIndex;
+		uint64_t hash = Hash::bytes(mesh->mVertices, mesh->mNumVertices * sizeof(aiVector3D));
 
-	VkDeviceMemory imageMemory = VK_NULL_HANDLE;
-	VK_CHECK(vkAllocateMemory(deviceHandle, &memAllocInfo, nullptr, &imageMemory));
+		if (mesh->HasNormals())
+		{
+			hash = Hash::bytes(mesh->mNormals, mesh->mNumVertices * sizeof(aiVector3D), hash);
+		}
 
-	//Upload image data
-	Buffer stagingBuffer = renderDevice->createBuffer(totalImageBaseSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-	//We are going to reuse `totalImageBaseSize` to keep track
-	//of copy offsets
-	totalImageBaseSize = 0;
-
-	renderDevice->executeCommands(1, [&](VkCommandBuffer* commandBuffers)
-	{
-		//Load materials
-		for (size_t i = 0; i < imageAllocDetails.size(); ++i)
-		{
-			ImageAllocDetails& allocDetails = imageAllocDetails[i];
-
-			VK_CHECK(vkBindImageMemory(deviceHandle, allocDetails.image, imageMemory, allocDetails.pageOffset));
-
-			//Create image view
-			VkImageViewCreateInfo imageViewCI = {};
-			imageViewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-			imageViewCI.image = allocDetails.image;
-			imageViewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
-			imageViewCI.format = allocDetails.imageFormat;
-			imageViewCI.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-			imageViewCI.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-			imageViewCI.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-			imageViewCI.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-			imageViewCI.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageViewCI.subresourceRange.baseMipLevel = 0;
-			imageViewCI.subresourceRange.levelCount = 1;
-			imageViewCI.subresourceRange.baseArrayLayer = 0;
-			imageViewCI.subresourceRange.layerCount = 1;
-
-			VK_CHECK(vkCreateImageView(deviceHandle, &imageViewCI, nullptr, &allocDetails.imageView));
-
-			//Copy image data to staging buffer
-			void* mem = nullptr;
-			VK_CHECK(vkMapMemory(deviceHandle, stagingBuffer.memory, totalImageBaseSize, allocDetails.baseSize, 0, &mem));
-
-			memcpy(mem, allocDetails.textureData.get(), allocDetails.baseSize);
-
-			vkUnmapMemory(deviceHandle, stagingBuffer.memory);
-
-			//Original texture data is not needed
-			allocDetails.textureData = nullptr;
-
-			//Record buffer-to-image copy commands
-			VkImageMemoryBarrier imageBarrier = {};
-			imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-			imageBarrier.srcAccessMask = 0;
-			imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			imageBarrier.image = allocDetails.image;
-			imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageBarrier.subresourceRange.baseArrayLayer = 0;
-			imageBarrier.subresourceRange.layerCount = 1;
-			imageBarrier.subresourceRange.baseMipLevel = 0;
-			imageBarrier.subresourceRange.levelCount = 1;
-
-			vkCmdPipelineBarrier(commandBuffers[0],
-				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-				0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
-
-			VkBufferImageCopy region = {};
-			region.bufferOffset = totalImageBaseSize;
-			region.bufferRowLength = 0;
-			region.bufferImageHeight = 0;
-			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			region.imageSubresource.baseArrayLayer = 0;
-			region.imageSubresource.layerCount = 1;
-			region.imageSubresource.mipLevel = 0;
-			region.imageOffset = { 0, 0, 0 };
-			region.imageExtent = { (uint32_t)allocDetails.width, (uint32_t)allocDetails.height, 1 };
-
-			vkCmdCopyBufferToImage(commandBuffers[0], stagingBuffer.buffer, allocDetails.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-			imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imageBarrier.dstAccessMask = 0;
-			imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-			imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-
-			vkCmdPipelineBarrier(commandBuffers[0],
-				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-				0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
-
-			//Increment offset
-			totalImageBaseSize += allocDetails.baseSize;
+		if (mesh->HasTextureCoords(0))
+		{
+			hash = Hash::bytes(mesh->mTextureCoords[0], mesh->mNumVertices * sizeof(aiVector3D), hash);
 		}
-	});
 
-	//Add textures to scene representation
-	for (size_t i = 0; i < imageAllocDetails.size(); ++i)
-	{
-		ImageAllocDetails allocDetails = imageAllocDetails[i];
+		//Meshes without normals or texture coordinates must not match meshes that have zeros
+		hash = Hash::combine(hash, (mesh->HasNormals() ? 1 : 0) | (mesh->HasTextureCoords(0) ? 2 : 0));
 
-		representation.textures.push_back(std::make_tuple(allocDetails.image, allocDetails.imageView, allocDetails.sampler));
-	}
+		for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
+		{
+			hash = Hash::bytes(mesh->mFaces[i].mIndices, mesh->mFaces[i].mNumIndices * sizeof(unsigned int), hash);
+		}
 
-	representation.textureMemory = imageMemory;
+		return hash;
+	};
 
-	renderDevice->destroyBuffer(stagingBuffer);
+	//Load animation data (the importer is freed after loading)
+	std::shared_ptr<SceneAnimationData> animation = SceneAnimationData::import(scene);
 
-	progress->setStageProgress(1.0f);
-}
+	description.animation = animation;
 
-void uploadMaterialMappings(const RaytracingDevice* device, Scene& representation, const std::vector<uint32_t>& materialIndices)
-{
-	const RenderDevice* renderDevice = device->getRenderDevice();
+	//Flatten scene graph
+	uint32_t nodeIndex = 0;
 
-	std::vector<Buffer> stagingBuffers;
+	flattenSceneGraph(scene->mRootNode, glm::identity<glm::mat4>(), animation.get(), nodeIndex, description.instances);
 
-	device->getRenderDevice()->executeCommands(1, [&](VkCommandBuffer* commandBuffers)
+	//Load camera data
+	if (scene->HasCameras())
 	{
-		//Write material data
-		VkDeviceSize materialBufferSize = (VkDeviceSize)materialIndices.size() * sizeof(Material);
-
-		representation.materialBuffer = renderDevice->createBuffer(materialBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		Buffer stagingBuffer = renderDevice->createBuffer(materialBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		const aiCamera* camera = scene->mCameras[0];
 
-		Material* memory = nullptr;
-		VK_CHECK(vkMapMemory(renderDevice->getDevice(), stagingBuffer.memory, 0, materialBufferSize, 0, (void**)&memory));
+		aiNode* cameraNode = scene->mRootNode->FindNode(camera->mName.data);
 
-		for (size_t i = 0; i < materialIndices.size(); ++i)
+		aiMatrix4x4 T;
+		while (cameraNode != scene->mRootNode)
 		{
-			const Material& material = representation.materials[materialIndices[i]];
-
-			memory[i].albedoIndex = material.albedoIndex;
+			T = cameraNode->mTransformation * T;
+			cameraNode = cameraNode->mParent;
 		}
 
-		vkUnmapMemory(renderDevice->getDevice(), stagingBuffer.memory);
-
-		VkBufferCopy region = { 0, 0, materialBufferSize };
-		vkCmdCopyBuffer(commandBuffers[0], stagingBuffer.buffer, representation.materialBuffer.buffer, 1, &region);
+		aiMatrix4x4 R = T;
+		R.a4 = R.b4 = R.c4 = 0.f;
+		R.d4 = 1.f;
 
-		stagingBuffers.push_back(stagingBuffer);
-	});
+		// Transform
+		aiVector3D from = T * camera->mPosition;
+		aiVector3D forward = R * camera->mLookAt;
+		aiVector3D up = R * camera->mUp;
 
-	for (size_t i = 0; i < stagingBuffers.size(); ++i)
-	{
-		renderDevice->destroyBuffer(stagingBuffers[i]);
+		description.hasCamera = true;
+		description.cameraPosition = glm::vec3(from.x, from.y, from.z);
+		description.cameraRotation = glm::quatLookAt(glm::vec3(forward.x, forward.y, forward.z), glm::vec3(up.x, up.y, up.z));
 	}
 }
 
-void createSceneDescriptorSets(const RaytracingDevice* raytracingDevice, Scene& scene, const std::vector<uint32_t>& materialIndices)
+void describeCachedScene(std::shared_ptr<SceneCache> cache, SceneDescription& description)
 {
-	VkDevice device = raytracingDevice->getRenderDevice()->getDevice();
-
-	//Create descriptor set layout
-	uint32_t meshBufferCount = (uint32_t)scene.meshBuffers.size();
-
-	VkDescriptorSetLayoutBinding layoutBinding[] = {
-		{ 0, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, nullptr },
-		{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, meshBufferCount, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR, nullptr },
-		{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, meshBufferCount, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR, nullptr },
-		{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, meshBufferCount, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR, nullptr },
-		{ 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, meshBufferCount, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR, nullptr },
-		{ 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, (uint32_t)scene.textures.size(), VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR, nullptr },
-		{ 6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR, nullptr }
-	};
-
-	VkDescriptorSetLayoutCreateInfo layoutCI = {};
-	layoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutCI.pBindings = layoutBinding;
-	layoutCI.bindingCount = sizeof(layoutBinding) / sizeof(layoutBinding[0]);
-	
-	VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutCI, nullptr, &scene.descriptorSetLayout));
+	for (uint32_t i = 0; i < cache->getMaterialCount(); ++i)
+	{
+		const CachedMaterial& material = cache->getMaterial(i);
 
-	//Create descriptor pool
-	VkDescriptorPoolSize descPoolSizes[] = {
-		{ VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1 },
-		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 * meshBufferCount + 1 },
-		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, (uint32_t)scene.materials.size() }
-	};
+		description.materials.push_back({ material.albedoTexture, (TextureWrap)material.wrapU, (TextureWrap)material.wrapV });
+	}
 
-	VkDescriptorPoolCreateInfo descPoolCI = {};
-	descPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	descPoolCI.poolSizeCount = sizeof(descPoolSizes) / sizeof(descPoolSizes[0]);
-	descPoolCI.pPoolSizes = descPoolSizes;
-	descPoolCI.maxSets = 1;
+	for (uint32_t i = 0; i < cache->getTextureCount(); ++i)
+	{
+		description.textureDecoders.push_back([cache, i](DecodedTexture& decoded)
+		{
+			const CachedTexture& texture = cache->getTexture(i);
 
-	VK_CHECK(vkCreateDescriptorPool(device, &descPoolCI, nullptr, &scene.descriptorPool));
+			if (!texture.isValid)
+			{
+				return false;
+			}
 
-	VkDescriptorSetAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = scene.descriptorPool;
-	allocInfo.descriptorSetCount = 1;
-	allocInfo.pSetLayouts = &scene.descriptorSetLayout;
+			//The format, mip count and data size were checked when the cache was opened
+			TextureFormat format = (TextureFormat)texture.format;
 
-	VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &scene.descriptorSet));
+			decoded.width = texture.width;
+			decoded.height = texture.height;
+			decoded.channelCount = 4;
+			decoded.mipLevelCount = texture.mipLevelCount;
+			decoded.format = format;
+			decoded.hasAlpha = texture.hasAlpha != 0;
 
-	//Update scene descriptor
-	std::vector<VkWriteDescriptorSet> setWrites;
+			//The pixels are read straight from the mapped file, which stays
+			//mapped for as long as anything is referencing them
+			decoded.textureData = std::shared_ptr<uint8_t>(cache, (uint8_t*)cache->getData(texture.dataOffset));
 
-	//Write TLAS (binding = 0)
-	VkAccelerationStructureKHR tlas = scene.tlas.get();
+			return true;
+		});
+	}
 
-	VkWriteDescriptorSetAccelerationStructureKHR tlasSetWrite = {};
-	tlasSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
-	tlasSetWrite.accelerationStructureCount = 1;
-	tlasSetWrite.pAccelerationStructures = &tlas;
+	for (uint32_t i = 0; i < cache->getMeshCount(); ++i)
+	{
+		const CachedMesh& mesh = cache->getMesh(i);
 
-	setWrites.push_back({});
-	setWrites.back().sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	setWrites.back().pNext = &tlasSetWrite;
-	setWrites.back().dstSet = scene.descriptorSet;
-	setWrites.back().dstBinding = 0;
-	setWrites.back().descriptorCount = 1 ;
-	setWrites.back().descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+		description.meshes.push_back({ mesh.vertexCount, mesh.faceCount, mesh.materialIndex });
 
-	//Write position buffers (binding = 1)
-	std::vector<VkDescriptorBufferInfo> vertexPosSetWrites(scene.meshBuffers.size());
-	std::transform(scene.meshBuffers.begin(), scene.meshBuffers.end(), vertexPosSetWrites.begin(), [](const MeshBuffers& val)
-		{ return VkDescriptorBufferInfo{ val.vertexBuffer, val.positionRange.first, val.positionRange.second }; });
+		TriangleOpacity opacity;
+		opacity.isClassified = mesh.isOpacityClassified != 0;
+		opacity.opaqueFaceCount = mesh.opaqueFaceCount;
+		opacity.mixedFaceCount = mesh.mixedFaceCount;
 
-	DESC_SET_WRITE_BUFFER(setWrites, scene.descriptorSet, 1, vertexPosSetWrites, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		description.meshOpacity.push_back(opacity);
+	}
 
-	//Write normal buffers (binding = 2)
-	std::vector<VkDescriptorBufferInfo> vertexNormalSetWrites(scene.meshBuffers.size());
-	std::transform(scene.meshBuffers.begin(), scene.meshBuffers.end(), vertexNormalSetWrites.begin(), [](const MeshBuffers& val)
-		{ return VkDescriptorBufferInfo{ val.vertexBuffer, val.normalRange.first, val.normalRange.second }; });
+	//The cooked data is already laid out like the staging memory
+	description.writeVertexData = [cache](uint32_t meshIndex, uint8_t* memory, const VertexBufferAllocDetails& details)
+	{
+		const CachedMesh& mesh = cache->getMesh(meshIndex);
 
-	DESC_SET_WRITE_BUFFER(setWrites, scene.descriptorSet, 2, vertexNormalSetWrites, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		if (mesh.vertexDataSize != details.totalRangeSize)
+		{
+			FATAL_ERROR("Scene cache has invalid vertex data (mesh %u)\n", meshIndex);
+			return;
+		}
 
-	//Write texCoord buffers (binding = 3)
-	std::vector<VkDescriptorBufferInfo> vertexTexCoordSetWrites(scene.meshBuffers.size());
-	std::transform(scene.meshBuffers.begin(), scene.meshBuffers.end(), vertexTexCoordSetWrites.begin(), [](const MeshBuffers& val)
-		{ return VkDescriptorBufferInfo{ val.vertexBuffer, val.texCoordRange.first, val.texCoordRange.second }; });
+		memcpy(memory, cache->getData(mesh.vertexDataOffset), mesh.vertexDataSize);
+	};
 
-	DESC_SET_WRITE_BUFFER(setWrites, scene.descriptorSet, 3, vertexTexCoordSetWrites, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+	description.writeIndexData = [cache](uint32_t meshIndex, uint8_t* memory, const IndexBufferAllocDetails& details)
+	{
+		const CachedMesh& mesh = cache->getMesh(meshIndex);
 
-	//Write index buffers (binding = 4)
-	std::vector<VkDescriptorBufferInfo> indexSetWrites(scene.meshBuffers.size());
-	std::transform(scene.meshBuffers.begin(), scene.meshBuffers.end(), indexSetWrites.begin(), [](const MeshBuffers& val)
-		{ return VkDescriptorBufferInfo{ val.indexBuffer, val.indexOffset, val.indexSize }; });
+		if (mesh.indexDataSize != details.totalRangeSize)
+		{
+			FATAL_ERROR("Scene cache has invalid index data (mesh %u)\n", meshIndex);
+			return;
+		}
 
-	DESC_SET_WRITE_BUFFER(setWrites, scene.descriptorSet, 4, indexSetWrites, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		memcpy(memory, cache->getData(mesh.indexDataOffset), mesh.indexDataSize);
+	};
 
-	//Write textures (binding = 5)
-	std::vector<VkDescriptorImageInfo> imageSetWrites(scene.textures.size());
-	std::transform(scene.textures.begin(), scene.textures.end(), imageSetWrites.begin(), [](const std::tuple<VkImage, VkImageView, VkSampler>& texture)
-		{ return VkDescriptorImageInfo{ std::get<2>(texture), std::get<1>(texture), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }; });
+	//Shared meshes were cooked with the same data offsets
+	description.hashGeometry = [cache](uint32_t meshIndex)
+	{
+		const CachedMesh& mesh = cache->getMesh(meshIndex);
 
-	DESC_SET_WRITE_IMAGE(setWrites, scene.descriptorSet, 5, imageSetWrites, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		return Hash::combine(Hash::value(mesh.vertexDataOffset), Hash::value(mesh.indexDataOffset));
+	};
 
-	//Write material buffer (binding = 6)
-	std::vector<VkDescriptorBufferInfo> materialSetWrites = { { scene.materialBuffer.buffer, 0, (VkDeviceSize)materialIndices.size() * sizeof(Material) } };
+	for (uint32_t i = 0; i < cache->getInstanceCount(); ++i)
+	{
+		const CachedInstance& instance = cache->getInstance(i);
 
-	DESC_SET_WRITE_BUFFER(setWrites, scene.descriptorSet, 6, materialSetWrites, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+		description.instances.push_back({ instance.transform, instance.meshIndex });
+	}
 
-	vkUpdateDescriptorSets(device, (uint32_t)setWrites.size(), setWrites.data(), 0, nullptr);
+	description.hasCamera = cache->hasCamera();
+	description.cameraPosition = cache->getCameraPosition();
+	description.cameraRotation = cache->getCameraRotation();
 }
 
-std::shared_ptr<Scene> SceneLoader::loadScene(const RaytracingDevice* device, const char* scenePath, std::shared_ptr<SceneLoadProgress> progress)
+std::shared_ptr<Scene> SceneLoader::loadScene(const RaytracingDevice* device, const char* scenePath, std::shared_ptr<SceneLoadProgress> progress, const SceneLoadOptions& options)
 {
 	if (!progress)
 	{
@@ -876,78 +2361,147 @@ std::shared_ptr<Scene> SceneLoader::loadScene(const RaytracingDevice* device, co
 
 	progress->begin(4, "Importing scene");
 
-	//Import scene from file
-	std::cout << "Importing scene " << scenePath << "... ";
-
 	std::string path = Resources::resolvePath(scenePath);
 
 	auto start = std::chrono::high_resolution_clock::now();
 
-	Assimp::Importer importer;
-	importer.SetProgressHandler(new ProgressTracker(progress));
+	//Try to load the scene from the cache
+	SceneCacheKey cacheKey;
+	std::string cachePath;
+	std::shared_ptr<SceneCache> cache = nullptr;
 
-	const aiScene* scene = importer.ReadFile(path.c_str(), aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_ConvertToLeftHanded);
+	bool compressTextures = options.compressTextures && device->isTextureCompressionBCSupported();
 
-	auto end = std::chrono::high_resolution_clock::now();
-	std::cout << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / 1000.0f << "s" << std::endl;
+	if (options.compressTextures && !compressTextures)
+	{
+		std::cout << "Texture compression is not supported by the device, textures will be uncompressed" << std::endl;
+	}
 
-	if (!scene)
+	//Options that change the cooked data
+	uint32_t cookedOptions = (compressTextures ? 1 : 0) | (options.compactVertices ? 2 : 0) | (options.optimizeMeshes ? 4 : 0) | (options.classifyTriangleOpacity ? 8 : 0);
+	uint64_t optionsHash = Hash::value(cookedOptions);
+
+	bool canUseCache = options.useSceneCache && SceneCache::createKey(path, GEOMETRY_RANGE_ALIGNMENT, optionsHash, cacheKey);
+
+	if (canUseCache)
 	{
-		std::cout << "Assimp Error:\n" << importer.GetErrorString() << std::endl;
+		cachePath = SceneCache::getCachePath(path);
+		cache = SceneCache::open(cachePath, cacheKey, options.compactVertices);
+	}
 
-		progress->finish();
+	SceneDescription description;
+	description.compactVertices = options.compactVertices;
 
-		return nullptr;
+	//The description references the imported scene, so the importer must outlive it
+	Assimp::Importer importer;
+	std::unique_ptr<SceneCacheWriter> cacheWriter = nullptr;
+
+	if (cache)
+	{
+		std::cout << "Loading cached scene " << cachePath << "... ";
+
+		describeCachedScene(cache, description);
+	}
+	else
+	{
+		//Import scene from file
+		std::cout << "Importing scene " << scenePath << "... ";
+
+		importer.SetProgressHandler(new ProgressTracker(progress));
+
+		const aiScene* scene = importer.ReadFile(path.c_str(), aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_ConvertToLeftHanded);
+
+		if (!scene)
+		{
+			std::cout << "Assimp Error:\n" << importer.GetErrorString() << std::endl;
+
+			progress->finish();
+
+			return nullptr;
+		}
+
+		//The scene isn't referenced by anything but the importer yet, so it can be modified in place
+		if (options.optimizeMeshes)
+		{
+			optimizeImportedMeshes(const_cast<aiScene*>(scene));
+		}
+
+		describeImportedScene(scene, scenePath, compressTextures, options.classifyTriangleOpacity, description);
+
+		//Cook the scene while it's being loaded (the cache doesn't store animations)
+		if (canUseCache && description.animation)
+		{
+			std::cout << "Scene is animated, it won't be written to the scene cache" << std::endl;
+		}
+		else if (canUseCache)
+		{
+			cacheWriter = std::make_unique<SceneCacheWriter>();
+
+			if (!cacheWriter->begin(cachePath, cacheKey, (uint32_t)description.meshes.size(), (uint32_t)description.textureDecoders.size()))
+			{
+				cacheWriter = nullptr;
+			}
+		}
 	}
 
+	auto end = std::chrono::high_resolution_clock::now();
+	std::cout << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / 1000.0f << "s" << std::endl;
+
 	progress->nextStage("Loading materials");
 
 	std::shared_ptr<Scene> representation = std::make_shared<Scene>();
 	representation->device = device;
 
-	std::vector<uint32_t> materialIndices;
+	if (description.compactVertices)
+	{
+		representation->shaderDefinitions.push_back("#define COMPACT_VERTICES");
+	}
+
+	representation->loadStatistics.importTime = secondsBetween(start, end);
+	representation->loadStatistics.loadedFromCache = cache != nullptr;
+
+	//All mesh and texture data is streamed through a fixed amount of staging memory
+	StagingRing stagingRing;
+	stagingRing.init(device->getRenderDevice(), STAGING_RING_SIZE, STAGING_RING_SEGMENT_COUNT, options.batchUploads);
 
 	//Load materials
-	loadMaterials(device, scenePath, scene, *representation, progress);
+	auto stageStart = std::chrono::high_resolution_clock::now();
+
+	std::vector<std::shared_ptr<const AlphaMask>> materialAlphaMasks;
+
+	loadMaterials(device, description, *representation, stagingRing, progress, cacheWriter.get(), materialAlphaMasks);
+
+	representation->loadStatistics.materialTime = secondsBetween(stageStart, std::chrono::high_resolution_clock::now());
 
 	progress->nextStage("Loading scene graph");
 
 	//Load scene graph (meshes)
-	loadSceneGraph(device, scene, *representation, materialIndices);
+	//Built BLASes are cached alongside the scene
+	std::string blasCachePath = canUseCache ? BLASCache::getCachePath(path) : "";
 
-	//Upload material mapping indices
-	uploadMaterialMappings(device, *representation, materialIndices);
+	loadSceneGraph(device, description, *representation, options, materialAlphaMasks, stagingRing, cacheWriter.get(), blasCachePath, Hash::value(cacheKey));
 
-	progress->nextStage("Creating descriptors");
+	//Upload materials
+	uploadMaterials(device, *representation, stagingRing);
 
-	//Create scene descriptor sets
-	createSceneDescriptorSets(device, *representation, materialIndices);
+	representation->loadStatistics.stagingStats = stagingRing.getStats();
 
-	//Load camera data
-	if (scene->HasCameras())
-	{
-		const aiCamera* camera = scene->mCameras[0];
+	stagingRing.destroy();
 
-		aiNode* cameraNode = scene->mRootNode->FindNode(camera->mName.data);
+	progress->nextStage("Creating descriptors");
 
-		aiMatrix4x4 T;
-		while (cameraNode != scene->mRootNode)
-		{
-			T = cameraNode->mTransformation * T;
-			cameraNode = cameraNode->mParent;
-		}
+	//Create scene descriptor sets
+	stageStart = std::chrono::high_resolution_clock::now();
 
-		aiMatrix4x4 R = T;
-		R.a4 = R.b4 = R.c4 = 0.f;
-		R.d4 = 1.f;
+	createSceneDescriptorSets(device, *representation);
 
-		// Transform
-		aiVector3D from = T * camera->mPosition;
-		aiVector3D forward = R * camera->mLookAt;
-		aiVector3D up = R * camera->mUp;
+	representation->loadStatistics.descriptorTime = secondsBetween(stageStart, std::chrono::high_resolution_clock::now());
 
-		representation->cameraPosition = glm::vec3(from.x, from.y, from.z);
-		representation->cameraRotation = glm::quatLookAt(glm::vec3(forward.x, forward.y, forward.z), glm::vec3(up.x, up.y, up.z));
+	//Load camera data
+	if (description.hasCamera)
+	{
+		representation->cameraPosition = description.cameraPosition;
+		representation->cameraRotation = description.cameraRotation;
 	}
 	else
 	{
@@ -955,45 +2509,86 @@ std::shared_ptr<Scene> SceneLoader::loadScene(const RaytracingDevice* device, co
 		representation->cameraRotation = glm::identity<glm::quat>();
 	}
 
+	//Finish writing the cache
+	if (cacheWriter)
+	{
+		for (const SceneMaterial& material : description.materials)
+		{
+			cacheWriter->addMaterial(material.albedoTexture, material.wrapU, material.wrapV);
+		}
+
+		for (const SceneInstance& instance : description.instances)
+		{
+			cacheWriter->addInstance(instance.transform, instance.meshIndex);
+		}
+
+		if (description.hasCamera)
+		{
+			cacheWriter->setCamera(description.cameraPosition, description.cameraRotation);
+		}
+
+		if (cacheWriter->finish())
+		{
+			std::cout << "Wrote scene cache " << cachePath << std::endl;
+		}
+	}
+
 	importer.FreeScene();
 
+	representation->loadStatistics.totalTime = secondsBetween(start, std::chrono::high_resolution_clock::now());
+	representation->loadStatistics.print();
+
 	progress->finish();
 	
 	return representation;
 };
 
+bool Scene::animate(VkCommandBuffer commandBuffer, double deltaTime)
+{
+	if (!animator)
+	{
+		return false;
+	}
+
+	animator->update(commandBuffer, deltaTime, blasBuildResult, tlas);
+
+	return true;
+}
+
 Scene::~Scene()
 {
 	VkDevice deviceHandle = device->getRenderDevice()->getDevice();
 
+	if (animator)
+	{
+		animator->destroy();
+	}
+
 	//Destroy acceleration structures
 	tlas.destroy();
 
-	for (BottomLevelAS& blas : blasBuildResult.blasList)
-	{
-		device->destroyBLAS(blas);
-	}
+	device->destroyBLAS(blasBuildResult);
 
 	//Destroy buffers
-	for (MeshBuffers& buffers : meshBuffers)
+	for (const Buffer& buffer : geometryBuffers)
 	{
-		vkDestroyBuffer(deviceHandle, buffers.vertexBuffer, nullptr);
-		vkDestroyBuffer(deviceHandle, buffers.indexBuffer, nullptr);
+		device->getRenderDevice()->destroyBuffer(buffer);
 	}
 
-	vkFreeMemory(deviceHandle, meshMemory, nullptr);
-
 	//Destroy texutres
-	for (const std::tuple<VkImage, VkImageView, VkSampler>& texture : textures)
+	for (const std::pair<VkImage, VkImageView>& texture : textures)
 	{
-		vkDestroyImage(deviceHandle, std::get<0>(texture), nullptr);
-		vkDestroyImageView(deviceHandle, std::get<1>(texture), nullptr);
-		vkDestroySampler(deviceHandle, std::get<2>(texture), nullptr);
+		vkDestroyImage(deviceHandle, texture.first, nullptr);
+		vkDestroyImageView(deviceHandle, texture.second, nullptr);
 	}
 
-	vkFreeMemory(deviceHandle, textureMemory, nullptr);
+	for (const Allocation& memory : textureMemoryBlocks)
+	{
+		device->getRenderDevice()->freeMemory(memory);
+	}
 
 	device->getRenderDevice()->destroyBuffer(materialBuffer);
+	device->getRenderDevice()->destroyBuffer(geometryRecordBuffer);
 
 	//Destroy descriptors
 	if (descriptorSetLayout != VK_NULL_HANDLE)
@@ -7,24 +7,75 @@
 #include <memory>
 #include <mutex>
 #include <atomic>
+#include <string>
+#include <vector>
 
 #include "api/RaytracingDevice.h"
+#include "api/StagingRing.h"
+
+#include "SceneAnimation.h"
+
+/*
+ ------------------------------
+	Note on the material table
+ ------------------------------
+
+ The hit shaders find the material of a geometry through the material index in its geometry record. The material
+ fields are stored as a structure of arrays, so a shader only loads the fields it reads, and adding fields doesn't
+ make the existing lookups touch more memory. The material buffer starts with a `MaterialTable`, which is bound as a
+ uniform buffer and holds the device address of every field's array. The arrays follow it in the same buffer and
+ are indexed by the material index.
+*/
 
 struct Material
 {
 	uint32_t albedoIndex;
+
+	//Index into the scene's samplers (only meaningful if the material has a texture)
+	uint32_t samplerIndex;
+};
+
+//The header of the material buffer (see "Note on the material table")
+struct MaterialTable
+{
+	//uint32_t per material
+	VkDeviceAddress albedoIndices;
+	VkDeviceAddress samplerIndices;
+};
+
+//The mesh's index data stores 16-bit indices (packed two per word)
+#define MESH_FLAG_16_BIT_INDICES 1
+
+//Tells the hit shaders where the data of a hit geometry is and which material it uses. The records
+//of a TLAS instance start at its custom index and are indexed by the geometry index.
+struct GeometryRecord
+{
+	//The device addresses of the mesh's data (see "Note on geometry buffers")
+	VkDeviceAddress positions;
+	VkDeviceAddress normals;
+	VkDeviceAddress texCoords;
+	VkDeviceAddress indices;
+
+	uint32_t materialIndex;
+
+	//MESH_FLAG_*
+	uint32_t flags;
+
+	//The first triangle of the geometry within the mesh's index data
+	uint32_t firstFace;
+
+	uint32_t padding;
 };
 
+//The device addresses of a geometry's data within the scene's geometry buffers
 struct MeshBuffers
 {
-	VkBuffer vertexBuffer;
-	std::pair<VkDeviceSize, VkDeviceSize> positionRange;
-	std::pair<VkDeviceSize, VkDeviceSize> texCoordRange;
-	std::pair<VkDeviceSize, VkDeviceSize> normalRange;
-
-	VkBuffer indexBuffer;
-	VkDeviceSize indexOffset;
-	VkDeviceSize indexSize;
+	VkDeviceAddress positionAddress;
+	VkDeviceAddress texCoordAddress;
+	VkDeviceAddress normalAddress;
+
+	VkDeviceAddress indexAddress;
+	VkIndexType indexType;
 };
 
 class SceneLoadProgress
@@ -73,32 +124,83 @@ public:
 	}
 };
 
+/*
+ ------------------------------
+	  Note on scene memory
+ ------------------------------
+
+ The vertex and index data of a scene is packed into geometry buffers of (up to) SCENE_MEMORY_BLOCK_SIZE bytes, and its
+ textures into memory blocks of the same size. A single allocation can't be larger than maxMemoryAllocationSize, which
+ is only 2-4GB on many drivers, so packing a large scene into one allocation would fail. Resources are packed in order
+ and a new block is started when a resource doesn't fit into the current one (resources that are larger than a block
+ get a block of their own).
+
+ The blocks are allocated through the device memory allocator, so the blocks of small scenes are sub-allocated
+ like any other resource.
+*/
+
+//Size of the memory blocks that the buffers and textures of a scene are packed into (clamped to maxMemoryAllocationSize)
+#define SCENE_MEMORY_BLOCK_SIZE (256ull * 1024 * 1024)
+
+//Timings (in seconds) of each part of a scene load, used to benchmark the loader
+struct SceneLoadStatistics
+{
+	double importTime = 0.0;
+	double materialTime = 0.0;
+	double meshUploadTime = 0.0;
+	double accelerationStructureTime = 0.0;
+	double descriptorTime = 0.0;
+	double totalTime = 0.0;
+
+	bool loadedFromCache = false;
+	bool blasLoadedFromCache = false;
+
+	StagingRingStats stagingStats;
+
+	void print() const;
+};
+
 class Scene
 {
 public:
 	TopLevelAS tlas;
 	BLASBuildResult blasBuildResult;
 
-	//The memory from which all mesh buffers are allocated (this does 
-	//not include acceleration structures, only vertex and index data)
-	VkDeviceMemory meshMemory;
+	//The buffers that hold the vertex and index data of all meshes (see "Note on geometry buffers")
+	std::vector<Buffer> geometryBuffers;
 
-	//All buffers in `meshBuffers` are allocated from `sceneMemory`
+	//Where the data of each geometry is within `geometryBuffers`
 	std::vector<MeshBuffers> meshBuffers;
 
-	//The memory from which all texture are allocated
-	VkDeviceMemory textureMemory;
+	//The memory blocks from which all textures are allocated
+	std::vector<Allocation> textureMemoryBlocks;
 
 	//All textures that are needed by the scene
-	std::vector<std::tuple<VkImage, VkImageView, VkSampler>> textures;
+	std::vector<std::pair<VkImage, VkImageView>> textures;
+
+	//The distinct samplers that the textures are read with (owned by the device's sampler cache)
+	std::vector<VkSampler> samplers;
 
 	std::vector<Material> materials;
 	std::vector<bool> isMaterialOpaque;
+
+	//The material table and its field arrays (see "Note on the material table")
 	Buffer materialBuffer;
 
+	//The `GeometryRecord`s referenced by the TLAS instances
+	Buffer geometryRecordBuffer;
+
+	//Plays back the scene's animation (`nullptr` if the scene is static)
+	std::unique_ptr<SceneAnimator> animator = nullptr;
+
 	glm::vec3 cameraPosition;
 	glm::quat cameraRotation;
 
+	//Definitions that tell the shaders how the scene data is laid out
+	std::vector<std::string> shaderDefinitions;
+
+	SceneLoadStatistics loadStatistics;
+
 	//Descriptor set
 	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
 	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
@@ -107,10 +209,43 @@ public:
 	const RaytracingDevice* device = nullptr;
 public:
 	~Scene();
+
+	//Advances the animation and records the updates of the acceleration structures. Returns false if the scene is static.
+	bool animate(VkCommandBuffer commandBuffer, double deltaTime);
+};
+
+struct SceneLoadOptions
+{
+	//Load the scene from the scene cache if possible, and cook it into the cache otherwise
+	bool useSceneCache = true;
+
+	//Record all staging copies to the same buffer with a single command
+	bool batchUploads = true;
+
+	//Compress textures to BC1/BC7 (ignored if the device doesn't support BC formats)
+	bool compressTextures = false;
+
+	//Store octahedral-encoded normals and half precision texture coordinates
+	bool compactVertices = false;
+
+	//Weld duplicate vertices and sort triangles spatially before upload (see `MeshOptimizer`)
+	bool optimizeMeshes = false;
+
+	//Merge small meshes of the same node into multi-geometry BLASes (reduces the TLAS instance count)
+	bool mergeSmallMeshes = false;
+
+	//Split the triangles of meshes with alpha into opaque and mixed geometries (see "Note on triangle opacity")
+	bool classifyTriangleOpacity = true;
+
+	//How the BLASes of the scene are built (host builds fall back to batched ones if they aren't supported)
+	BLASBuildMode blasBuildMode = BLASBuildMode::Batched;
+
+	//Build the BLASes of the scene with every supported mode and print how long each one took
+	bool benchmarkBLASBuilds = false;
 };
 
 class SceneLoader
 {
 public:
-	static std::shared_ptr<Scene> loadScene(const RaytracingDevice* device, const char* scenePath, std::shared_ptr<SceneLoadProgress> progress = nullptr);
+	static std::shared_ptr<Scene> loadScene(const RaytracingDevice* device, const char* scenePath, std::shared_ptr<SceneLoadProgress> progress = nullptr, const SceneLoadOptions& options = SceneLoadOptions());
 };
\ No newline at end of file
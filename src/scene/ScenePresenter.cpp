@@ -88,7 +88,7 @@ void ScenePresenter::createPipeline()
 	samplerCI.maxLod = 1.0f;
 	samplerCI.unnormalizedCoordinates = VK_FALSE;
 
-	vkCreateSampler(m_device->getDevice(), &samplerCI, nullptr, &m_sampler);
+	m_sampler = m_device->getSampler(samplerCI);
 
 	//Create descriptor set
 	VkDescriptorSetLayoutBinding setLayoutBindings[] = {
@@ -420,16 +420,13 @@ void ScenePresenter::destroyImGui()
 
 void ScenePresenter::updateUniforms(int targetWidth, int targetHeight)
 {
-	int* mem = nullptr;
-	VK_CHECK(vkMapMemory(m_device->getDevice(), m_displayQuadData.memory, 0, 4 * sizeof(int), 0, (void**)&mem));
+	int* mem = (int*)m_displayQuadData.allocation.mappedData;
 
 	mem[0] = m_width;
 	mem[1] = m_height;
 
 	mem[2] = targetWidth;
 	mem[3] = targetHeight;
-
-	vkUnmapMemory(m_device->getDevice(), m_displayQuadData.memory);
 }
 
 void ScenePresenter::init(const RenderDevice* device, const Window& window, int initialWidth, int initialHeight)
@@ -463,8 +460,6 @@ void ScenePresenter::destroy()
 
 	m_device->destroyBuffer(m_displayQuadData);
 
-	vkDestroySampler(m_device->getDevice(), m_sampler, nullptr);
-
 	vkDestroyDescriptorSetLayout(m_device->getDevice(), m_descLayout, nullptr);
 	vkDestroyDescriptorPool(m_device->getDevice(), m_descriptorPool, nullptr);
 
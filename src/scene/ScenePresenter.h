@@ -20,6 +20,7 @@ private:
 	VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
 	VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
 
+	//Owned by the device's sampler cache
 	VkSampler m_sampler = VK_NULL_HANDLE;
 
 	VkRenderPass m_renderPass = VK_NULL_HANDLE;
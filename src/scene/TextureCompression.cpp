@@ -0,0 +1,545 @@
+#include "TextureCompression.h"
+
+#include "utils/MappedFile.h"
+#include "utils/ThreadPool.h"
+#include "utils/Hash.h"
+
+#include <Common.h>
+
+#define STB_DXT_IMPLEMENTATION
+#include <stb_dxt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+
+uint32_t TextureCompression::getBlockExtent(TextureFormat format)
+{
+	return format == TextureFormat::RGBA8 ? 1 : 4;
+}
+
+uint32_t TextureCompression::getBlockSize(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::BC1: return 8;
+	case TextureFormat::BC7: return 16;
+	default: return 4;
+	}
+}
+
+size_t TextureCompression::getLevelSize(TextureFormat format, uint32_t width, uint32_t height)
+{
+	uint32_t blockExtent = getBlockExtent(format);
+
+	size_t blocksX = (width + blockExtent - 1) / blockExtent;
+	size_t blocksY = (height + blockExtent - 1) / blockExtent;
+
+	return blocksX * blocksY * getBlockSize(format);
+}
+
+size_t TextureCompression::getLevelOffset(TextureFormat format, uint32_t width, uint32_t height, uint32_t level)
+{
+	return getChainSize(format, width, height, level);
+}
+
+size_t TextureCompression::getChainSize(TextureFormat format, uint32_t width, uint32_t height, uint32_t levelCount)
+{
+	size_t size = 0;
+
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		size += getLevelSize(format, std::max(width >> level, 1u), std::max(height >> level, 1u));
+	}
+
+	return size;
+}
+
+std::shared_ptr<uint8_t> TextureCompression::compressChain(TextureFormat format, const uint8_t* chain, uint32_t width, uint32_t height, uint32_t levelCount)
+{
+	std::shared_ptr<uint8_t> output((uint8_t*)malloc(getChainSize(format, width, height, levelCount)), free);
+
+	uint32_t blockSize = getBlockSize(format);
+
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		uint32_t levelWidth = std::max(width >> level, 1u);
+		uint32_t levelHeight = std::max(height >> level, 1u);
+
+		const uint8_t* src = chain + getLevelOffset(TextureFormat::RGBA8, width, height, level);
+		uint8_t* dst = output.get() + getLevelOffset(format, width, height, level);
+
+		uint32_t blocksX = (levelWidth + 3) / 4;
+		uint32_t blocksY = (levelHeight + 3) / 4;
+
+		ThreadPool::global().parallelFor(blocksY, [&](size_t blockY)
+		{
+			uint8_t texels[64];
+
+			for (uint32_t blockX = 0; blockX < blocksX; ++blockX)
+			{
+				//Blocks that go past the edge of the level repeat the last row/column
+				for (uint32_t y = 0; y < 4; ++y)
+				{
+					uint32_t srcY = std::min((uint32_t)blockY * 4 + y, levelHeight - 1);
+
+					for (uint32_t x = 0; x < 4; ++x)
+					{
+						uint32_t srcX = std::min(blockX * 4 + x, levelWidth - 1);
+
+						memcpy(&texels[4 * (4 * y + x)], src + 4 * ((size_t)srcY * levelWidth + srcX), 4);
+					}
+				}
+
+				uint8_t* block = dst + ((size_t)blockY * blocksX + blockX) * blockSize;
+
+				if (format == TextureFormat::BC1)
+				{
+					compressBC1Block(texels, block);
+				}
+				else
+				{
+					compressBC7Block(texels, block);
+				}
+			}
+		});
+	}
+
+	return output;
+}
+
+void TextureCompression::compressBC1Block(const uint8_t* texels, uint8_t* output)
+{
+	stb_compress_dxt_block(output, texels, 0, STB_DXT_HIGHQUAL);
+}
+
+void TextureCompression::compressBC7Block(const uint8_t* texels, uint8_t* output)
+{
+	static const uint32_t weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	//Find the principal axis of the block's texels (power iteration on the covariance matrix)
+	float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float minValue[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+	float maxValue[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			mean[c] += texels[4 * i + c] / 16.0f;
+			minValue[c] = std::min(minValue[c], (float)texels[4 * i + c]);
+			maxValue[c] = std::max(maxValue[c], (float)texels[4 * i + c]);
+		}
+	}
+
+	float covariance[4][4] = {};
+
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		for (uint32_t a = 0; a < 4; ++a)
+		{
+			for (uint32_t b = 0; b < 4; ++b)
+			{
+				covariance[a][b] += (texels[4 * i + a] - mean[a]) * (texels[4 * i + b] - mean[b]);
+			}
+		}
+	}
+
+	float axis[4];
+
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		axis[c] = maxValue[c] - minValue[c];
+	}
+
+	for (uint32_t iteration = 0; iteration < 8; ++iteration)
+	{
+		float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float length = 0.0f;
+
+		for (uint32_t a = 0; a < 4; ++a)
+		{
+			for (uint32_t b = 0; b < 4; ++b)
+			{
+				next[a] += covariance[a][b] * axis[b];
+			}
+
+			length = std::max(length, std::abs(next[a]));
+		}
+
+		if (length < 1e-6f)
+		{
+			break;
+		}
+
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3]);
+
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		axis[c] = axisLength > 1e-6f ? axis[c] / axisLength : 0.0f;
+	}
+
+	//Place the endpoints at the extremes of the texels projected onto the axis
+	float minT = 0.0f;
+	float maxT = 0.0f;
+
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		float t = 0.0f;
+
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			t += (texels[4 * i + c] - mean[c]) * axis[c];
+		}
+
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+
+	//Try every combination of p-bits and keep the one with the smallest error
+	uint32_t bestError = UINT32_MAX;
+	uint32_t bestEndpoints[2][4] = {};
+	uint32_t bestPBits[2] = {};
+	uint32_t bestIndices[16] = {};
+
+	for (uint32_t pBits = 0; pBits < 4; ++pBits)
+	{
+		uint32_t p[2] = { pBits & 1, pBits >> 1 };
+
+		uint32_t endpoints[2][4];
+		int32_t palette[16][4];
+
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			float values[2] = { mean[c] + axis[c] * minT, mean[c] + axis[c] * maxT };
+
+			for (uint32_t e = 0; e < 2; ++e)
+			{
+				int32_t quantized = (int32_t)std::floor((values[e] - p[e]) / 2.0f + 0.5f);
+
+				endpoints[e][c] = (uint32_t)std::min(std::max(quantized, 0), 127);
+			}
+
+			int32_t e0 = (endpoints[0][c] << 1) | p[0];
+			int32_t e1 = (endpoints[1][c] << 1) | p[1];
+
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				palette[i][c] = ((64 - weights[i]) * e0 + weights[i] * e1 + 32) >> 6;
+			}
+		}
+
+		uint32_t error = 0;
+		uint32_t indices[16];
+
+		for (uint32_t i = 0; i < 16 && error < bestError; ++i)
+		{
+			uint32_t bestTexelError = UINT32_MAX;
+
+			for (uint32_t j = 0; j < 16; ++j)
+			{
+				uint32_t texelError = 0;
+
+				for (uint32_t c = 0; c < 4; ++c)
+				{
+					int32_t difference = (int32_t)texels[4 * i + c] - palette[j][c];
+					texelError += difference * difference;
+				}
+
+				if (texelError < bestTexelError)
+				{
+					bestTexelError = texelError;
+					indices[i] = j;
+				}
+			}
+
+			error += bestTexelError;
+		}
+
+		if (error < bestError)
+		{
+			bestError = error;
+
+			memcpy(bestEndpoints, endpoints, sizeof(endpoints));
+			memcpy(bestPBits, p, sizeof(p));
+			memcpy(bestIndices, indices, sizeof(indices));
+		}
+	}
+
+	//The most significant bit of the first index is implied to be 0, so swap the endpoints if it isn't
+	if (bestIndices[0] & 8)
+	{
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			std::swap(bestEndpoints[0][c], bestEndpoints[1][c]);
+		}
+
+		std::swap(bestPBits[0], bestPBits[1]);
+
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			bestIndices[i] = 15 - bestIndices[i];
+		}
+	}
+
+	//Pack block (mode 6: 7-bit mode, 8 x 7-bit endpoints, 2 p-bits, 63 index bits)
+	uint64_t bits[2] = { 0, 0 };
+	uint32_t bitPosition = 0;
+
+	auto writeBits = [&](uint32_t value, uint32_t count)
+	{
+		for (uint32_t i = 0; i < count; ++i, ++bitPosition)
+		{
+			bits[bitPosition / 64] |= (uint64_t)((value >> i) & 1) << (bitPosition % 64);
+		}
+	};
+
+	writeBits(1 << 6, 7);
+
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		writeBits(bestEndpoints[0][c], 7);
+		writeBits(bestEndpoints[1][c], 7);
+	}
+
+	writeBits(bestPBits[0], 1);
+	writeBits(bestPBits[1], 1);
+
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		writeBits(bestIndices[i], i == 0 ? 3 : 4);
+	}
+
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		output[i] = (uint8_t)(bits[i / 8] >> (8 * (i % 8)));
+	}
+}
+
+std::shared_ptr<uint8_t> TextureCompression::decompressLevel(TextureFormat format, const uint8_t* level, uint32_t width, uint32_t height)
+{
+	std::shared_ptr<uint8_t> output((uint8_t*)malloc(4 * (size_t)width * height), free);
+
+	if (format == TextureFormat::RGBA8)
+	{
+		memcpy(output.get(), level, 4 * (size_t)width * height);
+		return output;
+	}
+
+	uint32_t blockSize = getBlockSize(format);
+
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+
+	std::atomic<bool> succeeded(true);
+
+	ThreadPool::global().parallelFor(blocksY, [&](size_t blockY)
+	{
+		uint8_t texels[64];
+
+		for (uint32_t blockX = 0; blockX < blocksX && succeeded; ++blockX)
+		{
+			const uint8_t* block = level + ((size_t)blockY * blocksX + blockX) * blockSize;
+
+			if (format == TextureFormat::BC1)
+			{
+				decompressBC1Block(block, texels);
+			}
+			else if (!decompressBC7Block(block, texels))
+			{
+				succeeded = false;
+				break;
+			}
+
+			//Blocks that go past the edge of the level only write the texels inside of it
+			for (uint32_t y = 0; y < 4 && blockY * 4 + y < height; ++y)
+			{
+				uint32_t rowWidth = std::min(4u, width - blockX * 4);
+
+				memcpy(output.get() + 4 * ((blockY * 4 + y) * width + blockX * 4), &texels[4 * (4 * y)], 4 * rowWidth);
+			}
+		}
+	});
+
+	return succeeded ? output : nullptr;
+}
+
+void TextureCompression::decompressBC1Block(const uint8_t* block, uint8_t* texels)
+{
+	uint32_t colors[2] = { (uint32_t)block[0] | ((uint32_t)block[1] << 8), (uint32_t)block[2] | ((uint32_t)block[3] << 8) };
+	uint32_t indices = (uint32_t)block[4] | ((uint32_t)block[5] << 8) | ((uint32_t)block[6] << 16) | ((uint32_t)block[7] << 24);
+
+	//Expand the RGB565 endpoints to 8 bits per channel
+	uint32_t palette[4][4];
+
+	for (uint32_t e = 0; e < 2; ++e)
+	{
+		uint32_t r = (colors[e] >> 11) & 0x1F;
+		uint32_t g = (colors[e] >> 5) & 0x3F;
+		uint32_t b = colors[e] & 0x1F;
+
+		palette[e][0] = (r << 3) | (r >> 2);
+		palette[e][1] = (g << 2) | (g >> 4);
+		palette[e][2] = (b << 3) | (b >> 2);
+		palette[e][3] = 255;
+	}
+
+	//The endpoint order selects between four colors and three colors with transparent black
+	for (uint32_t c = 0; c < 3; ++c)
+	{
+		if (colors[0] > colors[1])
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+
+	palette[2][3] = 255;
+	palette[3][3] = colors[0] > colors[1] ? 255 : 0;
+
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		uint32_t index = (indices >> (2 * i)) & 3;
+
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			texels[4 * i + c] = (uint8_t)palette[index][c];
+		}
+	}
+}
+
+bool TextureCompression::decompressBC7Block(const uint8_t* block, uint8_t* texels)
+{
+	static const uint32_t weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	//Mode 6 is stored as six zero bits followed by a one
+	if ((block[0] & 0x3F) != 0 || (block[0] & 0x40) == 0)
+	{
+		return false;
+	}
+
+	uint32_t bitPosition = 7;
+
+	auto readBits = [&](uint32_t count)
+	{
+		uint32_t value = 0;
+
+		for (uint32_t i = 0; i < count; ++i, ++bitPosition)
+		{
+			value |= (uint32_t)((block[bitPosition / 8] >> (bitPosition % 8)) & 1) << i;
+		}
+
+		return value;
+	};
+
+	uint32_t endpoints[2][4];
+
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		endpoints[0][c] = readBits(7);
+		endpoints[1][c] = readBits(7);
+	}
+
+	uint32_t pBits[2];
+	pBits[0] = readBits(1);
+	pBits[1] = readBits(1);
+
+	for (uint32_t i = 0; i < 16; ++i)
+	{
+		uint32_t index = readBits(i == 0 ? 3 : 4);
+
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			uint32_t e0 = (endpoints[0][c] << 1) | pBits[0];
+			uint32_t e1 = (endpoints[1][c] << 1) | pBits[1];
+
+			texels[4 * i + c] = (uint8_t)(((64 - weights[index]) * e0 + weights[index] * e1 + 32) >> 6);
+		}
+	}
+
+	return true;
+}
+
+std::string getCompressedTexturePath(uint64_t sourceHash)
+{
+	return Resources::cachePath(Hash::toHex(sourceHash) + ".vkrtex");
+}
+
+std::shared_ptr<uint8_t> TextureCompression::loadCached(uint64_t sourceHash, CompressedTextureHeader& header)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+
+	if (!file->open(getCompressedTexturePath(sourceHash)) || file->getSize() < sizeof(CompressedTextureHeader))
+	{
+		return nullptr;
+	}
+
+	memcpy(&header, file->getData(), sizeof(CompressedTextureHeader));
+
+	if (memcmp(header.magic, "VKRT", 4) != 0 || header.version != COMPRESSED_TEXTURE_CACHE_VERSION || header.sourceHash != sourceHash ||
+		(header.format != TextureFormat::BC1 && header.format != TextureFormat::BC7) || header.width == 0 || header.height == 0 ||
+		header.mipLevelCount == 0 || header.mipLevelCount > 32 ||
+		header.dataSize != getChainSize(header.format, header.width, header.height, header.mipLevelCount) ||
+		header.dataSize > file->getSize() - sizeof(CompressedTextureHeader))
+	{
+		return nullptr;
+	}
+
+	return std::shared_ptr<uint8_t>(file, (uint8_t*)file->getData() + sizeof(CompressedTextureHeader));
+}
+
+bool TextureCompression::storeCached(const CompressedTextureHeader& header, const uint8_t* data)
+{
+	std::string path = getCompressedTexturePath(header.sourceHash);
+
+	//Write to a temporary file first, so that a partially written file is never picked up
+	std::string temporaryPath = path + ".tmp" + Hash::toHex(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		CompressedTextureHeader fileHeader = header;
+		memcpy(fileHeader.magic, "VKRT", 4);
+		fileHeader.version = COMPRESSED_TEXTURE_CACHE_VERSION;
+
+		file.write((const char*)&fileHeader, sizeof(fileHeader));
+		file.write((const char*)data, header.dataSize);
+
+		if (!file.good())
+		{
+			file.close();
+			std::filesystem::remove(temporaryPath);
+
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temporaryPath, path, error);
+
+	if (error)
+	{
+		std::filesystem::remove(temporaryPath, error);
+		return false;
+	}
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+ ------------------------------
+	Note on texture compression
+ ------------------------------
+
+ When texture compression is enabled, textures are block-compressed on the CPU after their mip chain has
+ been generated. Opaque textures are compressed to BC1 (8 bytes per 4x4 block) and textures with alpha to
+ BC7 (16 bytes per 4x4 block), compared to the 64 bytes it takes to store a block of RGBA8 texels.
+
+ BC1 blocks are encoded with stb_dxt. BC7 blocks are encoded with mode 6 only (a single subset with RGBA
+ endpoints and 4-bit indices), which is fast to search and works well for most color textures.
+
+ The CPU decoders are only used to inspect the texels that the GPU samples (for example to classify triangle opacity,
+ see "Note on triangle opacity"). They follow the fixed-point interpolation of the BC formats, so the decoded BC7 texels
+ match what the hardware returns.
+
+ Encoding is much slower than decoding, so the results are stored in the cache directory, keyed by the hash
+ of the encoded source image (the file or the embedded texture), and reused by any scene that uses the same image.
+*/
+
+enum class TextureFormat : uint32_t
+{
+	RGBA8 = 0,
+	BC1 = 1,
+	BC7 = 2
+};
+
+//Bump this whenever the encoders or the layout of the compressed texture cache change
+#define COMPRESSED_TEXTURE_CACHE_VERSION 1
+
+struct CompressedTextureHeader
+{
+	char magic[4];
+	uint32_t version;
+
+	uint64_t sourceHash;
+
+	TextureFormat format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipLevelCount;
+	uint32_t hasAlpha;
+	uint32_t reserved;
+
+	//The size of the mip chain, which follows the header
+	uint64_t dataSize;
+};
+
+class TextureCompression
+{
+public:
+	//The width/height of a texel block and the number of bytes it takes
+	static uint32_t getBlockExtent(TextureFormat format);
+	static uint32_t getBlockSize(TextureFormat format);
+
+	static size_t getLevelSize(TextureFormat format, uint32_t width, uint32_t height);
+	static size_t getLevelOffset(TextureFormat format, uint32_t width, uint32_t height, uint32_t level);
+	static size_t getChainSize(TextureFormat format, uint32_t width, uint32_t height, uint32_t levelCount);
+
+	//Compresses a tightly packed RGBA8 mip chain. The blocks of each level are encoded in parallel on the global thread pool.
+	static std::shared_ptr<uint8_t> compressChain(TextureFormat format, const uint8_t* chain, uint32_t width, uint32_t height, uint32_t levelCount);
+
+	//Encode a block of 4x4 RGBA8 texels (stored row by row)
+	static void compressBC1Block(const uint8_t* texels, uint8_t* output);
+	static void compressBC7Block(const uint8_t* texels, uint8_t* output);
+
+	//Decompresses a level to tightly packed RGBA8 texels. BC7 blocks are only decoded in mode 6 (the only mode the
+	//encoder writes), so nullptr is returned if a block uses any other mode.
+	static std::shared_ptr<uint8_t> decompressLevel(TextureFormat format, const uint8_t* level, uint32_t width, uint32_t height);
+
+	//Decode a block to 4x4 RGBA8 texels (stored row by row)
+	static void decompressBC1Block(const uint8_t* block, uint8_t* texels);
+	static bool decompressBC7Block(const uint8_t* block, uint8_t* texels);
+
+	//Returns a pointer to the cached mip chain of a source image (which stays valid for as long as
+	//the returned pointer is referenced) or nullptr if it hasn't been compressed yet
+	static std::shared_ptr<uint8_t> loadCached(uint64_t sourceHash, CompressedTextureHeader& header);
+	static bool storeCached(const CompressedTextureHeader& header, const uint8_t* data);
+};
\ No newline at end of file
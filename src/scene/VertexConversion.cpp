@@ -0,0 +1,323 @@
+#include "VertexConversion.h"
+
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define VERTEX_CONVERSION_X86
+
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+//MSVC allows intrinsics for any instruction set to be used without extra compiler flags,
+//GCC and Clang need the functions that use them to be marked
+#ifdef _MSC_VER
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#endif
+#endif
+
+/**************************************/
+/*           Scalar kernels           */
+/**************************************/
+
+void vec3ToVec2Scalar(const float* src, float* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		dst[2 * i] = src[3 * i];
+		dst[2 * i + 1] = src[3 * i + 1];
+	}
+}
+
+void vec3ToHalf2Scalar(const float* src, uint32_t* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		dst[i] = VertexConversion::floatToHalf(src[3 * i]) | ((uint32_t)VertexConversion::floatToHalf(src[3 * i + 1]) << 16);
+	}
+}
+
+#ifdef VERTEX_CONVERSION_X86
+
+/**************************************/
+/*             SSE kernels            */
+/**************************************/
+
+void vec3ToVec2SSE(const float* src, float* dst, size_t count)
+{
+	size_t i = 0;
+
+	//Convert 4 vectors (12 floats in, 8 floats out) per iteration
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 a = _mm_loadu_ps(src + 3 * i);     //x0 y0 z0 x1
+		__m128 b = _mm_loadu_ps(src + 3 * i + 4); //y1 z1 x2 y2
+		__m128 c = _mm_loadu_ps(src + 3 * i + 8); //z2 x3 y3 z3
+
+		__m128 t = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 3, 3));        //x1 x1 y1 y1
+		__m128 out0 = _mm_shuffle_ps(a, t, _MM_SHUFFLE(2, 0, 1, 0));     //x0 y0 x1 y1
+		__m128 out1 = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 1, 3, 2));     //x2 y2 x3 y3
+
+		_mm_storeu_ps(dst + 2 * i, out0);
+		_mm_storeu_ps(dst + 2 * i + 4, out1);
+	}
+
+	vec3ToVec2Scalar(src + 3 * i, dst + 2 * i, count - i);
+}
+
+/**************************************/
+/*            AVX2 kernels            */
+/**************************************/
+
+//Loads 8 vectors (24 floats) and returns their first two components (16 floats)
+TARGET_AVX2 inline void loadVec3ToVec2x8(const float* src, __m256& out0, __m256& out1)
+{
+	const __m256i permuteA = _mm256_setr_epi32(0, 1, 3, 4, 6, 7, 0, 0);
+	const __m256i permuteB0 = _mm256_setr_epi32(0, 0, 0, 0, 0, 0, 1, 2);
+	const __m256i permuteB1 = _mm256_setr_epi32(4, 5, 7, 0, 0, 0, 0, 0);
+	const __m256i permuteC = _mm256_setr_epi32(0, 0, 0, 0, 2, 3, 5, 6);
+
+	__m256 a = _mm256_loadu_ps(src);      //Floats 0-7
+	__m256 b = _mm256_loadu_ps(src + 8);  //Floats 8-15
+	__m256 c = _mm256_loadu_ps(src + 16); //Floats 16-23
+
+	//Floats 0 1 3 4 6 7 | 9 10
+	out0 = _mm256_blend_ps(_mm256_permutevar8x32_ps(a, permuteA), _mm256_permutevar8x32_ps(b, permuteB0), 0xC0);
+
+	//Floats 12 13 15 | 16 18 19 21 22
+	out1 = _mm256_blend_ps(_mm256_permutevar8x32_ps(b, permuteB1), _mm256_permutevar8x32_ps(c, permuteC), 0xF8);
+}
+
+TARGET_AVX2 void vec3ToVec2AVX2(const float* src, float* dst, size_t count)
+{
+	size_t i = 0;
+
+	//Convert 8 vectors (24 floats in, 16 floats out) per iteration
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 out0, out1;
+		loadVec3ToVec2x8(src + 3 * i, out0, out1);
+
+		_mm256_storeu_ps(dst + 2 * i, out0);
+		_mm256_storeu_ps(dst + 2 * i + 8, out1);
+	}
+
+	vec3ToVec2SSE(src + 3 * i, dst + 2 * i, count - i);
+}
+
+TARGET_AVX2 void vec3ToHalf2AVX2(const float* src, uint32_t* dst, size_t count)
+{
+	size_t i = 0;
+
+	//Convert 8 vectors (24 floats in, 16 halfs out) per iteration
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 out0, out1;
+		loadVec3ToVec2x8(src + 3 * i, out0, out1);
+
+		_mm_storeu_si128((__m128i*)(dst + i), _mm256_cvtps_ph(out0, _MM_FROUND_TO_NEAREST_INT));
+		_mm_storeu_si128((__m128i*)(dst + i + 4), _mm256_cvtps_ph(out1, _MM_FROUND_TO_NEAREST_INT));
+	}
+
+	vec3ToHalf2Scalar(src + 3 * i, dst + i, count - i);
+}
+
+bool isAVX2Supported()
+{
+	unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+#ifdef _MSC_VER
+	int info[4];
+
+	__cpuid(info, 1);
+	ecx = info[2];
+#else
+	__get_cpuid(1, &eax, &ebx, &ecx, &edx);
+#endif
+
+	//The OS must save the AVX registers (OSXSAVE + AVX). F16C is
+	//required too, which every CPU that supports AVX2 also supports.
+	bool osSavesAVX = (ecx & (1u << 27)) && (ecx & (1u << 28));
+	bool hasF16C = (ecx & (1u << 29)) != 0;
+
+	if (!osSavesAVX || !hasF16C)
+	{
+		return false;
+	}
+
+#ifdef _MSC_VER
+	unsigned long long xcr0 = _xgetbv(0);
+#else
+	unsigned int xcr0Low, xcr0High;
+	__asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+
+	unsigned long long xcr0 = ((unsigned long long)xcr0High << 32) | xcr0Low;
+#endif
+
+	if ((xcr0 & 0x6) != 0x6)
+	{
+		return false;
+	}
+
+#ifdef _MSC_VER
+	__cpuidex(info, 7, 0);
+	ebx = info[1];
+#else
+	__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx);
+#endif
+
+	return (ebx & (1u << 5)) != 0;
+}
+
+#endif
+
+/**************************************/
+/*              Dispatch              */
+/**************************************/
+
+VertexConversion::InstructionSet VertexConversion::getInstructionSet()
+{
+#ifdef VERTEX_CONVERSION_X86
+	static const InstructionSet instructionSet = isAVX2Supported() ? InstructionSet::AVX2 : InstructionSet::SSE;
+#else
+	static const InstructionSet instructionSet = InstructionSet::Scalar;
+#endif
+
+	return instructionSet;
+}
+
+const char* VertexConversion::getInstructionSetName()
+{
+	switch (getInstructionSet())
+	{
+	case InstructionSet::AVX2: return "AVX2";
+	case InstructionSet::SSE: return "SSE";
+	default: return "Scalar";
+	}
+}
+
+void VertexConversion::copyVec3(const float* src, float* dst, size_t count)
+{
+	memcpy(dst, src, count * 3 * sizeof(float));
+}
+
+void VertexConversion::vec3ToVec2(const float* src, float* dst, size_t count)
+{
+	switch (getInstructionSet())
+	{
+#ifdef VERTEX_CONVERSION_X86
+	case InstructionSet::AVX2: vec3ToVec2AVX2(src, dst, count); break;
+	case InstructionSet::SSE: vec3ToVec2SSE(src, dst, count); break;
+#endif
+	default: vec3ToVec2Scalar(src, dst, count); break;
+	}
+}
+
+void VertexConversion::vec3ToHalf2(const float* src, uint32_t* dst, size_t count)
+{
+	switch (getInstructionSet())
+	{
+#ifdef VERTEX_CONVERSION_X86
+	case InstructionSet::AVX2: vec3ToHalf2AVX2(src, dst, count); break;
+#endif
+	default: vec3ToHalf2Scalar(src, dst, count); break;
+	}
+}
+
+void VertexConversion::packOctahedral(const float* src, uint32_t* dst, size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		float x = src[3 * i];
+		float y = src[3 * i + 1];
+		float z = src[3 * i + 2];
+
+		//Project onto the octahedron and fold the lower half over the upper one
+		float sum = std::abs(x) + std::abs(y) + std::abs(z);
+
+		if (sum > 0.0f)
+		{
+			x /= sum;
+			y /= sum;
+		}
+
+		if (z < 0.0f)
+		{
+			float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+
+			x = foldedX;
+			y = foldedY;
+		}
+
+		int32_t packedX = (int32_t)std::round(std::min(std::max(x, -1.0f), 1.0f) * 32767.0f);
+		int32_t packedY = (int32_t)std::round(std::min(std::max(y, -1.0f), 1.0f) * 32767.0f);
+
+		dst[i] = ((uint32_t)packedX & 0xFFFF) | ((uint32_t)packedY << 16);
+	}
+}
+
+uint16_t VertexConversion::floatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t mantissa = bits & 0x7FFFFF;
+	int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+
+	//Infinity and NaN
+	if (((bits >> 23) & 0xFF) == 0xFF)
+	{
+		return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+	}
+
+	//Too large, round to infinity
+	if (exponent >= 31)
+	{
+		return (uint16_t)(sign | 0x7C00);
+	}
+
+	//Denormals (rounded to nearest even)
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+		{
+			return (uint16_t)sign;
+		}
+
+		mantissa |= 0x800000;
+
+		uint32_t shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+
+		if (remainder > halfway || (remainder == halfway && (half & 1)))
+		{
+			half++;
+		}
+
+		return (uint16_t)(sign | half);
+	}
+
+	//Normals (rounded to nearest even, a carry correctly moves into the exponent)
+	uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1FFF;
+
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+	{
+		half++;
+	}
+
+	return (uint16_t)half;
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ ------------------------------
+	Note on vertex conversion
+ ------------------------------
+
+ Assimp stores positions, normals and texture coordinates as arrays of `aiVector3D` (3 floats),
+ while the renderer stores texture coordinates as 2 floats. The conversion kernels below are
+ written with SSE and AVX2 intrinsics (with a scalar fallback for other architectures) and the
+ best one supported by the CPU is picked at runtime.
+
+ Positions and normals have the same layout in both representations, so they are just copied.
+
+ In compact vertex mode, normals are octahedral-encoded into two 16-bit snorm values and texture
+ coordinates are stored as two halfs (both match GLSL's `unpackSnorm2x16` and `unpackHalf2x16`).
+*/
+
+class VertexConversion
+{
+public:
+	enum class InstructionSet
+	{
+		Scalar,
+		SSE,
+		AVX2
+	};
+public:
+	//Copies `count` 3-component vectors
+	static void copyVec3(const float* src, float* dst, size_t count);
+
+	//Copies the first two components of `count` 3-component vectors
+	static void vec3ToVec2(const float* src, float* dst, size_t count);
+
+	//Converts the first two components of `count` 3-component vectors to halfs
+	static void vec3ToHalf2(const float* src, uint32_t* dst, size_t count);
+
+	//Octahedral-encodes `count` unit vectors
+	static void packOctahedral(const float* src, uint32_t* dst, size_t count);
+
+	static uint16_t floatToHalf(float value);
+
+	//The instruction set used by the conversion kernels
+	static InstructionSet getInstructionSet();
+	static const char* getInstructionSetName();
+};
\ No newline at end of file
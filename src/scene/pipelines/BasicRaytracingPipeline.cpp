@@ -18,6 +18,7 @@ bool BasicRaytracingPipeline::create(const RaytracingDevice* device, RTPipelineI
 	
 	//Load pipeline shaders
 	std::vector<std::string> definitions = { camera->getCameraDefintions() };
+	definitions.insert(definitions.end(), m_scene->shaderDefinitions.begin(), m_scene->shaderDefinitions.end());
 
 	pipelineInfo.addRaygenShaderFromPath(renderDevice, "asset://shaders/rtsimple/simple.rgen", definitions);
 	pipelineInfo.addMissShaderFromPath(renderDevice, "asset://shaders/rtsimple/simple.rmiss", definitions);
@@ -39,6 +39,7 @@ bool SamplerZooPipeline::create(const RaytracingDevice* device, RTPipelineInfo&
 
 	//Load pipeline shaders
 	std::vector<std::string> definitions = { s_samplerDefs[m_samplerIndex], camera->getCameraDefintions() };
+	definitions.insert(definitions.end(), m_scene->shaderDefinitions.begin(), m_scene->shaderDefinitions.end());
 
 	pipelineInfo.addRaygenShaderFromPath(renderDevice, "asset://shaders/sampler_zoo/sampler_zoo.rgen", definitions);
 	pipelineInfo.addMissShaderFromPath(renderDevice, "asset://shaders/sampler_zoo/sampler_zoo.rmiss", definitions);
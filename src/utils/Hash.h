@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+class Hash
+{
+public:
+	//64-bit MurmurHash2 (MurmurHash64A). It is not cryptographic, but it is fast
+	//and well distributed, which is all that's needed for content-addressed caches.
+	static uint64_t bytes(const void* data, size_t size, uint64_t seed = 0)
+	{
+		const uint64_t m = 0xc6a4a7935bd1e995ull;
+		const int r = 47;
+
+		uint64_t h = seed ^ (size * m);
+
+		const uint8_t* bytePointer = (const uint8_t*)data;
+		const uint8_t* end = bytePointer + (size & ~(size_t)7);
+
+		for (; bytePointer != end; bytePointer += 8)
+		{
+			uint64_t k;
+			memcpy(&k, bytePointer, sizeof(k));
+
+			k *= m;
+			k ^= k >> r;
+			k *= m;
+
+			h ^= k;
+			h *= m;
+		}
+
+		switch (size & 7)
+		{
+		case 7: h ^= uint64_t(bytePointer[6]) << 48; [[fallthrough]];
+		case 6: h ^= uint64_t(bytePointer[5]) << 40; [[fallthrough]];
+		case 5: h ^= uint64_t(bytePointer[4]) << 32; [[fallthrough]];
+		case 4: h ^= uint64_t(bytePointer[3]) << 24; [[fallthrough]];
+		case 3: h ^= uint64_t(bytePointer[2]) << 16; [[fallthrough]];
+		case 2: h ^= uint64_t(bytePointer[1]) << 8; [[fallthrough]];
+		case 1: h ^= uint64_t(bytePointer[0]);
+				h *= m;
+		};
+
+		h ^= h >> r;
+		h *= m;
+		h ^= h >> r;
+
+		return h;
+	}
+
+	static uint64_t string(const std::string& value, uint64_t seed = 0)
+	{
+		return bytes(value.data(), value.size(), seed);
+	}
+
+	template<typename T>
+	static uint64_t value(const T& value, uint64_t seed = 0)
+	{
+		return bytes(&value, sizeof(T), seed);
+	}
+
+	static uint64_t combine(uint64_t a, uint64_t b)
+	{
+		return a ^ (b + 0x9e3779b97f4a7c15ull + (a << 6) + (a >> 2));
+	}
+
+	static std::string toHex(uint64_t hash)
+	{
+		static const char* digits = "0123456789abcdef";
+
+		std::string result(16, '0');
+
+		for (int i = 15; i >= 0; --i, hash >>= 4)
+		{
+			result[i] = digits[hash & 0xF];
+		}
+
+		return result;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+//Read-only memory mapping of a whole file
+class MappedFile
+{
+private:
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+
+#ifdef _WIN32
+	void* m_fileHandle = nullptr;
+	void* m_mappingHandle = nullptr;
+#else
+	int m_fileDescriptor = -1;
+#endif
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	~MappedFile();
+
+	bool open(const std::string& path);
+	void close();
+
+	inline const uint8_t* getData() const { return m_data; }
+	inline size_t getSize() const { return m_size; }
+
+	inline bool isOpen() const { return m_data != nullptr; }
+
+	MappedFile& operator=(const MappedFile&) = delete;
+};
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+{
+	threadCount = std::max(threadCount, 1u);
+
+	for (unsigned int i = 0; i < threadCount; ++i)
+	{
+		m_workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_stopping = true;
+	}
+
+	m_taskAvailable.notify_all();
+
+	for (std::thread& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true)
+	{
+		std::function<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_taskAvailable.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+
+			if (m_stopping && m_tasks.empty())
+			{
+				return;
+			}
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop();
+		}
+
+		task();
+	}
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& func)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	struct SharedState
+	{
+		std::atomic<size_t> nextIndex{ 0 };
+		std::atomic<size_t> completedCount{ 0 };
+
+		std::mutex lock;
+		std::condition_variable finished;
+	};
+
+	//Helpers can start after the caller has already returned (if the caller ended
+	//up doing all the work), so the state they touch must outlive this function
+	std::shared_ptr<SharedState> state = std::make_shared<SharedState>();
+	std::shared_ptr<std::function<void(size_t)>> work = std::make_shared<std::function<void(size_t)>>(func);
+
+	auto runItems = [state, work, count]()
+	{
+		size_t index;
+		while ((index = state->nextIndex++) < count)
+		{
+			(*work)(index);
+
+			if (++state->completedCount == count)
+			{
+				std::lock_guard<std::mutex> guard(state->lock);
+				state->finished.notify_all();
+			}
+		}
+	};
+
+	size_t helperCount = std::min(count, m_workers.size()) - 1;
+
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		for (size_t i = 0; i < helperCount; ++i)
+		{
+			m_tasks.push(runItems);
+		}
+	}
+
+	m_taskAvailable.notify_all();
+
+	runItems();
+
+	std::unique_lock<std::mutex> lock(state->lock);
+	state->finished.wait(lock, [&]() { return state->completedCount == count; });
+}
+
+ThreadPool& ThreadPool::global()
+{
+	static ThreadPool pool(std::thread::hardware_concurrency());
+
+	return pool;
+}
\ No newline at end of file
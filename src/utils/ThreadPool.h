@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+class ThreadPool
+{
+private:
+	std::vector<std::thread> m_workers;
+	std::queue<std::function<void()>> m_tasks;
+
+	std::mutex m_lock;
+	std::condition_variable m_taskAvailable;
+	bool m_stopping = false;
+private:
+	void workerLoop();
+public:
+	ThreadPool(unsigned int threadCount);
+	ThreadPool(const ThreadPool&) = delete;
+	~ThreadPool();
+
+	template<typename F>
+	auto submit(F&& func) -> std::future<decltype(func())>
+	{
+		typedef decltype(func()) ReturnType;
+
+		std::shared_ptr<std::packaged_task<ReturnType()>> task = std::make_shared<std::packaged_task<ReturnType()>>(std::forward<F>(func));
+		std::future<ReturnType> result = task->get_future();
+
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_tasks.push([task]() { (*task)(); });
+		}
+
+		m_taskAvailable.notify_one();
+
+		return result;
+	}
+
+	//Runs `func` for every index in [0, count). The calling thread takes part in the
+	//work, so it is safe to call this from inside a task that is running on the pool.
+	void parallelFor(size_t count, const std::function<void(size_t)>& func);
+
+	inline size_t getThreadCount() const { return m_workers.size(); }
+
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	//Pool shared by the whole application, sized to the number of hardware threads
+	static ThreadPool& global();
+};
\ No newline at end of file